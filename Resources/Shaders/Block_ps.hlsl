@@ -16,6 +16,8 @@ struct Input {
     float4 pos : SV_POSITION;
     float4 normal : NORMAL0;
     float2 uv : TEXCOORD0;
+    float shade : TEXCOORD1;
+    float3 tint : TEXCOORD2;
 };
 
 float4 main(Input input) : SV_TARGET {
@@ -33,6 +35,10 @@ float4 main(Input input) : SV_TARGET {
     // Apply Diffuse color
     finalColor += saturate(dot(float4(Direction, 0), input.normal) * Diffuse * color);
     
+    // Apply voxel light : every level lost darkens the face by 20%, down to a floor so that caves stay readable
+    finalColor.rgb *= max(pow(0.8f, input.shade * 15.0f), 0.1f);
+    finalColor.rgb *= input.tint;
+    
     
     // Clipping
     clip(color.a < 0.1 ? -1 : 1);
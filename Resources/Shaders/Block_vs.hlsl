@@ -8,6 +8,8 @@ struct Input {
 cbuffer ModelData : register(b0) {
     float4x4 Model;
     bool isInstance;
+    // Level of detail the chunk is drawn at, to tint it (0 for none)
+    int LodTint;
 };
 cbuffer CameraData : register(b1) {
     float4x4 View;
@@ -18,6 +20,8 @@ struct Output {
     float4 pos : SV_POSITION;
     float4 normal : NORMAL0;
     float2 uv : TEXCOORD0;
+    float shade : TEXCOORD1;
+    float3 tint : TEXCOORD2;
 };
 
 Output main(Input input) {
@@ -32,8 +36,11 @@ Output main(Input input) {
     output.pos = mul(input.pos, Model);
     output.pos = mul(output.pos, View);
     output.pos = mul(output.pos, Projection);
-    output.normal = mul(input.normal, Model);
+    // The normal's W is how much the face is in the dark (baked voxel light, 0 for the buildings)
+    output.normal = mul(float4(input.normal.xyz, 0.0f), Model);
+    output.shade = input.normal.w;
     output.uv = input.uv; 
+    output.tint = LodTint == 1 ? float3(0.6f, 1.0f, 0.6f) : (LodTint == 2 ? float3(1.0f, 0.6f, 0.6f) : float3(1.0f, 1.0f, 1.0f));
 
 	return output;
 }
\ No newline at end of file
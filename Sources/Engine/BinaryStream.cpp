@@ -0,0 +1,77 @@
+#include "pch.h"
+
+#include "BinaryStream.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+
+// Writes bytes in an open file. WriteFile takes 32 bits sizes.
+static bool WriteAll(HANDLE file, const std::vector<uint8_t>& buffer) {
+	size_t offset = 0;
+	while (offset < buffer.size()) {
+		DWORD toWrite = (DWORD)std::min<size_t>(buffer.size() - offset, 1u << 30);
+		DWORD count = 0;
+		if (!WriteFile(file, buffer.data() + offset, toWrite, &count, nullptr) || count != toWrite) return false;
+		offset += count;
+	}
+	return true;
+}
+
+bool BinaryWriter::SaveToFile(const std::wstring& path) const {
+	std::wstring tempPath = path + L".tmp";
+
+	HANDLE file = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	bool written = WriteAll(file, buffer);
+	CloseHandle(file);
+
+	if (!written || !MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileW(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool BinaryWriter::AppendToFile(const std::wstring& path) const {
+	HANDLE file = CreateFileW(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	bool written = WriteAll(file, buffer);
+	CloseHandle(file);
+	return written;
+}
+
+#else
+
+// Writes bytes in an open file
+static bool WriteAll(FILE* file, const std::vector<uint8_t>& buffer) {
+	return fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+}
+
+bool BinaryWriter::SaveToFile(const std::wstring& path) const {
+	std::string finalPath = ToUtf8(path);
+	std::string tempPath = finalPath + ".tmp";
+
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (!file) return false;
+
+	bool written = WriteAll(file, buffer);
+	written &= fclose(file) == 0;
+
+	if (!written || rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool BinaryWriter::AppendToFile(const std::wstring& path) const {
+	FILE* file = fopen(ToUtf8(path).c_str(), "ab");
+	if (!file) return false;
+
+	bool written = WriteAll(file, buffer);
+	return fclose(file) == 0 && written;
+}
+
+#endif
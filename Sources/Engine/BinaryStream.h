@@ -0,0 +1,212 @@
+#pragma once
+
+/// <summary>
+/// Computes the FNV-1a hash of some bytes
+/// </summary>
+/// <param name="data">The bytes</param>
+/// <param name="size">The number of bytes</param>
+/// <param name="hash">The hash to continue from (to hash several blocks of data)</param>
+/// <returns>The hash</returns>
+inline uint64_t Fnv1a64(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/// <summary>
+/// Writes binary data in memory, to save it in a file afterward
+/// </summary>
+class BinaryWriter {
+	std::vector<uint8_t> buffer;
+public:
+	BinaryWriter() {}
+
+	/// <summary>
+	/// Writes a value (copied as is)
+	/// </summary>
+	/// <param name="value">The value</param>
+	template<typename T>
+	void Write(const T& value) {
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be written");
+		WriteBytes(&value, sizeof(T));
+	}
+
+	/// <summary>
+	/// Writes some bytes
+	/// </summary>
+	/// <param name="data">The bytes</param>
+	/// <param name="size">The number of bytes</param>
+	void WriteBytes(const void* data, size_t size) {
+		buffer.insert(buffer.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+	}
+
+	/// <summary>
+	/// Overwrites a value written before (sizes, checksums, ... only known at the end)
+	/// </summary>
+	/// <param name="offset">The value's offset</param>
+	/// <param name="value">The value</param>
+	template<typename T>
+	void WriteAt(size_t offset, const T& value) {
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be written");
+		memcpy(buffer.data() + offset, &value, sizeof(T));
+	}
+
+	/// <summary>
+	/// Writes an unsigned integer on as few bytes as possible (7 bits per byte, small values take 1 byte)
+	/// </summary>
+	/// <param name="value">The value</param>
+	void WriteVarUint(uint64_t value) {
+		while (value >= 0x80) {
+			buffer.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		buffer.push_back((uint8_t)value);
+	}
+
+	/// <summary>
+	/// Writes bytes with run-length encoding, as (run length - 1, value) pairs.
+	/// Meant for data with long runs of the same value (blocks, tiles).
+	/// </summary>
+	/// <param name="data">The bytes</param>
+	/// <param name="size">The number of bytes</param>
+	void WriteRle(const uint8_t* data, size_t size) {
+		// Worst case : a pair for every byte
+		size_t start = buffer.size();
+		buffer.resize(start + size * 2);
+		uint8_t* out = buffer.data() + start;
+
+		const uint8_t* end = data + size;
+		while (data < end) {
+			uint8_t value = *data;
+			const uint8_t* runEnd = data + std::min<size_t>(end - data, 256);
+			const uint8_t* q = data + 1;
+			while (q < runEnd && *q == value) q++;
+
+			*out++ = (uint8_t)(q - data - 1);
+			*out++ = value;
+			data = q;
+		}
+		buffer.resize(out - buffer.data());
+	}
+
+	// Gets the written bytes
+	const uint8_t* GetData() const { return buffer.data(); }
+
+	// Gets the number of written bytes
+	size_t GetSize() const { return buffer.size(); }
+
+	/// <summary>
+	/// Saves the written bytes in a file. They are written in a temporary file first,
+	/// so that the file is never left half written.
+	/// </summary>
+	/// <param name="path">The file's path</param>
+	/// <returns>True if the file was saved</returns>
+	bool SaveToFile(const std::wstring& path) const;
+
+	/// <summary>
+	/// Appends the written bytes at the end of a file (created if it doesn't exist)
+	/// </summary>
+	/// <param name="path">The file's path</param>
+	/// <returns>True if the bytes were appended</returns>
+	bool AppendToFile(const std::wstring& path) const;
+};
+
+/// <summary>
+/// Reads binary data from memory (usually a mapped file). Reads past the end fail instead of crashing.
+/// </summary>
+class BinaryReader {
+	const uint8_t* p;
+	const uint8_t* end;
+	bool failed = false;
+public:
+	BinaryReader(const void* data, size_t size) : p((const uint8_t*)data), end((const uint8_t*)data + size) {}
+
+	/// <summary>
+	/// Reads a value
+	/// </summary>
+	/// <param name="value">The value</param>
+	/// <returns>False if there wasn't enough data</returns>
+	template<typename T>
+	bool Read(T& value) {
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be read");
+		return ReadBytes(&value, sizeof(T));
+	}
+
+	/// <summary>
+	/// Reads some bytes
+	/// </summary>
+	/// <param name="data">Where to copy the bytes</param>
+	/// <param name="size">The number of bytes</param>
+	/// <returns>False if there wasn't enough data</returns>
+	bool ReadBytes(void* data, size_t size) {
+		const uint8_t* bytes = Skip(size);
+		if (!bytes) return false;
+		memcpy(data, bytes, size);
+		return true;
+	}
+
+	/// <summary>
+	/// Moves forward without copying the bytes
+	/// </summary>
+	/// <param name="size">The number of bytes</param>
+	/// <returns>The skipped bytes, nullptr if there wasn't enough data</returns>
+	const uint8_t* Skip(size_t size) {
+		if (failed || (size_t)(end - p) < size) {
+			failed = true;
+			return nullptr;
+		}
+		const uint8_t* bytes = p;
+		p += size;
+		return bytes;
+	}
+
+	/// <summary>
+	/// Reads an integer written with WriteVarUint
+	/// </summary>
+	/// <param name="value">The value</param>
+	/// <returns>False if there wasn't enough data</returns>
+	bool ReadVarUint(uint64_t& value) {
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			const uint8_t* byte = Skip(1);
+			if (!byte) return false;
+			value |= (uint64_t)(*byte & 0x7F) << shift;
+			if (!(*byte & 0x80)) return true;
+		}
+		failed = true;
+		return false;
+	}
+
+	/// <summary>
+	/// Reads bytes written with WriteRle
+	/// </summary>
+	/// <param name="data">Where to write the bytes</param>
+	/// <param name="size">The number of bytes to read</param>
+	/// <returns>False if the runs don't match the size</returns>
+	bool ReadRle(uint8_t* data, size_t size) {
+		const uint8_t* q = p;
+		uint8_t* out = data;
+		uint8_t* outEnd = data + size;
+		while (out < outEnd) {
+			if (failed || end - q < 2 || (size_t)q[0] + 1 > (size_t)(outEnd - out)) {
+				failed = true;
+				return false;
+			}
+			size_t run = (size_t)q[0] + 1;
+			memset(out, q[1], run);
+			out += run;
+			q += 2;
+		}
+		p = q;
+		return true;
+	}
+
+	// True if a read failed
+	bool HasFailed() const { return failed; }
+
+	// Gets the number of bytes left
+	size_t GetRemaining() const { return end - p; }
+};
@@ -0,0 +1,35 @@
+#include "pch.h"
+
+#include "BitGrid.h"
+
+void BitGrid::Resize(int width, int height) {
+	this->width = width;
+	this->height = height;
+	rowWords = (width + 63) / 64;
+	words.assign((size_t)rowWords * height, 0);
+}
+
+size_t BitGrid::Count() const {
+	size_t count = 0;
+	for (uint64_t word : words) count += __popcnt64(word);
+	return count;
+}
+
+void BitGrid::And(const BitGrid& a, const BitGrid& b, BitGrid& out) {
+	assert(a.width == b.width && a.height == b.height);
+	if (out.width != a.width || out.height != a.height) out.Resize(a.width, a.height);
+
+	// The rows are contiguous : the whole grid is combined as a single array
+	size_t count = a.words.size();
+	const uint64_t* pa = a.words.data();
+	const uint64_t* pb = b.words.data();
+	uint64_t* po = out.words.data();
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(pa + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(pb + i));
+		_mm_storeu_si128((__m128i*)(po + i), _mm_and_si128(va, vb));
+	}
+	for (; i < count; i++) po[i] = pa[i] & pb[i];
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/// <summary>
+/// A 2D grid of bits, stored as rows of 64 bit words.
+/// Grids of the same size can be combined with bitwise operations, 128 bits at a time.
+/// </summary>
+class BitGrid {
+	int width = 0;
+	int height = 0;
+	// Words per row (the bits after the width are always 0)
+	int rowWords = 0;
+	std::vector<uint64_t> words;
+public:
+	BitGrid() {}
+	BitGrid(int width, int height) { Resize(width, height); }
+
+	/// <summary>
+	/// Resizes the grid, every bit is cleared
+	/// </summary>
+	/// <param name="width">The number of columns</param>
+	/// <param name="height">The number of rows</param>
+	void Resize(int width, int height);
+
+	// Clears every bit
+	void Clear() { std::fill(words.begin(), words.end(), 0); }
+
+	// Gets a bit
+	bool Get(int x, int y) const { return (words[y * rowWords + (x >> 6)] >> (x & 63)) & 1; }
+
+	// Sets a bit
+	void Set(int x, int y, bool value) {
+		uint64_t& word = words[y * rowWords + (x >> 6)];
+		uint64_t bit = 1ull << (x & 63);
+		word = value ? (word | bit) : (word & ~bit);
+	}
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+
+	// Counts the bits that are set
+	size_t Count() const;
+
+	/// <summary>
+	/// Calls a function for every bit that is set, row by row
+	/// </summary>
+	/// <param name="func">The function, called with the bit's X and Y</param>
+	template<typename Func>
+	void ForEach(Func func) const {
+		for (int y = 0; y < height; y++) {
+			for (int w = 0; w < rowWords; w++) {
+				uint64_t word = words[y * rowWords + w];
+				while (word) {
+					unsigned long bit;
+					_BitScanForward64(&bit, word);
+					func(w * 64 + (int)bit, y);
+					word &= word - 1;
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// Computes a AND b. The grids must have the same size.
+	/// </summary>
+	/// <param name="a">The first grid</param>
+	/// <param name="b">The second grid</param>
+	/// <param name="out">The result (can be a or b)</param>
+	static void And(const BitGrid& a, const BitGrid& b, BitGrid& out);
+};
@@ -93,8 +93,8 @@ public:
 /// </summary>
 class IndexBuffer {
 	ComPtr<ID3D11Buffer> buffer;
-	std::vector<uint32_t> indices;
 public:
+	std::vector<uint32_t> indices;
 	IndexBuffer() {};
 
 	/// <summary>
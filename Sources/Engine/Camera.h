@@ -63,6 +63,8 @@ public:
 	Matrix GetViewMatrix() const { return view; }
 	// Gets the inverse matrix of the view camera
 	Matrix GetInverseViewMatrix() const { return view.Invert(); }
+	// Gets the projection matrix of the camera
+	Matrix GetProjectionMatrix() const { return projection; }
 
 	/// <summary>
 	/// Applies the camera
@@ -24,7 +24,8 @@ public:
 	struct ModelData {
 		Matrix model;
 		bool isInstance;
-		int temp;
+		// Level of detail the model is tinted for, 0 for none (see World::SetShowLods)
+		int lodTint = 0;
 		int temp2;
 		int temp3;
 	};
@@ -0,0 +1,175 @@
+#include "pch.h"
+
+#include "JobSystem.h"
+
+JobSystem* JobSystem::instance = nullptr;
+
+// Index of the worker running on this thread (-1 if the thread isn't a worker)
+static thread_local int currentWorker = -1;
+
+JobSystem::JobSystem(int threadCount) {
+	assert(!instance);
+	instance = this;
+
+	if (threadCount < 0) {
+		threadCount = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+	}
+
+	// Worker 0 is the thread that created the job system
+	currentWorker = 0;
+	for (int i = 0; i <= threadCount; i++) {
+		workers.push_back(std::make_unique<Worker>());
+	}
+
+	for (int i = 1; i <= threadCount; i++) {
+		threads.emplace_back([this, i]() { WorkerLoop(i); });
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		running = false;
+	}
+	wakeUp.notify_all();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	instance = nullptr;
+}
+
+void JobSystem::Schedule(Job job, JobCounter* counter) {
+	if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+	Push({ std::move(job), counter });
+}
+
+void JobSystem::ScheduleAfter(JobCounter* dependency, Job job, JobCounter* counter) {
+	if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+	{
+		std::lock_guard<std::mutex> guard(dependency->lock);
+		if (!dependency->IsDone()) {
+			// The last job of the dependency will push it
+			dependency->continuations.push_back({ std::move(job), counter });
+			return;
+		}
+	}
+	Push({ std::move(job), counter });
+}
+
+void JobSystem::Wait(JobCounter* counter) {
+	JobEntry entry;
+	while (!counter->IsDone()) {
+		if (Pop(currentWorker, entry)) Run(entry);
+		else std::this_thread::yield();
+	}
+
+	// Wait for the last job to release the counter
+	std::lock_guard<std::mutex> guard(counter->lock);
+}
+
+void JobSystem::ParallelFor(int count, int grainSize, const std::function<void(int begin, int end)>& func) {
+	if (count <= 0) return;
+	if (grainSize < 1) grainSize = 1;
+
+	// Not worth splitting
+	if (count <= grainSize || workers.size() == 1) {
+		func(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (int begin = 0; begin < count; begin += grainSize) {
+		int end = std::min(begin + grainSize, count);
+		Schedule([&func, begin, end]() { func(begin, end); }, &counter);
+	}
+	Wait(&counter);
+}
+
+void JobSystem::Push(JobEntry entry) {
+	int workerIdx = currentWorker;
+	if (workerIdx < 0) workerIdx = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+	{
+		std::lock_guard<std::mutex> guard(workers[workerIdx]->lock);
+		workers[workerIdx]->jobs.push_back(std::move(entry));
+	}
+	queuedJobs.fetch_add(1, std::memory_order_release);
+
+	// Taking the lock makes sure a worker can't miss the notification between its check and its wait
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wakeUp.notify_one();
+}
+
+bool JobSystem::Pop(int workerIdx, JobEntry& entry) {
+	int count = (int)workers.size();
+
+	// Newest job of our own deque first
+	if (workerIdx >= 0) {
+		Worker* worker = workers[workerIdx].get();
+		std::lock_guard<std::mutex> guard(worker->lock);
+		if (!worker->jobs.empty()) {
+			entry = std::move(worker->jobs.back());
+			worker->jobs.pop_back();
+			queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Then steal the oldest job of another worker
+	int start = workerIdx < 0 ? 0 : workerIdx + 1;
+	for (int i = 0; i < count; i++) {
+		int victimIdx = (start + i) % count;
+		if (victimIdx == workerIdx) continue;
+
+		Worker* victim = workers[victimIdx].get();
+		std::lock_guard<std::mutex> guard(victim->lock);
+		if (!victim->jobs.empty()) {
+			entry = std::move(victim->jobs.front());
+			victim->jobs.pop_front();
+			queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::Run(JobEntry& entry) {
+	entry.job();
+	entry.job = nullptr;
+
+	JobCounter* counter = entry.counter;
+	if (!counter) return;
+
+	// The counter is only touched under its lock : Wait() takes it before returning,
+	// so the counter can't be destroyed while we still use it
+	std::vector<std::pair<Job, JobCounter*>> continuations;
+	{
+		std::lock_guard<std::mutex> guard(counter->lock);
+		if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			// Last job of the group : release the jobs that depended on it
+			continuations.swap(counter->continuations);
+		}
+	}
+	for (auto& [job, jobCounter] : continuations) {
+		Push({ std::move(job), jobCounter });
+	}
+}
+
+void JobSystem::WorkerLoop(int workerIdx) {
+	currentWorker = workerIdx;
+
+	JobEntry entry;
+	while (running) {
+		if (Pop(workerIdx, entry)) {
+			Run(entry);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wakeUp.wait(guard, [this]() { return !running || queuedJobs.load(std::memory_order_acquire) > 0; });
+	}
+}
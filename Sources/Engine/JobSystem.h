@@ -0,0 +1,123 @@
+#pragma once
+
+// A job is a small piece of work that can be run on any worker thread
+using Job = std::function<void()>;
+
+/// <summary>
+/// Counts the jobs of a group that are still running.
+/// Jobs can be scheduled to start only once a counter reaches zero.
+/// A counter must be waited on with JobSystem::Wait before being destroyed.
+/// </summary>
+class JobCounter {
+	std::atomic<int> pending = 0;
+
+	std::mutex lock;
+	std::vector<std::pair<Job, JobCounter*>> continuations;
+
+	friend class JobSystem;
+public:
+	JobCounter() {}
+
+	// True if every job linked to this counter is done
+	bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+/// <summary>
+/// Represents the engine's job system.
+/// Each worker owns a deque : it pops its own jobs from the back (LIFO, cache friendly)
+/// and steals the oldest jobs from the front of the other workers' deques when it runs dry.
+/// The thread that created the job system is worker 0 and helps while waiting on a counter.
+/// </summary>
+class JobSystem {
+	static JobSystem* instance;
+
+	struct JobEntry {
+		Job job;
+		JobCounter* counter;
+	};
+
+	struct Worker {
+		std::mutex lock;
+		std::deque<JobEntry> jobs;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+
+	std::atomic<bool> running = true;
+	std::atomic<int> queuedJobs = 0;
+	std::atomic<unsigned int> nextWorker = 0;
+
+	std::mutex sleepLock;
+	std::condition_variable wakeUp;
+
+public:
+	/// <summary>
+	/// Creates the job system
+	/// </summary>
+	/// <param name="threadCount">The number of background threads (-1 = one per hardware thread, minus the main thread)</param>
+	JobSystem(int threadCount = -1);
+	~JobSystem();
+
+	// Gets the JobSystem
+	static JobSystem* Get() { return instance; }
+
+	// Gets the number of workers, including the main thread
+	int GetWorkerCount() const { return (int)workers.size(); }
+
+	/// <summary>
+	/// Schedules a job
+	/// </summary>
+	/// <param name="job">The job</param>
+	/// <param name="counter">The counter incremented now and decremented when the job is done (Optional)</param>
+	void Schedule(Job job, JobCounter* counter = nullptr);
+
+	/// <summary>
+	/// Schedules a job that will only start once a dependency is done
+	/// </summary>
+	/// <param name="dependency">The counter to wait for</param>
+	/// <param name="job">The job</param>
+	/// <param name="counter">The counter incremented now and decremented when the job is done (Optional)</param>
+	void ScheduleAfter(JobCounter* dependency, Job job, JobCounter* counter = nullptr);
+
+	/// <summary>
+	/// Waits for a counter to reach zero. The calling thread runs jobs in the meantime.
+	/// </summary>
+	/// <param name="counter">The counter</param>
+	void Wait(JobCounter* counter);
+
+	/// <summary>
+	/// Runs a function over [0, count) split in ranges of grainSize, and waits for all of them
+	/// </summary>
+	/// <param name="count">The number of items</param>
+	/// <param name="grainSize">The number of items per job</param>
+	/// <param name="func">The function, called with the [begin, end) range of a job</param>
+	void ParallelFor(int count, int grainSize, const std::function<void(int begin, int end)>& func);
+
+private:
+	/// <summary>
+	/// Pushes a job in a worker's deque
+	/// </summary>
+	/// <param name="entry">The job and its counter</param>
+	void Push(JobEntry entry);
+
+	/// <summary>
+	/// Pops a job from the worker's own deque, or steals one from another worker
+	/// </summary>
+	/// <param name="workerIdx">The worker's index</param>
+	/// <param name="entry">The job found</param>
+	/// <returns>True if a job was found</returns>
+	bool Pop(int workerIdx, JobEntry& entry);
+
+	/// <summary>
+	/// Runs a job, then signals its counter
+	/// </summary>
+	/// <param name="entry">The job and its counter</param>
+	void Run(JobEntry& entry);
+
+	/// <summary>
+	/// The loop of a background worker
+	/// </summary>
+	/// <param name="workerIdx">The worker's index</param>
+	void WorkerLoop(int workerIdx);
+};
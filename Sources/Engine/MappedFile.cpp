@@ -0,0 +1,126 @@
+#include "pch.h"
+
+#include "MappedFile.h"
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::wstring& path) {
+	Close();
+
+	file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize)) {
+		Close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	// An empty file can't be mapped
+	if (size == 0) return true;
+
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		Close();
+		return false;
+	}
+
+	data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+	data = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+	size = 0;
+}
+
+std::string ToUtf8(const std::wstring& text) {
+	if (text.empty()) return std::string();
+	int length = WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), nullptr, 0, nullptr, nullptr);
+	std::string result(length, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), result.data(), length, nullptr, nullptr);
+	return result;
+}
+
+#else
+
+bool MappedFile::Open(const std::wstring& path) {
+	Close();
+
+	file = open(ToUtf8(path).c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0) return false;
+
+	struct stat status = {};
+	if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode)) {
+		Close();
+		return false;
+	}
+	size = (size_t)status.st_size;
+
+	// An empty file can't be mapped
+	if (size == 0) return true;
+
+	void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (view == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	madvise(view, size, MADV_SEQUENTIAL);
+	data = (const uint8_t*)view;
+	return true;
+}
+
+void MappedFile::Close() {
+	if (data) munmap((void*)data, size);
+	if (file >= 0) close(file);
+
+	data = nullptr;
+	file = -1;
+	size = 0;
+}
+
+std::string ToUtf8(const std::wstring& text) {
+	// wchar_t holds UTF-32 here
+	std::string result;
+	result.reserve(text.size());
+	for (wchar_t c : text) {
+		uint32_t code = (uint32_t)c;
+		if (code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) code = 0xFFFD;
+		if (code < 0x80) {
+			result += (char)code;
+		}
+		else if (code < 0x800) {
+			result += (char)(0xC0 | (code >> 6));
+			result += (char)(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000) {
+			result += (char)(0xE0 | (code >> 12));
+			result += (char)(0x80 | ((code >> 6) & 0x3F));
+			result += (char)(0x80 | (code & 0x3F));
+		}
+		else {
+			result += (char)(0xF0 | (code >> 18));
+			result += (char)(0x80 | ((code >> 12) & 0x3F));
+			result += (char)(0x80 | ((code >> 6) & 0x3F));
+			result += (char)(0x80 | (code & 0x3F));
+		}
+	}
+	return result;
+}
+
+#endif
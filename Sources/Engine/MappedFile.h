@@ -0,0 +1,50 @@
+#pragma once
+
+/// <summary>
+/// Represents a read-only memory-mapped file
+/// </summary>
+class MappedFile {
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int file = -1;
+#endif
+
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// <summary>
+	/// Maps a file in memory
+	/// </summary>
+	/// <param name="path">The file's path</param>
+	/// <returns>True if the file could be mapped</returns>
+	bool Open(const std::wstring& path);
+
+	// Unmaps the file
+	void Close();
+
+	// True if a file is mapped
+#ifdef _WIN32
+	bool IsOpen() const { return file != INVALID_HANDLE_VALUE; }
+#else
+	bool IsOpen() const { return file >= 0; }
+#endif
+
+	// Gets the file's content (nullptr if the file is empty)
+	const uint8_t* GetData() const { return data; }
+
+	// Gets the file's size
+	size_t GetSize() const { return size; }
+};
+
+/// <summary>
+/// Converts a path (or any wide string) to UTF-8, for the messages and the APIs taking narrow strings
+/// </summary>
+std::string ToUtf8(const std::wstring& text);
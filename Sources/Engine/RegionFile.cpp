@@ -0,0 +1,276 @@
+#include "pch.h"
+
+#include "BinaryStream.h"
+#include "MappedFile.h"
+#include "RegionFile.h"
+
+// "MCRG"
+static constexpr uint32_t REGION_MAGIC = 0x4752434D;
+// To increment whenever the layout of the file changes
+static constexpr uint32_t REGION_VERSION = 3;
+
+// Start of the file, followed by the chunk table
+struct RegionHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t regionSize;
+	uint32_t reserved;
+};
+
+RegionFile::~RegionFile() {
+	Close();
+}
+
+bool RegionFile::Open(const std::wstring& path, bool truncate) {
+	Close();
+
+	uint64_t fileSize = 0;
+	if (!OpenFile(path, truncate, fileSize)) return false;
+
+	table.assign(ENTRY_COUNT, {});
+	uint32_t tableSectors = GetTableSectors();
+
+	// An existing file is kept if its table is valid : no blob out of the file, no sector used twice
+	RegionHeader header = {};
+	bool valid = fileSize >= (uint64_t)tableSectors * SECTOR_SIZE &&
+		ReadAt(0, &header, sizeof(header)) && header.magic == REGION_MAGIC && header.version == REGION_VERSION && header.regionSize == REGION_SIZE &&
+		ReadAt(sizeof(header), table.data(), table.size() * sizeof(ChunkEntry));
+	if (valid) {
+		uint64_t fileSectors = (fileSize + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		usedSectors.assign(tableSectors, true);
+		for (const ChunkEntry& entry : table) {
+			if ((entry.flags & ~RE_PRESENT) != 0 || (!(entry.flags & RE_PRESENT) && entry.sectorCount > 0)) {
+				valid = false;
+				break;
+			}
+			if (entry.sectorCount == 0) {
+				// A chunk without a blob, or with an empty one
+				if (entry.storedSize == 0 && entry.size == 0) continue;
+				valid = false;
+				break;
+			}
+			uint64_t end = (uint64_t)entry.firstSector + entry.sectorCount;
+			if (entry.firstSector < tableSectors || end > fileSectors || entry.storedSize > (uint64_t)entry.sectorCount * SECTOR_SIZE ||
+				entry.compression > RC_RLE) {
+				valid = false;
+				break;
+			}
+			if (end > usedSectors.size()) usedSectors.resize((size_t)end, false);
+			for (uint32_t sector = entry.firstSector; sector < end; sector++) {
+				if (usedSectors[sector]) valid = false;
+				usedSectors[sector] = true;
+			}
+			if (!valid) break;
+		}
+	}
+	if (valid) {
+		// Sectors freed at the end of the file are written over by the next blobs
+		while (usedSectors.size() > tableSectors && !usedSectors.back()) usedSectors.pop_back();
+		return true;
+	}
+
+	table.assign(ENTRY_COUNT, {});
+	usedSectors.assign(tableSectors, true);
+	header = { REGION_MAGIC, REGION_VERSION, REGION_SIZE, 0 };
+	std::vector<uint8_t> start((size_t)tableSectors * SECTOR_SIZE, 0);
+	memcpy(start.data(), &header, sizeof(header));
+	// What an invalid file had after the table is overwritten by the next blobs
+	if (!WriteAt(0, start.data(), start.size())) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void RegionFile::Close() {
+	CloseFile();
+	table.clear();
+	usedSectors.clear();
+}
+
+bool RegionFile::Write(int x, int z, const void* data, size_t size, bool compress) {
+	if (!IsOpen() || !IsInRegion(x, z) || size > UINT32_MAX) return false;
+
+	ChunkEntry entry = {};
+	entry.size = (uint32_t)size;
+	entry.compression = RC_NONE;
+	entry.flags = RE_PRESENT;
+	const void* stored = data;
+	size_t storedSize = size;
+
+	BinaryWriter encoded;
+	if (compress) {
+		encoded.WriteRle((const uint8_t*)data, size);
+		if (encoded.GetSize() < size) {
+			entry.compression = RC_RLE;
+			stored = encoded.GetData();
+			storedSize = encoded.GetSize();
+		}
+	}
+	entry.storedSize = (uint32_t)storedSize;
+	entry.checksum = Fnv1a64(stored, storedSize);
+	entry.timestamp = (uint64_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	// The blob goes to free sectors : the previous one stays valid until the table points to the new one.
+	// An empty blob takes none : a sector past the end of the file would make the table invalid.
+	entry.sectorCount = (uint32_t)((storedSize + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	if (entry.sectorCount > 0) {
+		entry.firstSector = FindFreeSectors(entry.sectorCount);
+		if (!WriteAt((uint64_t)entry.firstSector * SECTOR_SIZE, stored, storedSize)) return false;
+		MarkSectors(entry.firstSector, entry.sectorCount, true);
+	}
+
+	int index = GetEntryIndex(x, z);
+	ChunkEntry previous = table[index];
+	if (!WriteEntry(index, entry)) {
+		if (entry.sectorCount > 0) MarkSectors(entry.firstSector, entry.sectorCount, false);
+		return false;
+	}
+	if (previous.sectorCount > 0) MarkSectors(previous.firstSector, previous.sectorCount, false);
+	return true;
+}
+
+bool RegionFile::Read(int x, int z, std::vector<uint8_t>& data) {
+	if (!Has(x, z)) return false;
+	const ChunkEntry& entry = table[GetEntryIndex(x, z)];
+
+	std::vector<uint8_t> stored(entry.storedSize);
+	if (!ReadAt((uint64_t)entry.firstSector * SECTOR_SIZE, stored.data(), stored.size()) || Fnv1a64(stored.data(), stored.size()) != entry.checksum) return false;
+
+	if (entry.compression == RC_NONE) {
+		data = std::move(stored);
+		return true;
+	}
+	// A run of 2 bytes gives at most 256 : a larger size is corrupted
+	if (entry.size > (uint64_t)entry.storedSize * 128) return false;
+	data.resize(entry.size);
+	BinaryReader reader(stored.data(), stored.size());
+	return reader.ReadRle(data.data(), data.size()) && reader.GetRemaining() == 0;
+}
+
+bool RegionFile::Remove(int x, int z) {
+	if (!Has(x, z)) return false;
+	int index = GetEntryIndex(x, z);
+	ChunkEntry previous = table[index];
+	if (!WriteEntry(index, {})) return false;
+	if (previous.sectorCount > 0) MarkSectors(previous.firstSector, previous.sectorCount, false);
+	return true;
+}
+
+uint32_t RegionFile::GetFreeSectorCount() const {
+	return (uint32_t)std::count(usedSectors.begin(), usedSectors.end(), false);
+}
+
+std::wstring RegionFile::GetPath(const std::wstring& directory, int regionX, int layer, int regionZ) {
+	return directory + L"/r." + std::to_wstring(regionX) + L"." + std::to_wstring(layer) + L"." + std::to_wstring(regionZ) + L".region";
+}
+
+uint32_t RegionFile::GetTableSectors() {
+	size_t size = sizeof(RegionHeader) + ENTRY_COUNT * sizeof(ChunkEntry);
+	return (uint32_t)((size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+}
+
+uint32_t RegionFile::FindFreeSectors(uint32_t count) const {
+	// First fit : the blobs of a region are a few sectors each, the holes they leave are reused by the next ones
+	uint32_t runStart = 0, runLength = 0;
+	for (uint32_t sector = GetTableSectors(); sector < usedSectors.size(); sector++) {
+		if (usedSectors[sector]) {
+			runLength = 0;
+			continue;
+		}
+		if (runLength == 0) runStart = sector;
+		if (++runLength == count) return runStart;
+	}
+	// A run of free sectors at the end is extended
+	return runLength > 0 ? runStart : (uint32_t)usedSectors.size();
+}
+
+void RegionFile::MarkSectors(uint32_t first, uint32_t count, bool used) {
+	if (used && first + count > usedSectors.size()) usedSectors.resize(first + count, false);
+	for (uint32_t sector = first; sector < first + count; sector++) usedSectors[sector] = used;
+	// The freed sectors at the end of the file are written over by the next blobs
+	while (!used && usedSectors.size() > GetTableSectors() && !usedSectors.back()) usedSectors.pop_back();
+}
+
+bool RegionFile::WriteEntry(int index, const ChunkEntry& entry) {
+	if (!WriteAt(sizeof(RegionHeader) + (uint64_t)index * sizeof(ChunkEntry), &entry, sizeof(entry))) return false;
+	table[index] = entry;
+	return true;
+}
+
+#ifdef _WIN32
+
+bool RegionFile::OpenFile(const std::wstring& path, bool truncate, uint64_t& fileSize) {
+	file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size = {};
+	if (!GetFileSizeEx(file, &size)) {
+		CloseFile();
+		return false;
+	}
+	fileSize = (uint64_t)size.QuadPart;
+	return true;
+}
+
+void RegionFile::CloseFile() {
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+}
+
+bool RegionFile::ReadAt(uint64_t offset, void* data, size_t size) {
+	OVERLAPPED position = {};
+	position.Offset = (DWORD)offset;
+	position.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD count = 0;
+	return ReadFile(file, data, (DWORD)size, &count, &position) && count == size;
+}
+
+bool RegionFile::WriteAt(uint64_t offset, const void* data, size_t size) {
+	OVERLAPPED position = {};
+	position.Offset = (DWORD)offset;
+	position.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD count = 0;
+	return WriteFile(file, data, (DWORD)size, &count, &position) && count == size;
+}
+
+#else
+
+bool RegionFile::OpenFile(const std::wstring& path, bool truncate, uint64_t& fileSize) {
+	file = open(ToUtf8(path).c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+	if (file < 0) return false;
+
+	struct stat status = {};
+	if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode)) {
+		CloseFile();
+		return false;
+	}
+	fileSize = (uint64_t)status.st_size;
+	return true;
+}
+
+void RegionFile::CloseFile() {
+	if (file >= 0) close(file);
+	file = -1;
+}
+
+// pread and pwrite may stop short (a signal, a large size) : they are called until everything is done
+bool RegionFile::ReadAt(uint64_t offset, void* data, size_t size) {
+	for (size_t done = 0; done < size;) {
+		ssize_t count = pread(file, (uint8_t*)data + done, size - done, (off_t)(offset + done));
+		if (count <= 0) return false;
+		done += (size_t)count;
+	}
+	return true;
+}
+
+bool RegionFile::WriteAt(uint64_t offset, const void* data, size_t size) {
+	for (size_t done = 0; done < size;) {
+		ssize_t count = pwrite(file, (const uint8_t*)data + done, size - done, (off_t)(offset + done));
+		if (count <= 0) return false;
+		done += (size_t)count;
+	}
+	return true;
+}
+
+#endif
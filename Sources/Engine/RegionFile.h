@@ -0,0 +1,144 @@
+#pragma once
+
+/// <summary>
+/// A file holding the blobs (blocks, meshes, ...) of a square of REGION_SIZE x REGION_SIZE chunks, each read and written alone
+/// without touching the others.
+/// The file starts with a header and a table giving where every chunk's blob is, its size, compression and last write time.
+/// The blobs start on whole sectors. A blob written again goes to free sectors (the first run long enough, or the end of the file),
+/// then the table points to it : the previous blob stays valid until then, and its sectors are reused afterward.
+/// </summary>
+class RegionFile {
+public:
+	static constexpr uint32_t SECTOR_SIZE = 4096;
+	// Chunks along each side of a region
+	static constexpr int REGION_SIZE = 32;
+	static constexpr int ENTRY_COUNT = REGION_SIZE * REGION_SIZE;
+
+	// How a blob is stored
+	enum Compression : uint32_t {
+		RC_NONE,
+		// Run-length encoded, see BinaryWriter::WriteRle
+		RC_RLE,
+	};
+
+private:
+	// Flags of a chunk's entry
+	enum EntryFlags : uint32_t {
+		// The chunk has a blob. An empty blob takes no sector.
+		RE_PRESENT = 1 << 0,
+	};
+
+	// Where a chunk's blob is (all zeros if the chunk has none)
+	struct ChunkEntry {
+		uint32_t firstSector;
+		uint32_t sectorCount;
+		// Size on the disk, and once decompressed
+		uint32_t storedSize;
+		uint32_t size;
+		Compression compression;
+		uint32_t flags;
+		// Seconds since 1970 of the last write
+		uint64_t timestamp;
+		// FNV-1a of the stored bytes
+		uint64_t checksum;
+	};
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+#else
+	int file = -1;
+#endif
+	std::vector<ChunkEntry> table;
+	// The sectors holding the header, the table or a blob
+	std::vector<bool> usedSectors;
+
+public:
+	RegionFile() {}
+	~RegionFile();
+
+	RegionFile(const RegionFile&) = delete;
+	RegionFile& operator=(const RegionFile&) = delete;
+
+	/// <summary>
+	/// Opens a region file, or creates it. An invalid file (another version, a broken table) is started again.
+	/// </summary>
+	/// <param name="path">The file's path</param>
+	/// <param name="truncate">True to start from an empty file</param>
+	/// <returns>True if the file is open</returns>
+	bool Open(const std::wstring& path, bool truncate);
+
+	// Closes the file
+	void Close();
+
+	// True if the file is open
+#ifdef _WIN32
+	bool IsOpen() const { return file != INVALID_HANDLE_VALUE; }
+#else
+	bool IsOpen() const { return file >= 0; }
+#endif
+
+	// True if a chunk has a blob. The coordinates are the chunk's in the region.
+	bool Has(int x, int z) const { return IsInRegion(x, z) && (table[GetEntryIndex(x, z)].flags & RE_PRESENT) != 0; }
+
+	// Gets the time of the last write of a chunk's blob, in seconds since 1970 (0 if it has none)
+	uint64_t GetTimestamp(int x, int z) const { return Has(x, z) ? table[GetEntryIndex(x, z)].timestamp : 0; }
+
+	/// <summary>
+	/// Writes the blob of a chunk
+	/// </summary>
+	/// <param name="x">The chunk's X in the region</param>
+	/// <param name="z">The chunk's Z in the region</param>
+	/// <param name="data">The blob</param>
+	/// <param name="size">The blob's size</param>
+	/// <param name="compress">True to run-length encode the blob, if it gets smaller</param>
+	/// <returns>True if the blob was written</returns>
+	bool Write(int x, int z, const void* data, size_t size, bool compress);
+
+	/// <summary>
+	/// Reads the blob of a chunk. Several threads can read at once (the reads don't move a file pointer), as long as none writes.
+	/// </summary>
+	/// <param name="x">The chunk's X in the region</param>
+	/// <param name="z">The chunk's Z in the region</param>
+	/// <param name="data">The blob, decompressed</param>
+	/// <returns>False if the chunk has no blob, or it couldn't be read or is corrupted</returns>
+	bool Read(int x, int z, std::vector<uint8_t>& data);
+
+	// Removes the blob of a chunk, its sectors are reused
+	bool Remove(int x, int z);
+
+	// Gets the number of sectors in the file, and the number of them not used
+	uint32_t GetSectorCount() const { return (uint32_t)usedSectors.size(); }
+	uint32_t GetFreeSectorCount() const;
+
+	// Gets the region holding a chunk, along an axis
+	static int GetRegionCoord(int chunk) { return chunk >= 0 ? chunk / REGION_SIZE : (chunk + 1) / REGION_SIZE - 1; }
+	// Gets a chunk's coordinate in its region
+	static int GetLocalCoord(int chunk) { return chunk - GetRegionCoord(chunk) * REGION_SIZE; }
+
+	/// <summary>
+	/// Gets the path of a region in a directory : "directory/r.X.Y.Z.region". Y tells apart the layers of chunks.
+	/// </summary>
+	static std::wstring GetPath(const std::wstring& directory, int regionX, int layer, int regionZ);
+
+private:
+	static bool IsInRegion(int x, int z) { return x >= 0 && z >= 0 && x < REGION_SIZE && z < REGION_SIZE; }
+	static int GetEntryIndex(int x, int z) { return x + z * REGION_SIZE; }
+
+	// Gets the number of sectors taken by the header and the table
+	static uint32_t GetTableSectors();
+
+	// Finds a run of free sectors, at the end of the file if none is long enough
+	uint32_t FindFreeSectors(uint32_t count) const;
+	void MarkSectors(uint32_t first, uint32_t count, bool used);
+
+	// Writes an entry of the table to the file, then in memory
+	bool WriteEntry(int index, const ChunkEntry& entry);
+
+	// Opens the file and gets its size, or closes it
+	bool OpenFile(const std::wstring& path, bool truncate, uint64_t& fileSize);
+	void CloseFile();
+
+	// Reads or writes some bytes at an offset of the file
+	bool ReadAt(uint64_t offset, void* data, size_t size);
+	bool WriteAt(uint64_t offset, const void* data, size_t size);
+};
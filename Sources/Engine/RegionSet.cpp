@@ -0,0 +1,79 @@
+#include "pch.h"
+
+#include "MappedFile.h"
+#include "RegionSet.h"
+
+#ifdef _WIN32
+
+static bool FileExists(const std::wstring& path) {
+	return GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+// Creates a directory, an existing one is left as it is
+static void MakeDirectory(const std::wstring& path) {
+	CreateDirectoryW(path.c_str(), nullptr);
+}
+
+static void DeleteRegionFile(const std::wstring& path) {
+	DeleteFileW(path.c_str());
+}
+
+// Removes a directory, if it is empty
+static void RemoveEmptyDirectory(const std::wstring& path) {
+	RemoveDirectoryW(path.c_str());
+}
+
+#else
+
+static bool FileExists(const std::wstring& path) {
+	struct stat status = {};
+	return stat(ToUtf8(path).c_str(), &status) == 0;
+}
+
+// Creates a directory, an existing one is left as it is
+static void MakeDirectory(const std::wstring& path) {
+	mkdir(ToUtf8(path).c_str(), 0755);
+}
+
+static void DeleteRegionFile(const std::wstring& path) {
+	unlink(ToUtf8(path).c_str());
+}
+
+// Removes a directory, if it is empty
+static void RemoveEmptyDirectory(const std::wstring& path) {
+	rmdir(ToUtf8(path).c_str());
+}
+
+#endif
+
+RegionFile* RegionSet::Get(int cx, int cy, int cz, bool create, int& x, int& z) {
+	x = RegionFile::GetLocalCoord(cx);
+	z = RegionFile::GetLocalCoord(cz);
+
+	auto key = std::make_tuple(RegionFile::GetRegionCoord(cx), cy, RegionFile::GetRegionCoord(cz));
+	auto it = files.find(key);
+	if (it != files.end()) return it->second.get();
+	if (!create) {
+		// A file from a previous session is still read
+		if (truncate || !FileExists(RegionFile::GetPath(directory, std::get<0>(key), cy, std::get<2>(key)))) return nullptr;
+	}
+
+	// Every level of the directory is created, the existing ones are left as they are
+	for (size_t slash = directory.find(L'/'); slash != std::wstring::npos; slash = directory.find(L'/', slash + 1)) {
+		MakeDirectory(directory.substr(0, slash));
+	}
+	MakeDirectory(directory);
+
+	auto file = std::make_unique<RegionFile>();
+	if (!file->Open(RegionFile::GetPath(directory, std::get<0>(key), cy, std::get<2>(key)), truncate)) return nullptr;
+	return (files[key] = std::move(file)).get();
+}
+
+void RegionSet::Delete() {
+	for (auto& [key, file] : files) {
+		file->Close();
+		DeleteRegionFile(RegionFile::GetPath(directory, std::get<0>(key), std::get<1>(key), std::get<2>(key)));
+	}
+	files.clear();
+	RemoveEmptyDirectory(directory);
+}
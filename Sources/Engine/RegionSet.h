@@ -0,0 +1,38 @@
+#pragma once
+
+#include "RegionFile.h"
+
+/// <summary>
+/// The region files of a directory, opened when a chunk in them is first needed.
+/// Chunks are addressed by their coordinates in chunks : a region holds a square of them on a layer.
+/// </summary>
+class RegionSet {
+	std::wstring directory;
+	// True to start every file from empty (the data is only valid for this session)
+	bool truncate = false;
+	std::map<std::tuple<int, int, int>, std::unique_ptr<RegionFile>> files;
+
+public:
+	RegionSet(const std::wstring& directory, bool truncate) : directory(directory), truncate(truncate) {}
+
+	RegionSet(const RegionSet&) = delete;
+	RegionSet& operator=(const RegionSet&) = delete;
+
+	/// <summary>
+	/// Gets the region file holding a chunk
+	/// </summary>
+	/// <param name="cx">The chunk's X, in chunks</param>
+	/// <param name="cy">The chunk's layer</param>
+	/// <param name="cz">The chunk's Z, in chunks</param>
+	/// <param name="create">True to open the file (and create the directory) if it isn't yet</param>
+	/// <param name="x">The chunk's X in the region</param>
+	/// <param name="z">The chunk's Z in the region</param>
+	/// <returns>The region file, nullptr if it isn't open</returns>
+	RegionFile* Get(int cx, int cy, int cz, bool create, int& x, int& z);
+
+	// Closes every file
+	void Close() { files.clear(); }
+
+	// Closes and deletes the files opened by Get, then the directory if nothing else is left in it
+	void Delete();
+};
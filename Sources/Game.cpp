@@ -11,8 +11,12 @@
 #include "Engine/VertexLayout.h"
 #include "Engine/Texture.h"
 #include "Engine/DefaultResources.h"
+#include "Engine/JobSystem.h"
 #include "Minicraft/World.h"
 #include "Minicraft/Player.h"
+#include "Minicraft/CitySave.h"
+#include "Minicraft/Autosave.h"
+#include "Minicraft/Replay.h"
 #include "Minicraft/Utils.h"
 #include "Engine/Light.h"
 #include "Minicraft/Skybox.h"
@@ -28,6 +32,7 @@ using namespace DirectX::SimpleMath;
 using Microsoft::WRL::ComPtr;
 
 // Global stuff
+JobSystem jobSystem;
 DefaultResources gpuResources;
 Shader basicShader(L"Basic");
 Shader blockShader(L"Block");
@@ -38,6 +43,7 @@ Texture texture(L"terrain");
 Texture textureSky(L"skybox");
 World world;
 Player player(&world, Vector3(16, 32, 16));
+Autosave autosave(L"Saves/Autosave.journal");
 OrthographicCamera hudCamera(400, 600);
 
 Light light;
@@ -47,6 +53,25 @@ bool showGUI = true;
 int seed = 786768768876;
 float treeThreshold = 0.4f;
 char filenameBuf[50] = "Coast";
+char saveNameBuf[50] = "City";
+std::string saveStatus;
+char replayNameBuf[50] = "Session";
+std::string replayStatus;
+std::string meshingStatus;
+std::string regionStatus;
+
+// Fixed simulation ticks
+Replay replay;
+Command lastGeneration = Command::GenerateSeed(seed, treeThreshold);
+std::vector<Command> pendingCommands;
+float tickAccumulator = 0;
+constexpr float TICK_DURATION = 1.0f / Replay::TICK_RATE;
+// Ticks simulated at most in a frame, so that a long frame doesn't make the next ones longer
+constexpr int MAX_TICKS_PER_FRAME = 10;
+// Ticks between two samples of the camera in a recording
+constexpr uint32_t CAMERA_SAMPLE_TICKS = 6;
+Vector3 lastCameraPosition;
+float lastCameraYaw = 0;
 std::vector<const char*> maps = {"Coast","River","Mountain","Delta", "Islands","Channel","Extreme" };
 
 /// <summary>
@@ -105,7 +130,7 @@ void Game::Initialize(HWND window, int width, int height) {
 	// Initialize world
 	light.Generate(m_deviceResources.get());
 	//world.Generate(m_deviceResources.get(),786768768876,treeThreshold);
-	world.GenerateFromFile(m_deviceResources.get(), L"Coast", treeThreshold);
+	Execute(Command::GenerateFile("Coast", treeThreshold));
 	skybox.Generate(m_deviceResources.get());
 
 	// Initialize crossahir for the GUI
@@ -128,6 +153,44 @@ void Game::Initialize(HWND window, int width, int height) {
 	ImGui_ImplDX11_Init(m_deviceResources.get()->GetD3DDevice(), m_deviceResources.get()->GetD3DDeviceContext());
 }
 
+/// <summary>
+/// Plays a replay without a window
+/// </summary>
+/// <param name="replayPath">The replay's path</param>
+/// <returns>0 if the state is the recorded one, 1 if it differs, 2 if the replay couldn't be loaded</returns>
+int Game::RunHeadless(const std::wstring& replayPath) {
+	CreateHeadlessResources();
+	int result = PlayReplayHeadless(replayPath);
+	printf("%s\n", replayStatus.c_str());
+	fflush(stdout);
+	return result;
+}
+
+/// <summary>
+/// Checks the light updates without a window
+/// </summary>
+/// <param name="edits">The number of edits</param>
+/// <returns>0 if the light always matched the rebuild, 1 otherwise</returns>
+int Game::CheckLightHeadless(int edits) {
+	CreateHeadlessResources();
+	Execute(Command::GenerateSeed(seed, treeThreshold));
+
+	LightBenchmark result = world.BenchmarkLight(edits, (uint32_t)seed);
+	printf("Light : %d edits, %d differ from a rebuild (%zu cells)\n", result.edits, result.mismatchedEdits, result.mismatchedCells);
+	printf("Update : %.3f ms, %.0f cells changed on average. Rebuild : %.2f ms\n", result.updateTime, result.changedCells, result.rebuildTime);
+	fflush(stdout);
+	return result.mismatchedEdits == 0 ? 0 : 1;
+}
+
+/// <summary>
+/// Creates the resources used by the simulation, without a window
+/// </summary>
+void Game::CreateHeadlessResources() {
+	m_deviceResources->CreateDeviceResources();
+	gpuResources.Create(m_deviceResources.get());
+	player.GenerateGPUResources(m_deviceResources.get());
+}
+
 /// <summary>
 /// Updates the game, then renders it
 /// </summary>
@@ -153,7 +216,23 @@ void Game::Update(DX::StepTimer const& timer) {
 	auto const ms = m_mouse->GetState();
 	m_mouse->ResetScrollWheelValue();
 	
-	player.Update(timer.GetElapsedSeconds(), kb, ms);
+	// The player is moved by the replay when one is playing
+	if (replay.GetMode() != Replay::REPLAY_PLAYING)
+		player.Update(timer.GetElapsedSeconds(), kb, ms);
+	player.TakeCommands(pendingCommands);
+
+	// The city only changes in the fixed ticks
+	tickAccumulator += (float)timer.GetElapsedSeconds();
+	int ticks = 0;
+	while (tickAccumulator >= TICK_DURATION && ticks < MAX_TICKS_PER_FRAME) {
+		SimulateTick();
+		tickAccumulator -= TICK_DURATION;
+		ticks++;
+	}
+	if (ticks == MAX_TICKS_PER_FRAME) tickAccumulator = 0;
+
+	// Between two ticks : the city isn't being modified
+	autosave.Update(timer.GetElapsedSeconds(), world, player);
 
 	if (kb.Escape)
 		ExitGame();
@@ -163,6 +242,90 @@ void Game::Update(DX::StepTimer const& timer) {
 	auto const pad = m_gamePad->GetState(0);
 }
 
+/// <summary>
+/// Executes a command on the world or the player
+/// </summary>
+/// <param name="command">The command</param>
+void Game::Execute(const Command& command) {
+	switch (command.type) {
+	case CMD_GENERATE_SEED:
+		world.Generate(m_deviceResources.get(), command.x, command.value);
+		player.Reset();
+		lastGeneration = command;
+		break;
+
+	case CMD_GENERATE_FILE:
+		if (world.GenerateFromFile(m_deviceResources.get(), std::wstring(command.name.begin(), command.name.end()), command.value)) {
+			player.Reset();
+			lastGeneration = command;
+		}
+		break;
+
+	default:
+		player.Execute(command);
+		break;
+	}
+}
+
+/// <summary>
+/// Simulates a fixed tick
+/// </summary>
+void Game::SimulateTick() {
+	if (replay.GetMode() == Replay::REPLAY_PLAYING) {
+		// Only the replay's commands change the city
+		pendingCommands.clear();
+		replay.GetTickCommands(pendingCommands);
+	}
+
+	for (const Command& command : pendingCommands) {
+		Execute(command);
+		replay.Record(command);
+	}
+	pendingCommands.clear();
+
+	world.Tick();
+	player.Tick(TICK_DURATION);
+
+	if (replay.GetMode() == Replay::REPLAY_RECORDING && replay.GetTick() % CAMERA_SAMPLE_TICKS == 0) {
+		// Samples the camera for the replay, when it moved
+		if (player.GetPosition() != lastCameraPosition || player.GetYaw() != lastCameraYaw) {
+			lastCameraPosition = player.GetPosition();
+			lastCameraYaw = player.GetYaw();
+			replay.Record(Command::Camera(lastCameraPosition, lastCameraYaw));
+		}
+	}
+
+	if (!replay.NextTick()) {
+		// The replay is over
+		bool same = Replay::ComputeStateHash(world, player) == replay.GetFinalHash();
+		replayStatus = same ? "Replay over : same state as the recording" : "Replay over : the state differs from the recording";
+	}
+}
+
+/// <summary>
+/// Plays a replay at once, without rendering
+/// </summary>
+/// <param name="replayPath">The replay's path</param>
+/// <returns>0 if the state is the recorded one, 1 if it differs, 2 if the replay couldn't be loaded</returns>
+int Game::PlayReplayHeadless(const std::wstring& replayPath) {
+	std::string error;
+	if (!replay.Load(replayPath, error)) {
+		replayStatus = error;
+		return 2;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	replay.StartPlaying();
+	pendingCommands.clear();
+	while (replay.GetMode() == Replay::REPLAY_PLAYING) SimulateTick();
+	std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+
+	char ticksPerSecond[64];
+	sprintf_s(ticksPerSecond, " (%u ticks in %.3f s, %.0f ticks/s)", replay.GetLength(), time.count(), replay.GetLength() / std::max(time.count(), 1e-9));
+	replayStatus += ticksPerSecond;
+	return Replay::ComputeStateHash(world, player) == replay.GetFinalHash() ? 0 : 1;
+}
+
 /// <summary>
 /// Draws the scene
 /// </summary>
@@ -296,6 +459,61 @@ void Game::Im(DX::StepTimer const& timer)
 		ImGui::SameLine();
 		ImGui::Text(std::to_string(timer.GetFramesPerSecond()).c_str());
 
+		ImGui::Text("Worker threads : ");
+		ImGui::SameLine();
+		ImGui::Text(std::to_string(jobSystem.GetWorkerCount()).c_str());
+
+		ImGui::Text("Active water cells : %zu", world.GetActiveWaterCount());
+		const VoxelLight& voxelLight = world.GetVoxelLight();
+		ImGui::Text("Last light update : %zu cells in %.3f ms", voxelLight.GetLastChangedCount(), voxelLight.GetLastUpdateTime());
+		const LodStats& lodStats = world.GetLodStats();
+		ImGui::Text("Chunks drawn : %d full, %d at 2x, %d at 4x (%zu vertices)", lodStats.chunks[0], lodStats.chunks[1], lodStats.chunks[2], lodStats.vertices);
+		bool showLods = world.GetShowLods();
+		if (ImGui::Checkbox("Tint the levels of detail (2x green, 4x red)", &showLods)) world.SetShowLods(showLods);
+
+		ChunkStreamer& streamer = world.GetStreamer();
+		bool streaming = streamer.IsEnabled();
+		if (ImGui::Checkbox("Stream the chunks", &streaming)) streamer.SetEnabled(streaming);
+		if (streaming) {
+			int radius = streamer.GetRadius();
+			if (ImGui::InputInt("Radius (chunks)", &radius)) streamer.SetRadius(radius);
+			int budget = (int)(streamer.GetBudget() >> 20);
+			if (ImGui::InputInt("Budget (MB)", &budget)) streamer.SetBudget((size_t)std::max(budget, 0) << 20);
+		}
+		ImGui::Text("Chunks in memory : %d meshed, %d with their blocks (%.1f MB)", streamer.GetResidentCount(), streamer.GetLoadedCount(),
+			streamer.GetResidentMemory() / (1024.0f * 1024.0f));
+		ImGui::Text("From the region files : %zu meshes, %zu blocks. %zu remeshed, %zu evicted", streamer.GetMeshLoadCount(), streamer.GetBlockLoadCount(),
+			streamer.GetRemeshedCount(), streamer.GetEvictedCount());
+
+		MeshCache& meshCache = world.GetMeshCache();
+		bool caching = meshCache.IsEnabled();
+		if (ImGui::Checkbox("Cache the chunk meshes", &caching)) meshCache.SetEnabled(caching);
+		ImGui::Text("Mesh cache : %zu hits in memory, %zu on the disk, %zu misses (%.1f MB)", meshCache.GetMemoryHits(), meshCache.GetDiskHits(),
+			meshCache.GetMisses(), meshCache.GetMemory() / (1024.0f * 1024.0f));
+
+		if (ImGui::Button("Benchmark meshing")) {
+			char result[96];
+			float chunkTime = world.BenchmarkMeshing(20);
+			sprintf_s(result, "%.1f us per chunk, %.1f us per section edit", chunkTime, world.BenchmarkSectionMeshing(20));
+			meshingStatus = result;
+		}
+		if (!meshingStatus.empty()) {
+			ImGui::SameLine();
+			ImGui::Text(meshingStatus.c_str());
+		}
+
+		if (ImGui::Button("Benchmark region files")) {
+			char result[128];
+			RegionBenchmark benchmark = world.BenchmarkRegionFile(20);
+			sprintf_s(result, "Write %.0f MB/s, read %.0f MB/s, blocks at %.0f%%, %u/%u sectors free", benchmark.writeThroughput, benchmark.readThroughput,
+				benchmark.blocksRatio * 100, benchmark.freeSectors, benchmark.sectors);
+			regionStatus = result;
+		}
+		if (!regionStatus.empty()) {
+			ImGui::SameLine();
+			ImGui::Text(regionStatus.c_str());
+		}
+
 		ImGui::Text("Tree threshold : ");
 		ImGui::SameLine();
 
@@ -306,8 +524,7 @@ void Game::Im(DX::StepTimer const& timer)
 
 		ImGui::InputInt(" ", &seed);
 		if (ImGui::Button("Generate from seed")) {
-			world.Generate(m_deviceResources.get(), seed, treeThreshold);
-			player.Reset();
+			pendingCommands.push_back(Command::GenerateSeed(seed, treeThreshold));
 		}
 
 		ImGui::Spacing();
@@ -317,12 +534,10 @@ void Game::Im(DX::StepTimer const& timer)
 		ImGui::SameLine();
 		ImGui::InputText("  ", filenameBuf, 50);
 		if (ImGui::Button("Generate from file")) {
-			const size_t cSize = strlen(filenameBuf) + 1;
-			wchar_t* wc = new wchar_t[cSize];
-			mbstowcs(wc, filenameBuf, cSize);
-
-			world.GenerateFromFile(m_deviceResources.get(), wc, treeThreshold);
-			player.Reset();
+			pendingCommands.push_back(Command::GenerateFile(filenameBuf, treeThreshold));
+		}
+		if (!world.GetLoadError().empty()) {
+			ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s", world.GetLoadError().c_str());
 		}
 
 		ImGui::Spacing();
@@ -331,12 +546,7 @@ void Game::Im(DX::StepTimer const& timer)
 		for (int i = 0; i < maps.size(); i++) {
 			ImGui::PushID(i);
 			if (ImGui::Button(maps.at(i))) {
-				const size_t cSize = strlen(maps.at(i)) + 1;
-				wchar_t* wc = new wchar_t[cSize];
-				mbstowcs(wc, maps.at(i), cSize);
-
-				world.GenerateFromFile(m_deviceResources.get(), wc, treeThreshold);
-				player.Reset();
+				pendingCommands.push_back(Command::GenerateFile(maps.at(i), treeThreshold));
 			}
 			ImGui::PopID();
 			if (i != maps.size() - 1) {
@@ -344,6 +554,82 @@ void Game::Im(DX::StepTimer const& timer)
 			}
 		}
 
+		ImGui::Spacing();
+		ImGui::Spacing();
+
+		ImGui::Text("Save : ");
+		ImGui::SameLine();
+		ImGui::InputText("    ", saveNameBuf, 50);
+
+		std::string saveName = saveNameBuf;
+		std::wstring savePath = CitySave::GetPath(std::wstring(saveName.begin(), saveName.end()));
+		if (ImGui::Button("Save city")) {
+			saveStatus = CitySave::Save(savePath, world, player) ? "Saved" : "Could not save the city";
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Load city")) {
+			// A loaded city can't be replayed from a generation
+			replay.Stop();
+			std::string error;
+			saveStatus = CitySave::Load(savePath, world, player, error) ? "Loaded" : error;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Restore autosave")) {
+			replay.Stop();
+			std::string error;
+			saveStatus = autosave.Restore(world, player, error) ? "Autosave restored" : error;
+		}
+		if (!saveStatus.empty()) {
+			ImGui::Text(saveStatus.c_str());
+		}
+		ImGui::Text("Last autosave : %.3f ms", autosave.GetLastSnapshotTime());
+
+		ImGui::Spacing();
+		ImGui::Spacing();
+
+		ImGui::Text("Replay : ");
+		ImGui::SameLine();
+		ImGui::InputText("     ", replayNameBuf, 50);
+
+		std::string replayName = replayNameBuf;
+		std::wstring replayPath = Replay::GetPath(std::wstring(replayName.begin(), replayName.end()));
+		if (replay.GetMode() == Replay::REPLAY_RECORDING) {
+			if (ImGui::Button("Stop and save")) {
+				replay.StopRecording(Replay::ComputeStateHash(world, player));
+				replayStatus = replay.Save(replayPath) ? "Replay saved" : "Could not save the replay";
+			}
+			ImGui::SameLine();
+			ImGui::Text("Recording : %u ticks", replay.GetTick());
+		}
+		else {
+			if (ImGui::Button("Record")) {
+				// A replay starts from the map : it is generated again on the first tick
+				replay.StartRecording();
+				pendingCommands.clear();
+				pendingCommands.push_back(lastGeneration);
+				pendingCommands.push_back(Command::SelectTool(player.GetTool()));
+				lastCameraPosition = Vector3();
+				lastCameraYaw = 0;
+				replayStatus.clear();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Play")) {
+				std::string error;
+				if (replay.Load(replayPath, error)) {
+					replay.StartPlaying();
+					pendingCommands.clear();
+					replayStatus = "Playing";
+				}
+				else replayStatus = error;
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Run headless")) {
+				PlayReplayHeadless(replayPath);
+			}
+		}
+		if (!replayStatus.empty()) {
+			ImGui::Text(replayStatus.c_str());
+		}
 
 	}
 	if (ImGui::CollapsingHeader("Controls")) {
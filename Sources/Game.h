@@ -2,6 +2,7 @@
 
 #include "Engine/DeviceResources.h"
 #include "Engine/StepTimer.h"
+#include "Minicraft/Command.h"
 
 // A basic game implementation that creates a D3D11 device and
 // provides a game loop.
@@ -13,6 +14,20 @@ public:
 	// Initialization and management
 	void Initialize(HWND window, int width, int height);
 
+	/// <summary>
+	/// Plays a replay without a window, then prints whether it reached the recorded state
+	/// </summary>
+	/// <param name="replayPath">The replay's path</param>
+	/// <returns>The process' exit code : 0 if the state is the recorded one, 1 if it differs, 2 if the replay couldn't be loaded</returns>
+	int RunHeadless(const std::wstring& replayPath);
+
+	/// <summary>
+	/// Checks the light updates without a window : random edits of a generated map, each compared with a full rebuild
+	/// </summary>
+	/// <param name="edits">The number of edits</param>
+	/// <returns>The process' exit code : 0 if the light always matched the rebuild, 1 otherwise</returns>
+	int CheckLightHeadless(int edits);
+
 	// Basic game loop
 	void Tick();
 
@@ -37,6 +52,18 @@ private:
 	void Update(DX::StepTimer const& timer);
 	void Render(DX::StepTimer const& timer);
 
+	// Executes a command on the world or the player
+	void Execute(const Command& command);
+
+	// Simulates a fixed tick : executes the commands (from the inputs or the replay) and updates the economy
+	void SimulateTick();
+
+	// Plays a replay at once, without rendering. Returns the same codes as RunHeadless.
+	int PlayReplayHeadless(const std::wstring& replayPath);
+
+	// Creates what the simulation needs without a window : the device for the chunks' buffers, no swap chain, shaders or textures
+	void CreateHeadlessResources();
+
 	// Device resources.
 	std::unique_ptr<DeviceResources>		m_deviceResources;
 
@@ -0,0 +1,422 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "Engine/MappedFile.h"
+#include "Autosave.h"
+#include "CitySave.h"
+#include "Chunk.h"
+#include "Player.h"
+
+// "MCAJ"
+static constexpr uint32_t JOURNAL_MAGIC = 0x4A41434D;
+// To increment whenever the layout of the file or the meaning of its data changes
+static constexpr uint32_t JOURNAL_VERSION = 2;
+// "RCRD"
+static constexpr uint32_t RECORD_MAGIC = 0x44524352;
+
+static constexpr int CHUNK_COUNT = WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT;
+static constexpr int CHUNK_BLOCKS = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+static constexpr int PAGE_COUNT = WORLD_SIZE * WORLD_SIZE;
+static constexpr int PAGE_TILES = CHUNK_SIZE * CHUNK_SIZE;
+static constexpr int MAP_SIZE = WORLD_SIZE * CHUNK_SIZE;
+
+// The journal is compacted once it's this many times bigger than its first record
+static constexpr size_t COMPACTION_RATIO = 4;
+
+struct JournalHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t worldSize;
+	uint32_t worldHeight;
+	uint32_t chunkSize;
+};
+
+/// <summary>
+/// Start of a record. Followed by the payload :
+/// - Full flag (1 byte)
+/// - The economy (energy, water, income) and the player (position, yaw, money, income cooldown)
+/// - The number of chunks, then for each : its index, the size of its data, its run-length encoded blocks, then its block states
+/// - The number of pages, then for each : its index, the size of its tiles, its run-length encoded tiles,
+///   then the height of every building in the page
+/// </summary>
+struct RecordHeader {
+	uint32_t magic;
+	uint32_t payloadSize;
+	// FNV-1a of the payload
+	uint64_t checksum;
+};
+
+static JournalHeader MakeJournalHeader() {
+	JournalHeader header = {};
+	header.magic = JOURNAL_MAGIC;
+	header.version = JOURNAL_VERSION;
+	header.worldSize = WORLD_SIZE;
+	header.worldHeight = WORLD_HEIGHT;
+	header.chunkSize = CHUNK_SIZE;
+	return header;
+}
+
+// Global tile index of a tile in a page
+static int PageTileToTile(int page, int tile) {
+	int x = (page % WORLD_SIZE) * CHUNK_SIZE + tile % CHUNK_SIZE;
+	int z = (page / WORLD_SIZE) * CHUNK_SIZE + tile / CHUNK_SIZE;
+	return x + z * MAP_SIZE;
+}
+
+Autosave::Autosave(const std::wstring& path, float interval) : path(path), interval(interval) {
+	writer = std::thread(&Autosave::WriterLoop, this);
+}
+
+Autosave::~Autosave() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+}
+
+void Autosave::Update(float dt, World& world, Player& player) {
+	timer += dt;
+	if (timer < interval) return;
+	timer = 0;
+
+	TakeSnapshot(world, player);
+}
+
+void Autosave::TakeSnapshot(World& world, Player& player) {
+	auto start = std::chrono::steady_clock::now();
+
+	auto snapshot = std::make_unique<Snapshot>();
+
+	// A chunk to save is loaded, or was evicted and handed its blocks to the streamer : nothing is read from the region files
+	ChunkStreamer& streamer = world.GetStreamer();
+	for (int idx = 0; idx < CHUNK_COUNT; idx++) {
+		Chunk* chunk = world.chunks[idx];
+		if (chunk->needSave && chunk->IsLoaded()) {
+			// Changed again since : the evicted copy is older
+			streamer.DropUnsaved(idx);
+			chunk->needSave = false;
+			snapshot->chunkIndices.push_back(idx);
+			snapshot->chunkBlocks.insert(snapshot->chunkBlocks.end(), chunk->data, chunk->data + CHUNK_BLOCKS);
+			snapshot->chunkStates.push_back(chunk->states);
+			continue;
+		}
+
+		std::vector<BlockStateEntry> states;
+		if (!streamer.TakeUnsaved(idx, snapshot->chunkBlocks, states)) continue;
+		snapshot->chunkIndices.push_back(idx);
+		snapshot->chunkStates.push_back(std::move(states));
+	}
+
+	// Slot of every dirty page in the snapshot
+	int pageSlots[PAGE_COUNT];
+	for (int page = 0; page < PAGE_COUNT; page++) {
+		pageSlots[page] = -1;
+		if (!world.dirtyBuildingPages[page]) continue;
+		world.dirtyBuildingPages[page] = false;
+
+		pageSlots[page] = (int)snapshot->pageIndices.size();
+		snapshot->pageIndices.push_back(page);
+		for (int tile = 0; tile < PAGE_TILES; tile++) {
+			snapshot->pageTiles.push_back((uint8_t)world.buildings[PageTileToTile(page, tile)]);
+		}
+	}
+	if (!snapshot->pageIndices.empty()) {
+		snapshot->pageHeights.resize(snapshot->pageIndices.size() * PAGE_TILES);
+		for (int type = TREE; type <= ROAD; type++) {
+			for (const Vector3& position : *world.buildingsPositions[(Building)type].positions) {
+				int x = (int)position.x;
+				int z = (int)position.z;
+				int slot = pageSlots[x / CHUNK_SIZE + (z / CHUNK_SIZE) * WORLD_SIZE];
+				if (slot >= 0) snapshot->pageHeights[slot * PAGE_TILES + x % CHUNK_SIZE + (z % CHUNK_SIZE) * CHUNK_SIZE] = position.y;
+			}
+		}
+	}
+
+	snapshot->full = snapshot->chunkIndices.size() == CHUNK_COUNT && snapshot->pageIndices.size() == PAGE_COUNT;
+	snapshot->energyGain = world.energyGain;
+	snapshot->waterGain = world.waterGain;
+	snapshot->passiveIncome = world.passiveIncome;
+	snapshot->playerPosition = player.position;
+	snapshot->playerYaw = player.currentYaw;
+	snapshot->money = player.money;
+	snapshot->incomeCooldown = player.passiveIncomeCooldown;
+
+	bool changed = !snapshot->chunkIndices.empty() || !snapshot->pageIndices.empty() ||
+		snapshot->money != last.money || snapshot->playerPosition != last.playerPosition || snapshot->playerYaw != last.playerYaw;
+	if (changed) {
+		last.money = snapshot->money;
+		last.playerPosition = snapshot->playerPosition;
+		last.playerYaw = snapshot->playerYaw;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			queue.push_back(std::move(snapshot));
+		}
+		wake.notify_one();
+	}
+
+	lastSnapshotTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Autosave::Flush() {
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this]() { return queue.empty() && !writing; });
+}
+
+void Autosave::WriterLoop() {
+	while (true) {
+		std::unique_ptr<Snapshot> snapshot;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]() { return !queue.empty() || stopping; });
+			// The pending snapshots are written before stopping
+			if (queue.empty()) return;
+
+			snapshot = std::move(queue.front());
+			queue.pop_front();
+			writing = true;
+		}
+
+		Write(*snapshot);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			writing = false;
+		}
+		idle.notify_all();
+	}
+}
+
+void Autosave::WriteRecord(BinaryWriter& writer, const Snapshot& snapshot) {
+	size_t headerOffset = writer.GetSize();
+	writer.Write(RecordHeader{});
+	size_t payloadOffset = writer.GetSize();
+
+	writer.Write((uint8_t)snapshot.full);
+	writer.Write(snapshot.energyGain);
+	writer.Write(snapshot.waterGain);
+	writer.Write(snapshot.passiveIncome);
+	writer.Write(snapshot.playerPosition);
+	writer.Write(snapshot.playerYaw);
+	writer.Write(snapshot.money);
+	writer.Write(snapshot.incomeCooldown);
+
+	writer.Write((uint32_t)snapshot.chunkIndices.size());
+	for (size_t i = 0; i < snapshot.chunkIndices.size(); i++) {
+		writer.Write((uint32_t)snapshot.chunkIndices[i]);
+		size_t sizeOffset = writer.GetSize();
+		writer.Write((uint32_t)0);
+		writer.WriteRle(&snapshot.chunkBlocks[i * CHUNK_BLOCKS], CHUNK_BLOCKS);
+		WriteBlockStates(writer, snapshot.chunkStates[i]);
+		writer.WriteAt(sizeOffset, (uint32_t)(writer.GetSize() - sizeOffset - sizeof(uint32_t)));
+	}
+
+	writer.Write((uint32_t)snapshot.pageIndices.size());
+	for (size_t i = 0; i < snapshot.pageIndices.size(); i++) {
+		writer.Write((uint32_t)snapshot.pageIndices[i]);
+		size_t sizeOffset = writer.GetSize();
+		writer.Write((uint32_t)0);
+		const uint8_t* tiles = &snapshot.pageTiles[i * PAGE_TILES];
+		writer.WriteRle(tiles, PAGE_TILES);
+		writer.WriteAt(sizeOffset, (uint32_t)(writer.GetSize() - sizeOffset - sizeof(uint32_t)));
+
+		for (int tile = 0; tile < PAGE_TILES; tile++) {
+			if (tiles[tile] != NOTHING) writer.Write(snapshot.pageHeights[i * PAGE_TILES + tile]);
+		}
+	}
+
+	RecordHeader header;
+	header.magic = RECORD_MAGIC;
+	header.payloadSize = (uint32_t)(writer.GetSize() - payloadOffset);
+	header.checksum = Fnv1a64(writer.GetData() + payloadOffset, header.payloadSize);
+	writer.WriteAt(headerOffset, header);
+}
+
+void Autosave::Write(const Snapshot& snapshot) {
+	ApplySnapshot(saved, snapshot);
+	// A journal can only start with a full snapshot
+	if (!saved.full) return;
+
+	// A new journal is started after a new map, after an error, or when the journal is too big
+	if (snapshot.full || journalSize == 0) {
+		WriteBase();
+		return;
+	}
+
+	BinaryWriter writer;
+	WriteRecord(writer, snapshot);
+	if (!writer.AppendToFile(path)) {
+		journalSize = 0;
+		return;
+	}
+
+	journalSize += writer.GetSize();
+	if (journalSize > baseSize * COMPACTION_RATIO) WriteBase();
+}
+
+void Autosave::WriteBase() {
+	BinaryWriter writer;
+	writer.Write(MakeJournalHeader());
+	WriteRecord(writer, saved);
+
+	CreateDirectoryW(L"Saves", nullptr);
+	journalSize = baseSize = writer.SaveToFile(path) ? writer.GetSize() : 0;
+}
+
+void Autosave::ApplySnapshot(Snapshot& target, const Snapshot& snapshot) {
+	if (snapshot.full) {
+		target = snapshot;
+		return;
+	}
+	// Changes without a full snapshot to apply them on
+	if (!target.full) return;
+
+	for (size_t i = 0; i < snapshot.chunkIndices.size(); i++) {
+		size_t idx = snapshot.chunkIndices[i];
+		memcpy(&target.chunkBlocks[idx * CHUNK_BLOCKS], &snapshot.chunkBlocks[i * CHUNK_BLOCKS], CHUNK_BLOCKS);
+		target.chunkStates[idx] = snapshot.chunkStates[i];
+	}
+	for (size_t i = 0; i < snapshot.pageIndices.size(); i++) {
+		size_t page = snapshot.pageIndices[i];
+		memcpy(&target.pageTiles[page * PAGE_TILES], &snapshot.pageTiles[i * PAGE_TILES], PAGE_TILES);
+		memcpy(&target.pageHeights[page * PAGE_TILES], &snapshot.pageHeights[i * PAGE_TILES], PAGE_TILES * sizeof(float));
+	}
+
+	target.energyGain = snapshot.energyGain;
+	target.waterGain = snapshot.waterGain;
+	target.passiveIncome = snapshot.passiveIncome;
+	target.playerPosition = snapshot.playerPosition;
+	target.playerYaw = snapshot.playerYaw;
+	target.money = snapshot.money;
+	target.incomeCooldown = snapshot.incomeCooldown;
+}
+
+bool Autosave::ReadRecord(BinaryReader& reader, Snapshot& snapshot) {
+	uint8_t full = 0;
+	reader.Read(full);
+	reader.Read(snapshot.energyGain);
+	reader.Read(snapshot.waterGain);
+	reader.Read(snapshot.passiveIncome);
+	reader.Read(snapshot.playerPosition);
+	reader.Read(snapshot.playerYaw);
+	reader.Read(snapshot.money);
+	reader.Read(snapshot.incomeCooldown);
+	snapshot.full = full != 0;
+
+	uint32_t chunkCount = 0;
+	if (!reader.Read(chunkCount) || chunkCount > CHUNK_COUNT) return false;
+	snapshot.chunkBlocks.resize((size_t)chunkCount * CHUNK_BLOCKS);
+	snapshot.chunkStates.resize(chunkCount);
+	for (uint32_t i = 0; i < chunkCount; i++) {
+		uint32_t idx = 0, size = 0;
+		reader.Read(idx);
+		reader.Read(size);
+		const uint8_t* encoded = reader.Skip(size);
+		if (!encoded || idx >= CHUNK_COUNT) return false;
+		// Full records hold every chunk in order
+		if (snapshot.full && idx != i) return false;
+
+		snapshot.chunkIndices.push_back(idx);
+		BinaryReader blocksReader(encoded, size);
+		const BlockId* blocks = &snapshot.chunkBlocks[i * CHUNK_BLOCKS];
+		if (!blocksReader.ReadRle((uint8_t*)blocks, CHUNK_BLOCKS) || !ReadBlockStates(blocksReader, blocks, CHUNK_BLOCKS, snapshot.chunkStates[i]) ||
+			blocksReader.GetRemaining() != 0) return false;
+	}
+
+	uint32_t pageCount = 0;
+	if (!reader.Read(pageCount) || pageCount > PAGE_COUNT) return false;
+	snapshot.pageTiles.resize((size_t)pageCount * PAGE_TILES);
+	snapshot.pageHeights.resize((size_t)pageCount * PAGE_TILES);
+	for (uint32_t i = 0; i < pageCount; i++) {
+		uint32_t page = 0, size = 0;
+		reader.Read(page);
+		reader.Read(size);
+		const uint8_t* encoded = reader.Skip(size);
+		if (!encoded || page >= PAGE_COUNT) return false;
+		if (snapshot.full && page != i) return false;
+
+		snapshot.pageIndices.push_back(page);
+		uint8_t* tiles = &snapshot.pageTiles[i * PAGE_TILES];
+		BinaryReader tilesReader(encoded, size);
+		if (!tilesReader.ReadRle(tiles, PAGE_TILES) || tilesReader.GetRemaining() != 0) return false;
+
+		for (int tile = 0; tile < PAGE_TILES; tile++) {
+			if (tiles[tile] > ROAD) return false;
+			if (tiles[tile] != NOTHING) reader.Read(snapshot.pageHeights[i * PAGE_TILES + tile]);
+		}
+	}
+
+	if (snapshot.full && (chunkCount != CHUNK_COUNT || pageCount != PAGE_COUNT)) return false;
+	return !reader.HasFailed() && reader.GetRemaining() == 0;
+}
+
+bool Autosave::Restore(World& world, Player& player, std::string& error) {
+	Flush();
+
+	MappedFile file;
+	if (!file.Open(path)) {
+		error = "There is no autosave";
+		return false;
+	}
+
+	JournalHeader header;
+	JournalHeader expected = MakeJournalHeader();
+	BinaryReader reader(file.GetData(), file.GetSize());
+	if (!reader.Read(header) || header.magic != expected.magic || header.version != expected.version ||
+		header.worldSize != expected.worldSize || header.worldHeight != expected.worldHeight || header.chunkSize != expected.chunkSize) {
+		error = "The autosave was made with another version of the game";
+		return false;
+	}
+
+	// The records are applied one after the other. A record cut by a crash ends the journal.
+	Snapshot state;
+	while (reader.GetRemaining() >= sizeof(RecordHeader)) {
+		RecordHeader recordHeader;
+		reader.Read(recordHeader);
+		const uint8_t* payload = reader.Skip(recordHeader.payloadSize);
+		if (recordHeader.magic != RECORD_MAGIC || !payload || Fnv1a64(payload, recordHeader.payloadSize) != recordHeader.checksum) break;
+
+		BinaryReader recordReader(payload, recordHeader.payloadSize);
+		Snapshot snapshot;
+		if (!ReadRecord(recordReader, snapshot)) break;
+
+		ApplySnapshot(state, snapshot);
+	}
+
+	if (!state.full) {
+		error = "The autosave is corrupted";
+		return false;
+	}
+
+	CityState city;
+	city.blocks = std::move(state.chunkBlocks);
+	city.states = std::move(state.chunkStates);
+	city.tiles.resize(MAP_SIZE * MAP_SIZE);
+	for (int page = 0; page < PAGE_COUNT; page++) {
+		for (int tile = 0; tile < PAGE_TILES; tile++) {
+			city.tiles[PageTileToTile(page, tile)] = state.pageTiles[page * PAGE_TILES + tile];
+		}
+	}
+	// The positions are rebuilt from the tiles (the order of the instances doesn't matter)
+	city.positions.resize(ROAD + 1);
+	for (int page = 0; page < PAGE_COUNT; page++) {
+		for (int tile = 0; tile < PAGE_TILES; tile++) {
+			uint8_t type = state.pageTiles[page * PAGE_TILES + tile];
+			if (type == NOTHING) continue;
+			int index = PageTileToTile(page, tile);
+			city.positions[type].push_back({ (float)(index % MAP_SIZE), state.pageHeights[page * PAGE_TILES + tile], (float)(index / MAP_SIZE) });
+		}
+	}
+	city.energyGain = state.energyGain;
+	city.waterGain = state.waterGain;
+	city.passiveIncome = state.passiveIncome;
+	city.playerPosition = { state.playerPosition.x, state.playerPosition.y, state.playerPosition.z };
+	city.playerYaw = state.playerYaw;
+	city.money = state.money;
+	city.incomeCooldown = state.incomeCooldown;
+
+	CitySave::Apply(std::move(city), world, player);
+	error.clear();
+	return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Minicraft/World.h"
+#include "Minicraft/Chunk.h"
+
+class Player;
+class BinaryWriter;
+class BinaryReader;
+
+/// <summary>
+/// Saves the city in the background. At a tick boundary, the chunks and building pages changed since the last
+/// autosave are copied (a few KB each); a writer thread then appends them to a journal, which is compacted
+/// into a single full record once it grows too much.
+/// </summary>
+class Autosave {
+	/// <summary>
+	/// The state of the city at a tick, only for what changed since the previous snapshot
+	/// </summary>
+	struct Snapshot {
+		// Holds every chunk and page (the journal can start from it)
+		bool full = false;
+
+		std::vector<int> chunkIndices;
+		// CHUNK_SIZE^3 blocks per chunk
+		std::vector<BlockId> chunkBlocks;
+		// The block states of every chunk
+		std::vector<std::vector<BlockStateEntry>> chunkStates;
+
+		// A page holds the tiles above a chunk column
+		std::vector<int> pageIndices;
+		// CHUNK_SIZE^2 tiles per page : the building, and the height it's placed at
+		std::vector<uint8_t> pageTiles;
+		std::vector<float> pageHeights;
+
+		int energyGain = 0;
+		int waterGain = 0;
+		int passiveIncome = 0;
+
+		Vector3 playerPosition;
+		float playerYaw = 0;
+		int money = 0;
+		float incomeCooldown = 0;
+	};
+
+	std::wstring path;
+	// Seconds between two snapshots
+	float interval;
+	float timer = 0;
+	// Time taken by the last snapshot on the main thread, in milliseconds
+	float lastSnapshotTime = 0;
+
+	// Player and economy of the last snapshot (to skip snapshots when nothing changed)
+	Snapshot last;
+
+	std::thread writer;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::deque<std::unique_ptr<Snapshot>> queue;
+	bool writing = false;
+	bool stopping = false;
+
+	// Writer thread only : the saved city (a full snapshot) and the size of the journal
+	Snapshot saved;
+	size_t journalSize = 0;
+	size_t baseSize = 0;
+public:
+	/// <summary>
+	/// Starts the writer thread
+	/// </summary>
+	/// <param name="path">The journal's path</param>
+	/// <param name="interval">Seconds between two autosaves</param>
+	Autosave(const std::wstring& path, float interval = 30.0f);
+	~Autosave();
+
+	Autosave(const Autosave&) = delete;
+	Autosave& operator=(const Autosave&) = delete;
+
+	/// <summary>
+	/// Takes a snapshot when it's time to. Must be called between two ticks, when the city isn't being modified.
+	/// </summary>
+	/// <param name="dt">The delta time</param>
+	/// <param name="world">The world</param>
+	/// <param name="player">The player</param>
+	void Update(float dt, World& world, Player& player);
+
+	// Takes a snapshot now
+	void TakeSnapshot(World& world, Player& player);
+
+	// Waits until every snapshot is written
+	void Flush();
+
+	/// <summary>
+	/// Replaces the city with the last autosave
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="player">The player</param>
+	/// <param name="error">Why the autosave couldn't be loaded</param>
+	/// <returns>True if the autosave was loaded. If it wasn't, the world and the player are unchanged.</returns>
+	bool Restore(World& world, Player& player, std::string& error);
+
+	// Gets the time taken by the last snapshot on the main thread, in milliseconds
+	float GetLastSnapshotTime() const { return lastSnapshotTime; }
+
+private:
+	// Writer thread's loop
+	void WriterLoop();
+
+	// Writes a snapshot in the journal
+	void Write(const Snapshot& snapshot);
+
+	// Starts a new journal with the saved city
+	void WriteBase();
+
+	// Serializes a snapshot as a record
+	static void WriteRecord(BinaryWriter& writer, const Snapshot& snapshot);
+
+	// Reads a record's payload, false if it isn't valid
+	static bool ReadRecord(BinaryReader& reader, Snapshot& snapshot);
+
+	/// <summary>
+	/// Applies a snapshot on a full snapshot
+	/// </summary>
+	/// <param name="target">The full snapshot</param>
+	/// <param name="snapshot">The changes</param>
+	static void ApplySnapshot(Snapshot& target, const Snapshot& snapshot);
+};
@@ -1,13 +1,33 @@
 #include "pch.h"
 
+#include "Engine/BinaryStream.h"
 #include "Block.h"
 
-#define CREATE_BLOCK_DATA( ... ) BlockData(__VA_ARGS__),
-const BlockData blocksData[] = {
-	BLOCKS(CREATE_BLOCK_DATA)
-};
-
 const BlockData& BlockData::Get(const BlockId id) {
-	if (id < 0 || id > COUNT) return blocksData[EMPTY];
-	return blocksData[id];
-}
\ No newline at end of file
+	if (id < 0 || id > COUNT) return BLOCKS_DATA[EMPTY];
+	return BLOCKS_DATA[id];
+}
+void WriteBlockStates(BinaryWriter& writer, const std::vector<BlockStateEntry>& states) {
+	writer.WriteVarUint(states.size());
+	// Field by field : the entries have padding
+	for (const BlockStateEntry& entry : states) {
+		writer.Write(entry.cell);
+		writer.Write(entry.state);
+	}
+}
+
+bool ReadBlockStates(BinaryReader& reader, const BlockId* blocks, int blockCount, std::vector<BlockStateEntry>& states) {
+	uint64_t count = 0;
+	if (!reader.ReadVarUint(count) || count > (uint64_t)blockCount) return false;
+
+	states.resize((size_t)count);
+	for (size_t i = 0; i < states.size(); i++) {
+		BlockStateEntry& entry = states[i];
+		if (!reader.Read(entry.cell) || !reader.Read(entry.state)) return false;
+		// Sorted without duplicates, as Chunk::SetState keeps them, and only the bits of BlockState
+		if (entry.cell >= blockCount || (i > 0 && entry.cell <= states[i - 1].cell)) return false;
+		if (entry.state == 0 || (entry.state & ~(BS_FACING_MASK | BS_ON)) != 0) return false;
+		if (!BLOCK_REGISTRY.oriented.Has(blocks[entry.cell])) return false;
+	}
+	return true;
+}
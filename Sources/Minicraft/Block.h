@@ -19,6 +19,10 @@ enum BlockFlags : uint64_t {
 	BF_NO_RAYCAST = 1 << 4,
 
 	BF_HALF_BLOCK = 1 << 5,
+	// Gives block light (VoxelLight::SOURCE_LEVEL)
+	BF_LIGHT_SOURCE = 1 << 6,
+	// Has a front face, turned by its state (see BlockState)
+	BF_ORIENTED = 1 << 7,
 };
 
 #define BLOCKS(F) \
@@ -52,13 +56,13 @@ enum BlockFlags : uint64_t {
 	F( DIAMOND_ORE,			50 ) \
 	F( DIAMOND_BLOCK,		24 ) \
 	F( EMERALD_BLOCK,		25 ) \
-	F( REDSTONE_ORE,		51 ) \
+	F( REDSTONE_ORE,		51, BF_LIGHT_SOURCE ) \
 	F( OBSIDIAN,			37 ) \
 \
 /* OBJECTS */ \
 	F( CRAFTING_TABLE,		59, 43, 4 ) /* there is a side variation at index 60 */ \
-	F( FURNACE,				44, 62, 62 ) /* need an orientation & on/off flag */ \
-	F( DISPENSER,			46, 62, 62 ) /* need an orientation flag */ \
+	F( FURNACE,				45, 62, 62, 44, 61, BF_ORIENTED ) \
+	F( DISPENSER,			45, 62, 62, 46, 46, BF_ORIENTED ) \
 /* TRANSPARENT STUFF */ \
 	F( GLASS,				49, BF_CUTOUT ) \
 	F( WATER,				205, BF_NO_PHYSICS | BF_GRAVITY_WATER | BF_NO_RAYCAST, SP_TRANSPARENT ) \
@@ -68,11 +72,14 @@ enum BlockFlags : uint64_t {
 	F( HIGHLIGHT, 180) \
 	F( COUNT, -1)
 
-#define EXTRACT_BLOCK_ID( v ) v,
+#define EXTRACT_BLOCK_ID( v, ... ) v,
 enum BlockId: uint8_t {
 	BLOCKS(EXTRACT_BLOCK_ID)
 };
 
+// Number of values a BlockId can hold : the tables below cover all of them, so that any byte can be looked up without a check
+static constexpr int BLOCK_ID_RANGE = 256;
+
 /// <summary>
 /// Represents a block's data
 /// </summary>
@@ -83,26 +90,171 @@ public:
 	int texIdSide;
 	int texIdTop;
 	int texIdBottom;
+	// Side facing the block's orientation (BF_ORIENTED), off and on
+	int texIdFront;
+	int texIdFrontOn;
 
 	uint64_t flags;
 	ShaderPass pass;
 public:
-	BlockData(BlockId id, int texId, uint64_t flags = BF_NONE, ShaderPass pass = SP_OPAQUE) :
+	constexpr BlockData(BlockId id, int texId, uint64_t flags = BF_NONE, ShaderPass pass = SP_OPAQUE) :
 		id(id),
 		texIdSide(texId),
 		texIdTop(texId),
 		texIdBottom(texId),
+		texIdFront(texId),
+		texIdFrontOn(texId),
+		flags(flags),
+		pass(pass) {}
+
+	constexpr BlockData(BlockId id, int texIdSide, int texIdTop, int texIdBottom, uint64_t flags = BF_NONE, ShaderPass pass = SP_OPAQUE) :
+		id(id),
+		texIdSide(texIdSide),
+		texIdTop(texIdTop),
+		texIdBottom(texIdBottom),
+		texIdFront(texIdSide),
+		texIdFrontOn(texIdSide),
 		flags(flags),
 		pass(pass) {}
 
-	BlockData(BlockId id, int texIdSide, int texIdTop, int texIdBottom, uint64_t flags = BF_NONE, ShaderPass pass = SP_OPAQUE) :
+	constexpr BlockData(BlockId id, int texIdSide, int texIdTop, int texIdBottom, int texIdFront, int texIdFrontOn, uint64_t flags, ShaderPass pass = SP_OPAQUE) :
 		id(id),
 		texIdSide(texIdSide),
 		texIdTop(texIdTop),
 		texIdBottom(texIdBottom),
+		texIdFront(texIdFront),
+		texIdFrontOn(texIdFrontOn),
 		flags(flags),
 		pass(pass) {}
 
 	// Gets a block's data given its ID
 	static const BlockData& Get(const BlockId id);
 };
+
+#define CREATE_BLOCK_DATA( ... ) BlockData(__VA_ARGS__),
+// Data of every block, indexed by ID (up to COUNT)
+inline constexpr BlockData BLOCKS_DATA[] = {
+	BLOCKS(CREATE_BLOCK_DATA)
+};
+
+/// <summary>
+/// The state of a block with BF_ORIENTED, kept beside the chunk's blocks
+/// </summary>
+enum BlockState : uint8_t {
+	// Direction of the front face : 0 = +Z, 1 = +X, 2 = -Z, 3 = -X
+	BS_FACING_MASK = 0x3,
+	// Lit (a burning furnace)
+	BS_ON = 0x4,
+};
+
+/// <summary>
+/// The state of a block in a chunk's side array
+/// </summary>
+struct BlockStateEntry {
+	// Index of the block in the chunk
+	uint16_t cell;
+	// The BlockState bits
+	uint8_t state;
+};
+
+class BinaryWriter;
+class BinaryReader;
+
+// Writes the states of a chunk's blocks : their count, then every entry
+void WriteBlockStates(BinaryWriter& writer, const std::vector<BlockStateEntry>& states);
+
+/// <summary>
+/// Reads the states written by WriteBlockStates, checked against the chunk's blocks
+/// </summary>
+/// <param name="reader">The reader</param>
+/// <param name="blocks">The chunk's blocks, read beforehand</param>
+/// <param name="blockCount">The number of blocks in a chunk</param>
+/// <param name="states">The states</param>
+/// <returns>False if the data is invalid : an entry out of order, or on a block without BF_ORIENTED</returns>
+bool ReadBlockStates(BinaryReader& reader, const BlockId* blocks, int blockCount, std::vector<BlockStateEntry>& states);
+
+/// <summary>
+/// A set of block IDs, with a bit per ID
+/// </summary>
+struct BlockSet {
+	uint64_t words[BLOCK_ID_RANGE / 64] = {};
+
+	constexpr void Add(int id) { words[id >> 6] |= 1ull << (id & 63); }
+	// Adds every ID from 'first' to the end of the range
+	constexpr void AddFrom(int first) {
+		for (int w = 0; w < BLOCK_ID_RANGE / 64; w++) {
+			int start = first - w * 64;
+			if (start <= 0) words[w] = ~0ull;
+			else if (start < 64) words[w] |= ~0ull << start;
+		}
+	}
+	constexpr bool Has(BlockId id) const { return (words[id >> 6] >> (id & 63)) & 1; }
+};
+
+/// <summary>
+/// The block properties the hot loops (meshing, light, water) need, laid out as a bitset per property,
+/// and the face culling table. Everything is computed at compile time from BLOCKS.
+/// The IDs above COUNT behave like EMPTY, as in BlockData::Get.
+/// </summary>
+struct BlockRegistry {
+	BlockSet cutout;
+	BlockSet halfBlock;
+	BlockSet transparentPass;
+	BlockSet water;
+	BlockSet lightSource;
+	BlockSet oriented;
+	// Blocks the light goes through (air, cutouts, water and half blocks)
+	BlockSet lightTransparent;
+	// Blocks the raycasts hit and the buildings stand on (the ones without BF_NO_RAYCAST)
+	BlockSet solid;
+	// Blocks hiding every face against them (the ones no culling rule lets a face through)
+	BlockSet opaque;
+	// For every block, the neighbours against which its faces are shown
+	BlockSet visibleFaces[BLOCK_ID_RANGE];
+
+	// True if a face of 'myself' against 'neighbour' is shown
+	constexpr bool IsFaceVisible(BlockId myself, BlockId neighbour) const { return visibleFaces[myself].Has(neighbour); }
+};
+
+constexpr BlockRegistry MakeBlockRegistry() {
+	BlockRegistry registry;
+	// The IDs above COUNT are air
+	constexpr int blockCount = COUNT + 1;
+	BlockSet air;
+	air.Add(EMPTY);
+	air.AddFrom(blockCount);
+
+	for (int id = 0; id < blockCount; id++) {
+		const BlockData& data = BLOCKS_DATA[id];
+		if (data.flags & BF_CUTOUT) registry.cutout.Add(id);
+		if (data.flags & BF_HALF_BLOCK) registry.halfBlock.Add(id);
+		if (data.pass == SP_TRANSPARENT) registry.transparentPass.Add(id);
+		if (data.flags & BF_GRAVITY_WATER) registry.water.Add(id);
+		if (data.flags & BF_LIGHT_SOURCE) registry.lightSource.Add(id);
+		if (data.flags & BF_ORIENTED) registry.oriented.Add(id);
+		if (data.flags & (BF_CUTOUT | BF_GRAVITY_WATER | BF_HALF_BLOCK)) registry.lightTransparent.Add(id);
+		if (!(data.flags & BF_NO_RAYCAST)) registry.solid.Add(id);
+		if (id != EMPTY && !(data.flags & (BF_CUTOUT | BF_HALF_BLOCK)) && data.pass != SP_TRANSPARENT) registry.opaque.Add(id);
+	}
+
+	// The face culling rules, checked in this order on the neighbour : a half block never hides a face,
+	// a cutout hides the faces of the other cutouts, a transparent block hides the faces of the other transparent blocks,
+	// and air hides nothing. Every other block hides the faces.
+	for (int id = 0; id < blockCount; id++) {
+		const BlockData& data = BLOCKS_DATA[id];
+		bool isCutout = data.flags & BF_CUTOUT;
+		bool isTransparent = data.pass == SP_TRANSPARENT;
+		for (int w = 0; w < BLOCK_ID_RANGE / 64; w++) {
+			uint64_t half = registry.halfBlock.words[w];
+			uint64_t cutout = registry.cutout.words[w] & ~half;
+			uint64_t transparent = registry.transparentPass.words[w] & ~half & ~cutout;
+			registry.visibleFaces[id].words[w] = half | air.words[w] | (isCutout ? 0 : cutout) | (isTransparent ? 0 : transparent);
+		}
+	}
+	for (int id = blockCount; id < BLOCK_ID_RANGE; id++) registry.visibleFaces[id] = registry.visibleFaces[EMPTY];
+
+	for (int w = 0; w < BLOCK_ID_RANGE / 64; w++) registry.lightTransparent.words[w] |= air.words[w];
+	return registry;
+}
+
+inline constexpr BlockRegistry BLOCK_REGISTRY = MakeBlockRegistry();
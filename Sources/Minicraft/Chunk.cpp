@@ -1,18 +1,57 @@
 #include "pch.h"
 
+#include "Engine/BinaryStream.h"
 #include "Chunk.h"
 #include "Utils.h"
 
 Chunk::Chunk(World* world, Vector3 pos) {
-	memset(data, EMPTY, sizeof(data));
+	AllocateBlocks();
 
 	this->world = world;
 	model = Matrix::CreateTranslation(pos);
 	bounds = DirectX::BoundingBox(pos + Vector3(CHUNK_SIZE / 2 - 0.5, CHUNK_SIZE / 2 - 0.5, CHUNK_SIZE / 2 - 0.5), Vector3(CHUNK_SIZE / 2, CHUNK_SIZE / 2, CHUNK_SIZE / 2));
 
-	for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE; i++) {
-		data[i] = EMPTY;
+	RebuildColumns();
+}
+
+void Chunk::AllocateBlocks() {
+	static_assert(EMPTY == 0, "The blocks are allocated zeroed");
+	voxels = std::make_unique<uint8_t[]>(BLOCK_MEMORY);
+	data = (BlockId*)voxels.get();
+	light = voxels.get() + BLOCK_COUNT * sizeof(BlockId);
+	states.clear();
+	waterLevels.reset();
+}
+
+void Chunk::ReleaseBlocks() {
+	voxels.reset();
+	data = nullptr;
+	light = nullptr;
+	std::vector<BlockStateEntry>().swap(states);
+	// The version is kept : the saved levels are still the simulation's
+	waterLevels.reset();
+}
+
+void Chunk::WriteBlocks(BinaryWriter& writer) const {
+	writer.WriteBytes(data, BLOCK_COUNT * sizeof(BlockId));
+	writer.WriteBytes(light, BLOCK_COUNT);
+	WriteBlockStates(writer, states);
+	writer.Write((uint8_t)(waterLevels != nullptr));
+	if (waterLevels) writer.WriteBytes(waterLevels.get(), BLOCK_COUNT);
+}
+
+bool Chunk::ReadBlocks(BinaryReader& reader) {
+	if (!reader.ReadBytes(data, BLOCK_COUNT * sizeof(BlockId)) || !reader.ReadBytes(light, BLOCK_COUNT) || !ReadBlockStates(reader, data, BLOCK_COUNT, states)) return false;
+
+	uint8_t hasWater = 0;
+	if (!reader.Read(hasWater) || hasWater > 1) return false;
+	waterLevels.reset();
+	if (hasWater) {
+		waterLevels = std::make_unique<uint8_t[]>(BLOCK_COUNT);
+		if (!reader.ReadBytes(waterLevels.get(), BLOCK_COUNT)) return false;
 	}
+	waterChanged = false;
+	return true;
 }
 
 BlockId* Chunk::GetCubeLocal(int lx, int ly, int lz) {
@@ -29,94 +68,463 @@ BlockId* Chunk::GetCubeLocal(int lx, int ly, int lz) {
 
 void Chunk::Reset()
 {
+	if (!IsLoaded()) AllocateBlocks();
 	for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE; i++) {
 		data[i] = EMPTY;
 	}
-	needRegen = true;
+	states.clear();
+	RebuildColumns();
+	MarkDirty();
+	needSave = true;
 }
 
-void Chunk::PushCube(int x, int y, int z) {
-	auto blockId = GetCubeLocal(x, y, z);
+void Chunk::UpdateColumnBit(int lx, int ly, int lz) {
+	BlockId block = At(lx, ly, lz);
+	int column = lx + lz * CHUNK_SIZE;
+	uint16_t bit = (uint16_t)(1 << ly);
+	meshVersion++;
+	solidColumns[column] = BLOCK_REGISTRY.solid.Has(block) ? solidColumns[column] | bit : solidColumns[column] & ~bit;
+	waterColumns[column] = BLOCK_REGISTRY.water.Has(block) ? waterColumns[column] | bit : waterColumns[column] & ~bit;
+	transparentColumns[column] = BLOCK_REGISTRY.opaque.Has(block) ? transparentColumns[column] & ~bit : transparentColumns[column] | bit;
+}
 
-	auto& data = BlockData::Get(*blockId);
-	float uvxSide = (data.texIdSide % 16) / BLOCK_TEXSIZE;
-	float uvySide = (data.texIdSide / 16) / BLOCK_TEXSIZE;
+bool Chunk::IsSectionEmpty(int section) const {
+	// A section is a run of rows in every layer of the chunk
+	for (int lz = 0; lz < CHUNK_SIZE; lz++) {
+		const BlockId* rows = &data[section * SECTION_HEIGHT * CHUNK_SIZE + lz * CHUNK_SIZE * CHUNK_SIZE];
+		for (int i = 0; i < SECTION_HEIGHT * CHUNK_SIZE; i++) {
+			if (rows[i] != EMPTY) return false;
+		}
+	}
+	return true;
+}
 
-	float scaleY = (data.flags & BF_HALF_BLOCK) ? 0.5f : 1.0f;
-	if (ShouldRenderFace(x, y, z, 0, 0, 1)) PushFace({ -0.5f + x, -0.5f + y, 0.5f + z }, Vector3::Up, Vector3::Right, Vector3::Backward, data.texIdSide, data.pass, scaleY);
-	if (ShouldRenderFace(x, y, z, 1, 0, 0)) PushFace({ 0.5f + x, -0.5f + y, 0.5f + z }, Vector3::Up, Vector3::Forward, Vector3::Right, data.texIdSide, data.pass, scaleY);
-	if (ShouldRenderFace(x, y, z, 0, 0,-1)) PushFace({ 0.5f + x, -0.5f + y,-0.5f + z }, Vector3::Up, Vector3::Left, Vector3::Forward, data.texIdSide, data.pass, scaleY);
-	if (ShouldRenderFace(x, y, z,-1, 0, 0)) PushFace({ -0.5f + x, -0.5f + y,-0.5f + z }, Vector3::Up, Vector3::Backward, Vector3::Left, data.texIdSide, data.pass, scaleY);
-	if (scaleY != 1.0f || ShouldRenderFace(x, y, z, 0, 1, 0)) PushFace({ -0.5f + x, (scaleY - 0.5f) + y, 0.5f + z }, Vector3::Forward, Vector3::Right, Vector3::Up, data.texIdTop, data.pass);
-	if (ShouldRenderFace(x, y, z, 0,-1, 0)) PushFace({ -0.5f + x, -0.5f + y,-0.5f + z }, Vector3::Backward, Vector3::Right, Vector3::Down, data.texIdBottom, data.pass);
+void Chunk::RebuildColumns() {
+	meshVersion++;
+	for (int lz = 0; lz < CHUNK_SIZE; lz++) {
+		for (int lx = 0; lx < CHUNK_SIZE; lx++) {
+			uint16_t solid = 0, water = 0, transparent = 0;
+			for (int ly = 0; ly < CHUNK_SIZE; ly++) {
+				BlockId block = At(lx, ly, lz);
+				uint16_t bit = (uint16_t)(1 << ly);
+				if (BLOCK_REGISTRY.solid.Has(block)) solid |= bit;
+				if (BLOCK_REGISTRY.water.Has(block)) water |= bit;
+				if (!BLOCK_REGISTRY.opaque.Has(block)) transparent |= bit;
+			}
+			int column = lx + lz * CHUNK_SIZE;
+			solidColumns[column] = solid;
+			waterColumns[column] = water;
+			transparentColumns[column] = transparent;
+		}
+	}
 }
 
-void Chunk::PushFace(Vector3 pos, Vector3 up, Vector3 right, Vector3 normal, int id, ShaderPass pass, float scaleY) {
+// Gets the light level a face receives from the cube it looks at : the brightest of its sky and block levels
+static int FaceLight(uint8_t light) {
+	return std::max(light >> 4, light & 0xF);
+}
+
+void Chunk::PushCube(const ChunkApron& apron, int x, int y, int z, SectionMesh& mesh) const {
+	int idx = ChunkApron::Index(x, y, z);
+	BlockId blockId = apron.blocks[idx];
+
+	auto& data = BlockData::Get(blockId);
+
+	// Sides in the order of BS_FACING_MASK : the one the block faces shows its front
+	int sides[4] = { data.texIdSide, data.texIdSide, data.texIdSide, data.texIdSide };
+	if (BLOCK_REGISTRY.oriented.Has(blockId)) {
+		uint8_t state = GetState(x, y, z);
+		sides[state & BS_FACING_MASK] = (state & BS_ON) ? data.texIdFrontOn : data.texIdFront;
+	}
+
+	// A face is shown and lit by the cube it looks at (the top of a half block is inside its own cube)
+	const BlockSet& visible = BLOCK_REGISTRY.visibleFaces[blockId];
+	float scaleY = BLOCK_REGISTRY.halfBlock.Has(blockId) ? 0.5f : 1.0f;
+	int front = idx + ChunkApron::STRIDE_Z;
+	int right = idx + 1;
+	int back = idx - ChunkApron::STRIDE_Z;
+	int left = idx - 1;
+	int top = idx + ChunkApron::STRIDE_Y;
+	int bottom = idx - ChunkApron::STRIDE_Y;
+	if (visible.Has(apron.blocks[front])) PushFace(mesh, { -0.5f + x, -0.5f + y, 0.5f + z }, Vector3::Up, Vector3::Right, Vector3::Backward, sides[0], data.pass, FaceLight(apron.light[front]), scaleY);
+	if (visible.Has(apron.blocks[right])) PushFace(mesh, { 0.5f + x, -0.5f + y, 0.5f + z }, Vector3::Up, Vector3::Forward, Vector3::Right, sides[1], data.pass, FaceLight(apron.light[right]), scaleY);
+	if (visible.Has(apron.blocks[back])) PushFace(mesh, { 0.5f + x, -0.5f + y,-0.5f + z }, Vector3::Up, Vector3::Left, Vector3::Forward, sides[2], data.pass, FaceLight(apron.light[back]), scaleY);
+	if (visible.Has(apron.blocks[left])) PushFace(mesh, { -0.5f + x, -0.5f + y,-0.5f + z }, Vector3::Up, Vector3::Backward, Vector3::Left, sides[3], data.pass, FaceLight(apron.light[left]), scaleY);
+	if (scaleY != 1.0f) PushFace(mesh, { -0.5f + x, (scaleY - 0.5f) + y, 0.5f + z }, Vector3::Forward, Vector3::Right, Vector3::Up, data.texIdTop, data.pass, FaceLight(apron.light[idx]));
+	else if (visible.Has(apron.blocks[top])) PushFace(mesh, { -0.5f + x, 0.5f + y, 0.5f + z }, Vector3::Forward, Vector3::Right, Vector3::Up, data.texIdTop, data.pass, FaceLight(apron.light[top]));
+	if (visible.Has(apron.blocks[bottom])) PushFace(mesh, { -0.5f + x, -0.5f + y,-0.5f + z }, Vector3::Backward, Vector3::Right, Vector3::Down, data.texIdBottom, data.pass, FaceLight(apron.light[bottom]));
+}
+
+void Chunk::PushFace(SectionMesh& mesh, Vector3 pos, Vector3 up, Vector3 right, Vector3 normal, int id, ShaderPass pass, int light, float scaleY) {
 	Vector2 uv(
 		(id % 16) * BLOCK_TEXSIZE,
 		(id / 16) * BLOCK_TEXSIZE
 	);
 
-	auto a = vb[pass].PushVertex({ ToVec4(pos), ToVec4Normal(normal), uv + Vector2::UnitY * BLOCK_TEXSIZE * scaleY });
-	auto b = vb[pass].PushVertex({ ToVec4(pos + up * scaleY), ToVec4Normal(normal), uv });
-	auto c = vb[pass].PushVertex({ ToVec4(pos + right), ToVec4Normal(normal), uv + Vector2::UnitX * BLOCK_TEXSIZE + Vector2::UnitY * BLOCK_TEXSIZE * scaleY });
-	auto d = vb[pass].PushVertex({ ToVec4(pos + up * scaleY + right), ToVec4Normal(normal), uv + Vector2::UnitX * BLOCK_TEXSIZE });
-	ib[pass].PushTriangle(a, b, c);
-	ib[pass].PushTriangle(c, b, d);
-}
+	// The normal's W holds how much the face is in the dark, so that the buildings (W = 0) stay fully lit
+	Vector4 shadedNormal = ToVec4Normal(normal);
+	shadedNormal.w = 1.0f - light / (float)VoxelLight::MAX_LEVEL;
 
-bool Chunk::ShouldRenderFace(int lx, int ly, int lz, int dx, int dy, int dz) {
-	auto neighbour = GetCubeLocal(lx + dx, ly + dy, lz + dz);
-	if (!neighbour) return true;
-	auto myself = GetCubeLocal(lx, ly, lz);
-
-	const BlockData& myData = BlockData::Get(*myself);
-	const BlockData& neighData = BlockData::Get(*neighbour);
+	auto& vertices = mesh.vertices[pass];
+	uint32_t a = (uint32_t)vertices.size();
+	vertices.push_back({ ToVec4(pos), shadedNormal, uv + Vector2::UnitY * BLOCK_TEXSIZE * scaleY });
+	vertices.push_back({ ToVec4(pos + up * scaleY), shadedNormal, uv });
+	vertices.push_back({ ToVec4(pos + right), shadedNormal, uv + Vector2::UnitX * BLOCK_TEXSIZE + Vector2::UnitY * BLOCK_TEXSIZE * scaleY });
+	vertices.push_back({ ToVec4(pos + up * scaleY + right), shadedNormal, uv + Vector2::UnitX * BLOCK_TEXSIZE });
+	uint32_t b = a + 1, c = a + 2, d = a + 3;
+	mesh.indices[pass].insert(mesh.indices[pass].end(), { a, b, c, c, b, d });
+}
 
-	// Render if half block 
-	if (neighData.flags & BF_HALF_BLOCK)
-		return true;
-	
-	// Check with Cutouts
-	if (neighData.flags & BF_CUTOUT)
-		return !(myData.flags & BF_CUTOUT);
+uint8_t Chunk::GetState(int lx, int ly, int lz) const {
+	uint16_t cell = (uint16_t)(lx + ly * CHUNK_SIZE + lz * CHUNK_SIZE * CHUNK_SIZE);
+	auto it = std::lower_bound(states.begin(), states.end(), cell, [](const BlockStateEntry& entry, uint16_t cell) { return entry.cell < cell; });
+	return it != states.end() && it->cell == cell ? it->state : 0;
+}
 
-	// Check with transparency
-	bool isNeighTransp = neighData.pass == SP_TRANSPARENT;
-	if (isNeighTransp) {
-		bool isTransp = myData.pass == SP_TRANSPARENT;
-		return !isTransp;
+void Chunk::SetState(int lx, int ly, int lz, uint8_t state) {
+	uint16_t cell = (uint16_t)(lx + ly * CHUNK_SIZE + lz * CHUNK_SIZE * CHUNK_SIZE);
+	auto it = std::lower_bound(states.begin(), states.end(), cell, [](const BlockStateEntry& entry, uint16_t cell) { return entry.cell < cell; });
+	bool found = it != states.end() && it->cell == cell;
+	if (state == 0) {
+		if (found) states.erase(it);
 	}
-
-	return *neighbour == EMPTY;
+	else if (found) it->state = state;
+	else states.insert(it, { cell, state });
 }
 
 void Chunk::Generate(DeviceResources* deviceRes) {
+	BuildMesh();
+	Upload(deviceRes);
+}
+
+void Chunk::BuildMesh(uint8_t sections) {
+	// Kept by every job, so that the meshing doesn't allocate once the vectors are big enough
+	static thread_local SectionMesh meshes[SECTION_COUNT];
+	static thread_local SectionMesh assembled;
+
+	// On the stack : every job meshes with its own. Only filled if a section has something to mesh.
+	ChunkApron apron;
+	bool apronFilled = false;
+	for (int section = 0; section < SECTION_COUNT; section++) {
+		if (!(sections & (1 << section))) continue;
+		meshes[section].Clear();
+		if (IsSectionEmpty(section)) continue;
+
+		if (!apronFilled) {
+			FillApron(apron);
+			apronFilled = true;
+		}
+		BuildSection(apron, section, meshes[section]);
+	}
+
+	// The sections are put back one after the other : the new meshes, and the ranges of the others moved as they are
 	for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
-		vb[pass].Clear();
-		ib[pass].Clear();
+		auto& vertices = assembled.vertices[pass];
+		auto& indices = assembled.indices[pass];
+		vertices.clear();
+		indices.clear();
+
+		for (int section = 0; section < SECTION_COUNT; section++) {
+			SectionRange& range = ranges[section][pass];
+			uint32_t firstVertex = (uint32_t)vertices.size();
+			uint32_t firstIndex = (uint32_t)indices.size();
+
+			if (sections & (1 << section)) {
+				const SectionMesh& mesh = meshes[section];
+				vertices.insert(vertices.end(), mesh.vertices[pass].begin(), mesh.vertices[pass].end());
+				for (uint32_t index : mesh.indices[pass]) indices.push_back(index + firstVertex);
+			}
+			else {
+				const auto& oldVertices = vb[pass].data;
+				const auto& oldIndices = ib[pass].indices;
+				vertices.insert(vertices.end(), oldVertices.begin() + range.firstVertex, oldVertices.begin() + range.firstVertex + range.vertexCount);
+				for (uint32_t i = 0; i < range.indexCount; i++) indices.push_back(oldIndices[range.firstIndex + i] - range.firstVertex + firstVertex);
+			}
+
+			range.firstVertex = firstVertex;
+			range.vertexCount = (uint32_t)vertices.size() - firstVertex;
+			range.firstIndex = firstIndex;
+			range.indexCount = (uint32_t)indices.size() - firstIndex;
+		}
+
+		// The chunk's previous buffers are kept for the next chunk
+		std::swap(vb[pass].data, vertices);
+		std::swap(ib[pass].indices, indices);
 	}
+}
+
+void Chunk::BuildSection(const ChunkApron& apron, int section, SectionMesh& mesh) const {
+	// The opaque columns around a column, air out of the world
+	auto opaqueColumn = [this](int x, int z) -> uint16_t {
+		if (x < 0) return adjXNeg ? adjXNeg->GetOpaqueColumn(CHUNK_SIZE - 1, z) : 0;
+		if (x >= CHUNK_SIZE) return adjXPos ? adjXPos->GetOpaqueColumn(0, z) : 0;
+		if (z < 0) return adjZNeg ? adjZNeg->GetOpaqueColumn(x, CHUNK_SIZE - 1) : 0;
+		if (z >= CHUNK_SIZE) return adjZPos ? adjZPos->GetOpaqueColumn(x, 0) : 0;
+		return GetOpaqueColumn(x, z);
+	};
 
+	int yMin = section * SECTION_HEIGHT;
 	for (int x = 0; x < CHUNK_SIZE; x++) {
 		for (int z = 0; z < CHUNK_SIZE; z++) {
-			for (int y = 0; y < CHUNK_SIZE; y++) {
-				auto block = GetCubeLocal(x, y, z);
-				if (EMPTY == *block) continue;
-				PushCube(x, y, z);
+			// An opaque block surrounded by opaque blocks shows no face : most of the ground is skipped without a look.
+			// The blocks above and below are the bits next to it, the ones of the chunks above and below count as shown.
+			uint16_t opaque = opaqueColumn(x, z);
+			uint16_t buried = opaque & (uint16_t)(opaque << 1) & (uint16_t)(opaque >> 1) &
+				opaqueColumn(x - 1, z) & opaqueColumn(x + 1, z) & opaqueColumn(x, z - 1) & opaqueColumn(x, z + 1);
+
+			for (int y = yMin; y < yMin + SECTION_HEIGHT; y++) {
+				if ((buried >> y) & 1) continue;
+				if (EMPTY == apron.blocks[ChunkApron::Index(x, y, z)]) continue;
+				PushCube(apron, x, y, z, mesh);
 			}
 		}
 	}
+}
+
+void Chunk::FillApron(ChunkApron& apron) const {
+	memset(apron.blocks, EMPTY, sizeof(apron.blocks));
+	memset(apron.light, VoxelLight::MAX_LEVEL << 4, sizeof(apron.light));
+
+	// The chunk, row by row
+	for (int z = 0; z < CHUNK_SIZE; z++) {
+		for (int y = 0; y < CHUNK_SIZE; y++) {
+			int from = y * CHUNK_SIZE + z * CHUNK_SIZE * CHUNK_SIZE;
+			int to = ChunkApron::Index(0, y, z);
+			memcpy(&apron.blocks[to], &data[from], CHUNK_SIZE);
+			memcpy(&apron.light[to], &light[from], CHUNK_SIZE);
+		}
+	}
 
+	// The layer of each neighbour touching the chunk (the apron's edges and corners are never read).
+	// An evicted neighbour has no blocks : it counts as out of the world, as World::RegenerateChunks loads them first.
+	auto copyLayer = [&apron](const Chunk* neighbour, int fromX, int fromY, int fromZ, int toX, int toY, int toZ, int axis) {
+		if (!neighbour || !neighbour->IsLoaded()) return;
+		for (int a = 0; a < CHUNK_SIZE; a++) {
+			for (int b = 0; b < CHUNK_SIZE; b++) {
+				// The layer spans the two axes other than 'axis'
+				int x = axis == 0 ? 0 : a;
+				int y = axis == 1 ? 0 : (axis == 0 ? a : b);
+				int z = axis == 2 ? 0 : b;
+				int from = (fromX + x) + (fromY + y) * CHUNK_SIZE + (fromZ + z) * CHUNK_SIZE * CHUNK_SIZE;
+				int to = ChunkApron::Index(toX + x, toY + y, toZ + z);
+				apron.blocks[to] = neighbour->data[from];
+				apron.light[to] = neighbour->light[from];
+			}
+		}
+	};
+	copyLayer(adjXNeg, CHUNK_SIZE - 1, 0, 0, -1, 0, 0, 0);
+	copyLayer(adjXPos, 0, 0, 0, CHUNK_SIZE, 0, 0, 0);
+	copyLayer(adjYNeg, 0, CHUNK_SIZE - 1, 0, 0, -1, 0, 1);
+	copyLayer(adjYPos, 0, 0, 0, 0, CHUNK_SIZE, 0, 1);
+	copyLayer(adjZNeg, 0, 0, CHUNK_SIZE - 1, 0, 0, -1, 2);
+	copyLayer(adjZPos, 0, 0, 0, 0, 0, CHUNK_SIZE, 2);
+}
+
+void Chunk::Upload(DeviceResources* deviceRes) {
 	for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
 		vb[pass].Create(deviceRes);
 		ib[pass].Create(deviceRes);
 	}
-	needRegen = false;
+	dirtySections = 0;
+	resident = true;
+}
+
+size_t Chunk::GetMeshMemory() {
+	size_t bytes = 0;
+	for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
+		bytes += vb[pass].Size() * sizeof(VertexLayout_PositionNormalUV) + ib[pass].Size() * sizeof(uint32_t);
+		for (int slot = 0; slot < LOD_COUNT - 1; slot++) {
+			bytes += lodVb[slot][pass].Size() * sizeof(VertexLayout_PositionNormalUV) + lodIb[slot][pass].Size() * sizeof(uint32_t);
+		}
+	}
+	// A copy on the CPU, a copy on the GPU
+	return bytes * 2;
+}
+
+void Chunk::ReleaseMeshes() {
+	// The vectors are swapped with empty ones : clearing them would keep their memory. Creating an empty buffer releases the GPU one.
+	for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
+		std::vector<VertexLayout_PositionNormalUV>().swap(vb[pass].data);
+		std::vector<uint32_t>().swap(ib[pass].indices);
+		vb[pass].Create(nullptr);
+		ib[pass].Create(nullptr);
+		for (int slot = 0; slot < LOD_COUNT - 1; slot++) {
+			std::vector<VertexLayout_PositionNormalUV>().swap(lodVb[slot][pass].data);
+			std::vector<uint32_t>().swap(lodIb[slot][pass].indices);
+			lodVb[slot][pass].Create(nullptr);
+			lodIb[slot][pass].Create(nullptr);
+		}
+	}
+	memset(ranges, 0, sizeof(ranges));
+	memset(lodVersions, 0, sizeof(lodVersions));
+	resident = false;
+}
+
+void Chunk::WriteMesh(BinaryWriter& writer) const {
+	for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
+		const auto& vertices = vb[pass].data;
+		const auto& indices = ib[pass].indices;
+		writer.Write((uint32_t)vertices.size());
+		writer.Write((uint32_t)indices.size());
+		writer.WriteBytes(vertices.data(), vertices.size() * sizeof(VertexLayout_PositionNormalUV));
+		writer.WriteBytes(indices.data(), indices.size() * sizeof(uint32_t));
+	}
+	writer.WriteBytes(ranges, sizeof(ranges));
+}
+
+bool Chunk::ReadMesh(BinaryReader& reader) {
+	for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
+		uint32_t vertexCount = 0, indexCount = 0;
+		reader.Read(vertexCount);
+		reader.Read(indexCount);
+		if (reader.HasFailed() || (uint64_t)vertexCount * sizeof(VertexLayout_PositionNormalUV) + indexCount * sizeof(uint32_t) > reader.GetRemaining()) return false;
+
+		vb[pass].data.resize(vertexCount);
+		reader.ReadBytes(vb[pass].data.data(), vertexCount * sizeof(VertexLayout_PositionNormalUV));
+		ib[pass].indices.resize(indexCount);
+		reader.ReadBytes(ib[pass].indices.data(), indexCount * sizeof(uint32_t));
+	}
+
+	// The sections are meshed again from these ranges : they must stay in the buffers
+	if (!reader.ReadBytes(ranges, sizeof(ranges))) return false;
+	for (int section = 0; section < SECTION_COUNT; section++) {
+		for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
+			const SectionRange& range = ranges[section][pass];
+			if ((uint64_t)range.firstVertex + range.vertexCount > vb[pass].data.size() ||
+				(uint64_t)range.firstIndex + range.indexCount > ib[pass].indices.size()) return false;
+		}
+	}
+	return true;
+}
+
+uint64_t Chunk::GetMeshHash() const {
+	ChunkApron apron;
+	FillApron(apron);
+	uint64_t hash = Fnv1a64(apron.blocks, sizeof(apron.blocks));
+	hash = Fnv1a64(apron.light, sizeof(apron.light), hash);
+	// Field by field : the entries have padding
+	for (const BlockStateEntry& entry : states) {
+		hash = Fnv1a64(&entry.cell, sizeof(entry.cell), hash);
+		hash = Fnv1a64(&entry.state, sizeof(entry.state), hash);
+	}
+	return hash;
 }
 
 void Chunk::Draw(DeviceResources* deviceRes, ShaderPass pass) {
-	if (vb[pass].Size() == 0) return;
-	vb[pass].Apply(deviceRes, 0);
-	ib[pass].Apply(deviceRes);
-	deviceRes->GetD3DDeviceContext()->DrawIndexed(ib[pass].Size(), 0, 0);
+	int level = GetDrawnLod();
+	auto& vertices = level > 0 ? lodVb[level - 1][pass] : vb[pass];
+	auto& indices = level > 0 ? lodIb[level - 1][pass] : ib[pass];
+	if (vertices.Size() == 0) return;
+	vertices.Apply(deviceRes, 0);
+	indices.Apply(deviceRes);
+	deviceRes->GetD3DDeviceContext()->DrawIndexed(indices.Size(), 0, 0);
+}
+
+size_t Chunk::GetDrawnVertexCount() {
+	int level = GetDrawnLod();
+	size_t count = 0;
+	for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
+		count += level > 0 ? lodVb[level - 1][pass].Size() : vb[pass].Size();
+	}
+	return count;
+}
+
+// The blocks a LOD job works on : the chunk's may change while it runs
+struct ChunkSnapshot {
+	BlockId blocks[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
+	uint8_t light[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
+};
+
+void Chunk::UpdateLod(DeviceResources* deviceRes, int level, JobCounter* jobs) {
+	int slot = level - 1;
+	if (lodPending[slot]) {
+		if (!lodBuilt[slot].load(std::memory_order_acquire)) return;
+
+		// The job is done : its mesh replaces the previous one, which it will reuse next time
+		for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
+			std::swap(lodVb[slot][pass].data, lodMeshes[slot].vertices[pass]);
+			std::swap(lodIb[slot][pass].indices, lodMeshes[slot].indices[pass]);
+			lodVb[slot][pass].Create(deviceRes);
+			lodIb[slot][pass].Create(deviceRes);
+		}
+		lodVersions[slot] = lodPendingVersions[slot];
+		lodPending[slot] = false;
+	}
+	if (lodVersions[slot] == meshVersion) return;
+
+	auto snapshot = std::make_shared<ChunkSnapshot>();
+	memcpy(snapshot->blocks, data, BLOCK_COUNT * sizeof(BlockId));
+	memcpy(snapshot->light, light, BLOCK_COUNT);
+	lodPending[slot] = true;
+	lodPendingVersions[slot] = meshVersion;
+	lodBuilt[slot].store(false, std::memory_order_relaxed);
+	JobSystem::Get()->Schedule([this, slot, level, snapshot]() {
+		BuildLodMesh(snapshot->blocks, snapshot->light, level, lodMeshes[slot]);
+		lodBuilt[slot].store(true, std::memory_order_release);
+	}, jobs);
+}
+
+void Chunk::BuildLodMesh(const BlockId* blocks, const uint8_t* light, int level, SectionMesh& mesh) {
+	mesh.Clear();
+	const int size = 1 << level;
+	const int cells = CHUNK_SIZE / size;
+
+	// Every cell is its highest block (the one seen from above), lit by the brightest of its blocks
+	BlockId cellBlocks[(CHUNK_SIZE / 2) * (CHUNK_SIZE / 2) * (CHUNK_SIZE / 2)];
+	uint8_t cellLight[(CHUNK_SIZE / 2) * (CHUNK_SIZE / 2) * (CHUNK_SIZE / 2)];
+	auto cellIndex = [cells](int cx, int cy, int cz) { return cx + cy * cells + cz * cells * cells; };
+	for (int cz = 0; cz < cells; cz++) {
+		for (int cy = 0; cy < cells; cy++) {
+			for (int cx = 0; cx < cells; cx++) {
+				BlockId top = EMPTY;
+				int brightest = 0;
+				for (int y = cy * size + size - 1; y >= cy * size; y--) {
+					for (int z = cz * size; z < cz * size + size; z++) {
+						for (int x = cx * size; x < cx * size + size; x++) {
+							int idx = x + y * CHUNK_SIZE + z * CHUNK_SIZE * CHUNK_SIZE;
+							if (top == EMPTY) top = blocks[idx];
+							brightest = std::max(brightest, FaceLight(light[idx]));
+						}
+					}
+				}
+				cellBlocks[cellIndex(cx, cy, cz)] = top;
+				cellLight[cellIndex(cx, cy, cz)] = (uint8_t)brightest;
+			}
+		}
+	}
+
+	// The faces between the cells follow the same rules as the blocks'. Out of the chunk, every face is shown.
+	const float s = (float)size;
+	for (int cz = 0; cz < cells; cz++) {
+		for (int cy = 0; cy < cells; cy++) {
+			for (int cx = 0; cx < cells; cx++) {
+				int idx = cellIndex(cx, cy, cz);
+				BlockId blockId = cellBlocks[idx];
+				if (blockId == EMPTY) continue;
+
+				auto& data = BlockData::Get(blockId);
+				const BlockSet& visible = BLOCK_REGISTRY.visibleFaces[blockId];
+				// A face is lit by the cell it looks at, by its own cell on the borders
+				auto neighbour = [&](int dx, int dy, int dz, int& faceLight) {
+					int nx = cx + dx, ny = cy + dy, nz = cz + dz;
+					if (nx < 0 || ny < 0 || nz < 0 || nx >= cells || ny >= cells || nz >= cells) {
+						faceLight = cellLight[idx];
+						return true;
+					}
+					faceLight = cellLight[cellIndex(nx, ny, nz)];
+					return visible.Has(cellBlocks[cellIndex(nx, ny, nz)]);
+				};
+
+				// Corner of the cell, as the blocks are centered on their position
+				Vector3 corner(cx * s - 0.5f, cy * s - 0.5f, cz * s - 0.5f);
+				int faceLight = 0;
+				if (neighbour(0, 0, 1, faceLight)) PushFace(mesh, corner + Vector3(0, 0, s), Vector3::Up * s, Vector3::Right * s, Vector3::Backward, data.texIdSide, data.pass, faceLight);
+				if (neighbour(1, 0, 0, faceLight)) PushFace(mesh, corner + Vector3(s, 0, s), Vector3::Up * s, Vector3::Forward * s, Vector3::Right, data.texIdSide, data.pass, faceLight);
+				if (neighbour(0, 0, -1, faceLight)) PushFace(mesh, corner + Vector3(s, 0, 0), Vector3::Up * s, Vector3::Left * s, Vector3::Forward, data.texIdSide, data.pass, faceLight);
+				if (neighbour(-1, 0, 0, faceLight)) PushFace(mesh, corner, Vector3::Up * s, Vector3::Backward * s, Vector3::Left, data.texIdSide, data.pass, faceLight);
+				if (neighbour(0, 1, 0, faceLight)) PushFace(mesh, corner + Vector3(0, s, s), Vector3::Forward * s, Vector3::Right * s, Vector3::Up, data.texIdTop, data.pass, faceLight);
+				if (neighbour(0, -1, 0, faceLight)) PushFace(mesh, corner, Vector3::Backward * s, Vector3::Right * s, Vector3::Down, data.texIdBottom, data.pass, faceLight);
+			}
+		}
+	}
 }
\ No newline at end of file
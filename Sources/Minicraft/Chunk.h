@@ -1,22 +1,119 @@
 #pragma once
 
 #include "Engine/Buffers.h"
+#include "Engine/JobSystem.h"
 #include "Engine/VertexLayout.h"
 #include "Minicraft/World.h"
 #include "Minicraft/Block.h"
 
 #define CHUNK_SIZE 16
+// Size of the meshing scratch : a chunk with a one-block border
+#define APRON_SIZE (CHUNK_SIZE + 2)
 class World;
+class BinaryWriter;
+class BinaryReader;
+
+// A column's occupancy is a mask with a bit per height
+static_assert(CHUNK_SIZE <= 16, "The column masks hold 16 blocks");
+
+// Height of the sections a chunk is meshed by
+#define SECTION_HEIGHT 4
+#define SECTION_COUNT (CHUNK_SIZE / SECTION_HEIGHT)
+// Mask of every section of a chunk
+#define ALL_SECTIONS ((uint8_t)((1 << SECTION_COUNT) - 1))
+static_assert(SECTION_COUNT <= 8, "The dirty sections are a mask of 8 bits");
+
+/// <summary>
+/// The blocks and light a chunk's mesh depends on, in one flat array : the chunk, and the layers of its neighbours touching it.
+/// Every neighbour of an inner cube is at a fixed offset, so meshing needs no bounds check nor neighbour lookup.
+/// </summary>
+struct ChunkApron {
+	// Offsets between two neighbour cells (1 along X)
+	static constexpr int STRIDE_Y = APRON_SIZE;
+	static constexpr int STRIDE_Z = APRON_SIZE * APRON_SIZE;
+
+	BlockId blocks[APRON_SIZE * APRON_SIZE * APRON_SIZE];
+	uint8_t light[APRON_SIZE * APRON_SIZE * APRON_SIZE];
+
+	// Gets the index of a cell from its position in the chunk (-1 - CHUNK_SIZE)
+	static int Index(int lx, int ly, int lz) { return (lx + 1) + (ly + 1) * STRIDE_Y + (lz + 1) * STRIDE_Z; }
+};
+
+/// <summary>
+/// Where a section's mesh is in the chunk's buffers of a shader pass
+/// </summary>
+struct SectionRange {
+	uint32_t firstVertex = 0;
+	uint32_t vertexCount = 0;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+};
+
+/// <summary>
+/// A mesh being built (a section's, or a level of detail's), with indices starting at 0
+/// </summary>
+struct SectionMesh {
+	std::vector<VertexLayout_PositionNormalUV> vertices[SP_COUNT];
+	std::vector<uint32_t> indices[SP_COUNT];
+
+	void Clear() {
+		for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
+			vertices[pass].clear();
+			indices[pass].clear();
+		}
+	}
+};
 
 /// <summary>
 /// Represents a chunck of the world
 /// </summary>
 class Chunk {
-	BlockId data[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
+public:
+	static constexpr int BLOCK_COUNT = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+	// Memory taken by the blocks and their light while the chunk is loaded, in bytes
+	static constexpr size_t BLOCK_MEMORY = BLOCK_COUNT * (sizeof(BlockId) + sizeof(uint8_t));
+
+private:
+	// The blocks and their light, in one allocation. Released while the chunk is evicted (see ChunkStreamer) : data is null then.
+	std::unique_ptr<uint8_t[]> voxels;
+	BlockId* data = nullptr;
+	// Light of every block : the sky level in the high nibble, the block level in the low one (see VoxelLight)
+	uint8_t* light = nullptr;
+	// States of the blocks with BF_ORIENTED, sorted by cell. Only the non-zero states are stored : these blocks are rare.
+	std::vector<BlockStateEntry> states;
+	// Water level of every block (see WaterFlow), null while the chunk has no water. Released and saved with the blocks.
+	std::unique_ptr<uint8_t[]> waterLevels;
+	// Version of the water simulation the levels were read for : the levels of another version are read again from the blocks
+	uint32_t waterVersion = 0;
+	// The levels changed since the blocks were last saved by the streaming
+	bool waterChanged = false;
+	// Occupancy of every column (lx + lz * CHUNK_SIZE), bit ly set if the block is in the category.
+	// Kept up to date by every block write, so that the column queries are bit operations.
+	// They stay in memory while the blocks are evicted : the queries on the columns never need to load a chunk.
+	uint16_t solidColumns[CHUNK_SIZE * CHUNK_SIZE];
+	uint16_t waterColumns[CHUNK_SIZE * CHUNK_SIZE];
+	// Blocks letting the faces against them show (air, cutouts, transparent and half blocks)
+	uint16_t transparentColumns[CHUNK_SIZE * CHUNK_SIZE];
 	World* world;
 
+	// The sections' meshes, one after the other from the bottom
 	VertexBuffer<VertexLayout_PositionNormalUV> vb[SP_COUNT];
 	IndexBuffer ib[SP_COUNT];
+	SectionRange ranges[SECTION_COUNT][SP_COUNT];
+
+	// Meshes of the coarse levels of detail (1 - LOD_COUNT-1), built on a job from a copy of the blocks
+	VertexBuffer<VertexLayout_PositionNormalUV> lodVb[LOD_COUNT - 1][SP_COUNT];
+	IndexBuffer lodIb[LOD_COUNT - 1][SP_COUNT];
+	// Mesh version each coarse mesh was built from (0 if it never was)
+	uint32_t lodVersions[LOD_COUNT - 1] = {};
+	// The coarse meshes being built : their mesh version, the mesh filled by the job, and whether the job is done
+	bool lodPending[LOD_COUNT - 1] = {};
+	uint32_t lodPendingVersions[LOD_COUNT - 1] = {};
+	SectionMesh lodMeshes[LOD_COUNT - 1];
+	std::atomic<bool> lodBuilt[LOD_COUNT - 1] = {};
+	// Incremented whenever anything a mesh is made from changes : the blocks, their light or their states.
+	// The coarse meshes and the streamed meshes of an older version are out of date.
+	uint32_t meshVersion = 1;
 
 	Chunk* adjXPos = nullptr;
 	Chunk* adjXNeg = nullptr;
@@ -27,7 +124,16 @@ class Chunk {
 public:
 	Matrix model;
 	DirectX::BoundingBox bounds;
-	bool needRegen = false;
+	// Sections to remesh, a bit per section from the bottom
+	uint8_t dirtySections = 0;
+	// Level of detail to draw, chosen from the camera (0 = full)
+	int lod = 0;
+	// True if the chunk's meshes are in memory. The streaming releases the meshes of the chunks far from the camera (see ChunkStreamer).
+	// A resident chunk is always loaded.
+	bool resident = true;
+	// True if the blocks changed since the last autosave. Only while the chunk is loaded : an evicted chunk hands its changes to the
+	// streamer (see ChunkStreamer::TakeUnsaved).
+	bool needSave = false;
 
 	Chunk(World* world, Vector3 pos);
 
@@ -38,7 +144,112 @@ public:
 	void Generate(DeviceResources* deviceRes);
 
 	/// <summary>
-	/// Draws the chunk
+	/// Builds the chunk's mesh on the CPU, from an apron filled first.
+	/// Only the given sections are meshed again, the others keep their range. The empty sections aren't meshed at all.
+	/// Only reads the blocks of the chunk and its neighbours, so it can run on a job.
+	/// </summary>
+	/// <param name="sections">The sections to mesh, a bit per section</param>
+	void BuildMesh(uint8_t sections = ALL_SECTIONS);
+
+	/// <summary>
+	/// Copies the chunk and the border of its neighbours in an apron.
+	/// Out of the world, the border is air under the full sky, so that the faces on the world's edges are shown and lit.
+	/// </summary>
+	/// <param name="apron">The apron</param>
+	void FillApron(ChunkApron& apron) const;
+
+	/// <summary>
+	/// Builds the mesh of a coarse level of detail : every cell of 2^level blocks is a cube, shown as its highest block.
+	/// The faces on the chunk's borders are always kept. They are the skirts hiding the cracks with the neighbours,
+	/// whatever their level : as a cell is full when any of its blocks is, they cover every face the neighbours leave out.
+	/// </summary>
+	/// <param name="blocks">The chunk's blocks</param>
+	/// <param name="light">The chunk's light</param>
+	/// <param name="level">The level of detail (1 - LOD_COUNT-1)</param>
+	/// <param name="mesh">The mesh</param>
+	static void BuildLodMesh(const BlockId* blocks, const uint8_t* light, int level, SectionMesh& mesh);
+
+	/// <summary>
+	/// Keeps the mesh of a coarse level up to date : builds it on a job when the blocks or the light changed since, and uploads it once the job is done.
+	/// </summary>
+	/// <param name="deviceRes">The game's device resources</param>
+	/// <param name="level">The level of detail (1 - LOD_COUNT-1)</param>
+	/// <param name="jobs">The counter of the world's LOD jobs</param>
+	void UpdateLod(DeviceResources* deviceRes, int level, JobCounter* jobs);
+
+	// Gets the level actually drawn : the chosen one if its mesh has the current blocks and light, the full mesh otherwise
+	int GetDrawnLod() const { return lod > 0 && lodVersions[lod - 1] == meshVersion ? lod : 0; }
+
+	// Gets the number of vertices drawn, over every pass
+	size_t GetDrawnVertexCount();
+
+	// Gets the memory taken by the chunk's meshes, on the CPU and the GPU, in bytes
+	size_t GetMeshMemory();
+
+	// Releases the chunk's meshes (but the coarse mesh a job is building), until it is meshed or loaded again
+	void ReleaseMeshes();
+
+	// Writes the chunk's full mesh (every pass, and the section ranges)
+	void WriteMesh(BinaryWriter& writer) const;
+
+	/// <summary>
+	/// Reads a full mesh written by WriteMesh, without uploading it
+	/// </summary>
+	/// <param name="reader">The reader</param>
+	/// <returns>False if the data is invalid</returns>
+	bool ReadMesh(BinaryReader& reader);
+
+	// True if the chunk's blocks, light, states and water levels are in memory
+	bool IsLoaded() const { return data != nullptr; }
+
+	// Gives the chunk its blocks again, all empty and unlit, until they are read or written
+	void AllocateBlocks();
+
+	// Releases the chunk's blocks, light, states and water levels, until they are loaded again. The column masks are kept.
+	void ReleaseBlocks();
+
+	// Writes the chunk's blocks, light, states and water levels
+	void WriteBlocks(BinaryWriter& writer) const;
+
+	/// <summary>
+	/// Reads the blocks, light, states and water levels written by WriteBlocks, in a loaded chunk. The column masks are left as they are.
+	/// </summary>
+	/// <param name="reader">The reader</param>
+	/// <returns>False if the data is invalid</returns>
+	bool ReadBlocks(BinaryReader& reader);
+
+	// Gets a hash of everything the chunk's full mesh is made from : its apron (blocks and light, with the neighbours' borders) and its block states
+	uint64_t GetMeshHash() const;
+
+	// True if some sections need to be meshed again
+	bool NeedsRegen() const { return dirtySections != 0; }
+
+	// Marks every section for the remeshing
+	void MarkDirty() {
+		dirtySections = ALL_SECTIONS;
+		meshVersion++;
+	}
+
+	// Marks the section holding a local height for the remeshing
+	void MarkSectionDirty(int ly) {
+		dirtySections |= (uint8_t)(1 << (ly / SECTION_HEIGHT));
+		meshVersion++;
+	}
+
+	// Clears the light of every block, before it is computed again. The meshes are left as they are.
+	void ClearLight() {
+		memset(light, 0, BLOCK_COUNT);
+		meshVersion++;
+	}
+
+	/// <summary>
+	/// Uploads the chunk's mesh to the GPU
+	/// </summary>
+	/// <param name="deviceRes">The game's device resources</param>
+	void Upload(DeviceResources* deviceRes);
+
+	/// <summary>
+	/// Draws the chunk, at the drawn level of detail
 	/// </summary>
 	/// <param name="deviceRes">The game's device resources</param>
 	/// <param name="pass">The linked shader pass</param>
@@ -53,41 +264,110 @@ public:
 	/// <returns>The cube</returns>
 	BlockId* GetCubeLocal(int lx, int ly, int lz);
 
+	/// <summary>
+	/// Gets a local cube in the chunk, without bounds checks nor neighbour lookups
+	/// </summary>
+	/// <param name="lx">The cube's X position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="ly">The cube's Y position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="lz">The cube's Z position (0 - CHUNK_SIZE-1)</param>
+	/// <returns>The cube</returns>
+	BlockId& At(int lx, int ly, int lz) { return data[lx + ly * CHUNK_SIZE + lz * CHUNK_SIZE * CHUNK_SIZE]; }
+
+	/// <summary>
+	/// Gets the light of a local cube, without bounds checks nor neighbour lookups
+	/// </summary>
+	/// <param name="lx">The cube's X position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="ly">The cube's Y position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="lz">The cube's Z position (0 - CHUNK_SIZE-1)</param>
+	/// <returns>The light (sky level in the high nibble, block level in the low one)</returns>
+	uint8_t& LightAt(int lx, int ly, int lz) { return light[lx + ly * CHUNK_SIZE + lz * CHUNK_SIZE * CHUNK_SIZE]; }
+
+	/// <summary>
+	/// Gets the state of a local cube
+	/// </summary>
+	/// <param name="lx">The cube's X position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="ly">The cube's Y position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="lz">The cube's Z position (0 - CHUNK_SIZE-1)</param>
+	/// <returns>The BlockState bits, 0 if the cube has none</returns>
+	uint8_t GetState(int lx, int ly, int lz) const;
+
+	/// <summary>
+	/// Sets the state of a local cube
+	/// </summary>
+	/// <param name="lx">The cube's X position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="ly">The cube's Y position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="lz">The cube's Z position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="state">The BlockState bits, 0 to remove the state</param>
+	void SetState(int lx, int ly, int lz, uint8_t state);
+
+	/// <summary>
+	/// Gets the solid blocks of a local column (see BlockRegistry::solid)
+	/// </summary>
+	/// <param name="lx">The column's X position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="lz">The column's Z position (0 - CHUNK_SIZE-1)</param>
+	/// <returns>The column's mask, bit ly set if the block is solid</returns>
+	uint16_t GetSolidColumn(int lx, int lz) const { return solidColumns[lx + lz * CHUNK_SIZE]; }
+
+	// Gets the water blocks of a local column, bit ly set if the block is water
+	uint16_t GetWaterColumn(int lx, int lz) const { return waterColumns[lx + lz * CHUNK_SIZE]; }
+
+	// Gets the blocks of a local column that hide every face against them, bit ly set if the block is opaque
+	uint16_t GetOpaqueColumn(int lx, int lz) const { return (uint16_t)~transparentColumns[lx + lz * CHUNK_SIZE]; }
+
+	/// <summary>
+	/// Updates the column masks (and the mesh version) for a changed block
+	/// </summary>
+	/// <param name="lx">The cube's X position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="ly">The cube's Y position (0 - CHUNK_SIZE-1)</param>
+	/// <param name="lz">The cube's Z position (0 - CHUNK_SIZE-1)</param>
+	void UpdateColumnBit(int lx, int ly, int lz);
+
+	// Computes the column masks from the blocks (and changes the mesh version), after they were written directly
+	void RebuildColumns();
+
+	// True if a section only holds air
+	bool IsSectionEmpty(int section) const;
+
 	// Reset the chunk
 	void Reset();
 private:
 
 	/// <summary>
-	/// Pushs a cube inside the chunk
+	/// Meshes the cubes of a section
+	/// </summary>
+	/// <param name="apron">The chunk's apron</param>
+	/// <param name="section">The section</param>
+	/// <param name="mesh">The section's mesh</param>
+	void BuildSection(const ChunkApron& apron, int section, SectionMesh& mesh) const;
+
+	/// <summary>
+	/// Pushs a cube inside a section's mesh
 	/// </summary>
+	/// <param name="apron">The chunk's apron</param>
 	/// <param name="lx">The cube's X position</param>
 	/// <param name="ly">The cube's Y position</param>
 	/// <param name="lz">The cube's Z position</param>
-	void PushCube(int x, int y, int z);
+	/// <param name="mesh">The section's mesh</param>
+	void PushCube(const ChunkApron& apron, int x, int y, int z, SectionMesh& mesh) const;
 
 	/// <summary>
-	/// Pushs a face to the chunk's buffers
+	/// Pushs a face to a section's mesh
 	/// </summary>
+	/// <param name="mesh">The section's mesh</param>
 	/// <param name="pos">The face's position</param>
 	/// <param name="up">The face's up vector</param>
 	/// <param name="right">The face's right vector</param>
 	/// <param name="normal">The face's normal</param>
 	/// <param name="id">The block's ID</param>
 	/// <param name="pass">The linked shader pass</param>
+	/// <param name="light">The face's light level (0 - 15)</param>
 	/// <param name="scaleY">The Y scale</param>
-	void PushFace(Vector3 pos, Vector3 up, Vector3 right, Vector3 normal, int id, ShaderPass pass, float scaleY = 1.0f);
-
-	/// <summary>
-	/// Checks if a face should be rendered
-	/// </summary>
-	/// <param name="lx">The cube's X position</param>
-	/// <param name="ly">The cube's Y position</param>
-	/// <param name="lz">The cube's Y position</param>
-	/// <param name="dx">The target's X position</param>
-	/// <param name="dy">The target's Y position</param>
-	/// <param name="dz">The target's Z position</param>
-	/// <returns>True if the face should be rendered</returns>
-	bool ShouldRenderFace(int lx, int ly, int lz, int dx, int dy, int dz);
+	static void PushFace(SectionMesh& mesh, Vector3 pos, Vector3 up, Vector3 right, Vector3 normal, int id, ShaderPass pass, int light, float scaleY = 1.0f);
 
 	friend class World;
+	friend class WorldCache;
+	friend class CitySave;
+	friend class Autosave;
+	friend class ChunkStreamer;
+	friend class WaterFlow;
 };
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "ChunkStreamer.h"
+#include "World.h"
+#include "Chunk.h"
+
+static constexpr int CHUNK_COUNT = WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT;
+
+void ChunkStreamer::Update(World& world, const Vector3& eye) {
+	frame++;
+	lastUsed.resize(CHUNK_COUNT, 0);
+	savedMeshVersions.resize(CHUNK_COUNT, 0);
+	savedBlockVersions.resize(CHUNK_COUNT, 0);
+	unsaved.resize(CHUNK_COUNT);
+
+	// The chunks in the radius (their columns, seen from above) are used by this frame
+	float maxDistance = (float)(radius * CHUNK_SIZE);
+	int loads = 0;
+	for (int idx = 0; idx < CHUNK_COUNT; idx++) {
+		Chunk* chunk = world.chunks[idx];
+		Vector3 boxMin = chunk->bounds.Center - chunk->bounds.Extents;
+		Vector3 boxMax = chunk->bounds.Center + chunk->bounds.Extents;
+		float dx = std::max({ boxMin.x - eye.x, 0.0f, eye.x - boxMax.x });
+		float dz = std::max({ boxMin.z - eye.z, 0.0f, eye.z - boxMax.z });
+		if (enabled && dx * dx + dz * dz > maxDistance * maxDistance) continue;
+
+		lastUsed[idx] = frame;
+		if (!chunk->resident && loads < MAX_LOADS_PER_FRAME) {
+			Load(world, idx);
+			loads++;
+		}
+	}
+
+	residentCount = 0;
+	loadedCount = 0;
+	residentMemory = 0;
+	for (Chunk* chunk : world.chunks) {
+		if (chunk->IsLoaded()) {
+			loadedCount++;
+			residentMemory += Chunk::BLOCK_MEMORY;
+		}
+		if (chunk->resident) {
+			residentCount++;
+			residentMemory += chunk->GetMeshMemory();
+		}
+	}
+	if (!enabled) return;
+
+	// The least recently used chunks are evicted first. The ones of this frame never are, even past the budget.
+	std::vector<int> candidates;
+	for (int idx = 0; idx < CHUNK_COUNT; idx++) {
+		if (world.chunks[idx]->IsLoaded() && lastUsed[idx] != frame) candidates.push_back(idx);
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](int a, int b) { return lastUsed[a] < lastUsed[b]; });
+	for (int idx : candidates) {
+		if (residentMemory <= budget) break;
+		bool wasResident = world.chunks[idx]->resident;
+		residentMemory -= Evict(world, idx);
+		if (wasResident) residentCount--;
+		if (!world.chunks[idx]->IsLoaded()) loadedCount--;
+	}
+}
+
+void ChunkStreamer::Load(World& world, int idx) {
+	// The meshes are made from the blocks : they come first
+	Chunk* chunk = world.LoadChunk(idx);
+
+	// A saved mesh is only valid if its blocks, light and states didn't change since
+	std::vector<uint8_t> blob;
+	int x, z;
+	RegionFile* region = GetRegion(meshRegions, idx, false, x, z);
+	if (savedMeshVersions[idx] == chunk->meshVersion && !chunk->NeedsRegen() && region && region->Read(x, z, blob)) {
+		BinaryReader reader(blob.data(), blob.size());
+		if (chunk->ReadMesh(reader) && reader.GetRemaining() == 0) {
+			chunk->Upload(world.deviceRes);
+			meshLoadCount++;
+			return;
+		}
+	}
+
+	// Meshed by the next RegenerateChunks, as a chunk whose blocks changed
+	chunk->resident = true;
+	chunk->MarkDirty();
+	remeshedCount++;
+}
+
+bool ChunkStreamer::LoadBlocks(World& world, int idx) {
+	lastUsed.resize(CHUNK_COUNT, 0);
+	savedBlockVersions.resize(CHUNK_COUNT, 0);
+	unsaved.resize(CHUNK_COUNT);
+	lastUsed[idx] = frame;
+
+	// The blocks can't change while they are evicted : the saved ones are the latest.
+	// The version may have changed though (a neighbour's edit marking the chunk for the remeshing).
+	Chunk* chunk = world.chunks[idx];
+	chunk->AllocateBlocks();
+	// The changes the autosave was handed are the loaded blocks : the chunk has them again
+	if (!unsaved[idx].blocks.empty()) {
+		DropUnsaved(idx);
+		chunk->needSave = true;
+	}
+	std::vector<uint8_t> blob;
+	int x, z;
+	RegionFile* region = GetRegion(blockRegions, idx, false, x, z);
+	if (region && region->Read(x, z, blob)) {
+		BinaryReader reader(blob.data(), blob.size());
+		if (chunk->ReadBlocks(reader) && reader.GetRemaining() == 0) {
+			savedBlockVersions[idx] = chunk->meshVersion;
+			blockLoadCount++;
+			return true;
+		}
+	}
+
+	// The file was broken : the chunk comes back empty rather than with blocks its column masks don't match
+	chunk->Reset();
+	savedBlockVersions[idx] = 0;
+	return false;
+}
+
+size_t ChunkStreamer::Evict(World& world, int idx) {
+	Chunk* chunk = world.chunks[idx];
+	size_t released = 0;
+	int x, z;
+
+	if (chunk->resident) {
+		savedMeshVersions[idx] = 0;
+		// A mesh waiting for the remeshing is out of date : it isn't worth saving
+		if (!chunk->NeedsRegen()) {
+			RegionFile* region = GetRegion(meshRegions, idx, true, x, z);
+			BinaryWriter writer;
+			chunk->WriteMesh(writer);
+			// The vertices are floats : the run-length encoding wouldn't make them smaller
+			if (region && region->Write(x, z, writer.GetData(), writer.GetSize(), false)) savedMeshVersions[idx] = chunk->meshVersion;
+		}
+		released += chunk->GetMeshMemory();
+		chunk->ReleaseMeshes();
+	}
+
+	// The blocks are only written if they may have changed since they were last loaded (the water levels change on their own)
+	if (savedBlockVersions[idx] != chunk->meshVersion || chunk->waterChanged) {
+		RegionFile* region = GetRegion(blockRegions, idx, true, x, z);
+		BinaryWriter writer;
+		chunk->WriteBlocks(writer);
+		// Runs of air and of full sky light : the blocks get several times smaller
+		if (!region || !region->Write(x, z, writer.GetData(), writer.GetSize(), true)) return released;
+		savedBlockVersions[idx] = chunk->meshVersion;
+		chunk->waterChanged = false;
+	}
+	// The autosave gets the changes it doesn't have yet, so that it doesn't load the chunk back from the region file
+	if (chunk->needSave) {
+		unsaved[idx].blocks.assign(chunk->data, chunk->data + Chunk::BLOCK_COUNT);
+		unsaved[idx].states = chunk->states;
+		chunk->needSave = false;
+	}
+	chunk->ReleaseBlocks();
+	evictedCount++;
+	return released + Chunk::BLOCK_MEMORY;
+}
+
+bool ChunkStreamer::TakeUnsaved(int idx, std::vector<BlockId>& blocks, std::vector<BlockStateEntry>& states) {
+	if (idx >= (int)unsaved.size() || unsaved[idx].blocks.empty()) return false;
+	blocks.insert(blocks.end(), unsaved[idx].blocks.begin(), unsaved[idx].blocks.end());
+	states = std::move(unsaved[idx].states);
+	DropUnsaved(idx);
+	return true;
+}
+
+void ChunkStreamer::DropUnsaved(int idx) {
+	if (idx >= (int)unsaved.size()) return;
+	// Swapped with empty vectors : clearing them would keep their memory
+	std::vector<BlockId>().swap(unsaved[idx].blocks);
+	std::vector<BlockStateEntry>().swap(unsaved[idx].states);
+}
+
+RegionFile* ChunkStreamer::GetRegion(RegionSet& regions, int idx, bool create, int& x, int& z) {
+	return regions.Get(idx % WORLD_SIZE, (idx / WORLD_SIZE) % WORLD_HEIGHT, idx / (WORLD_SIZE * WORLD_HEIGHT), create, x, z);
+}
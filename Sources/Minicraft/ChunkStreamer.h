@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Engine/RegionSet.h"
+#include "Minicraft/Block.h"
+
+class World;
+
+/// <summary>
+/// Keeps the chunks in memory only around the camera.
+/// The chunks within a radius of the camera are loaded (or meshed) on demand, a few per frame. The others are evicted, the least
+/// recently used first, while the chunks take more than a memory budget : the mesh and the blocks (with their light, states and water levels)
+/// are saved in region files, and released.
+/// An evicted mesh is loaded back instead of meshing the chunk again if the chunk didn't change since.
+/// The blocks of an evicted chunk are loaded back as soon as anything reads them (the water, the light, the edits, the saves) :
+/// the column masks stay in memory, so that the queries on the columns (the raycasts, the placement) don't load anything.
+/// A chunk evicted with changes the autosave doesn't have yet hands it a copy of its blocks : the autosave never loads them back.
+/// </summary>
+class ChunkStreamer {
+public:
+	// Chunks loaded at most in a frame, so that moving doesn't make a frame longer
+	static constexpr int MAX_LOADS_PER_FRAME = 4;
+
+private:
+	bool enabled = false;
+	// Distance to the camera under which the chunks are loaded, in chunks
+	int radius = 2;
+	// Memory the chunks can take (meshes, blocks and light), in bytes.
+	// Smaller than the chunks of the radius : the chunks out of it are evicted as soon as the camera leaves them.
+	size_t budget = 8u << 20;
+
+	uint64_t frame = 0;
+	// Frame each chunk was last in the radius, or last loaded
+	std::vector<uint64_t> lastUsed;
+	// Version (see Chunk::meshVersion) of the mesh and of the blocks each chunk has in the region files (0 if it has none)
+	std::vector<uint32_t> savedMeshVersions;
+	std::vector<uint32_t> savedBlockVersions;
+	// The evicted meshes and blocks. Only valid for this session : the files are emptied when opened.
+	RegionSet meshRegions{ L"Cache/Streaming/Meshes", true };
+	RegionSet blockRegions{ L"Cache/Streaming/Blocks", true };
+
+	// The blocks and states of an evicted chunk that changed since the last autosave (see Chunk::needSave)
+	struct UnsavedChunk {
+		std::vector<BlockId> blocks;
+		std::vector<BlockStateEntry> states;
+	};
+	// By chunk, empty when the chunk has nothing waiting for the autosave. A few KB per chunk, until the next snapshot.
+	std::vector<UnsavedChunk> unsaved;
+
+	// Stats
+	int residentCount = 0;
+	int loadedCount = 0;
+	size_t residentMemory = 0;
+	size_t meshLoadCount = 0;
+	size_t blockLoadCount = 0;
+	size_t remeshedCount = 0;
+	size_t evictedCount = 0;
+
+public:
+	/// <summary>
+	/// Loads the chunks around the camera, and evicts the least recently used ones while the chunks take more than the budget.
+	/// The loaded chunks without a valid saved mesh are marked for the remeshing : call it before World::RegenerateChunks.
+	/// When the streaming is disabled, every chunk is loaded back.
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="eye">The camera's position</param>
+	void Update(World& world, const DirectX::SimpleMath::Vector3& eye);
+
+	/// <summary>
+	/// Brings back the blocks, light and states of an evicted chunk from the region file. Only called on the main thread (see World::LoadChunk).
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="idx">The chunk's index</param>
+	/// <returns>False if the saved blocks couldn't be read : the chunk is empty</returns>
+	bool LoadBlocks(World& world, int idx);
+
+	/// <summary>
+	/// Takes the blocks and states an evicted chunk had when it was evicted, if they changed since the last autosave.
+	/// The chunk doesn't have them anymore : the autosave takes them from here instead of loading the chunk back.
+	/// </summary>
+	/// <param name="idx">The chunk's index</param>
+	/// <param name="blocks">Where the chunk's blocks are appended</param>
+	/// <param name="states">The chunk's block states</param>
+	/// <returns>False if the chunk has nothing waiting for the autosave</returns>
+	bool TakeUnsaved(int idx, std::vector<BlockId>& blocks, std::vector<BlockStateEntry>& states);
+
+	// Drops the copy of an evicted chunk waiting for the autosave, once the chunk has newer blocks
+	void DropUnsaved(int idx);
+
+	// Enables or disables the streaming
+	void SetEnabled(bool enabled) { this->enabled = enabled; }
+	bool IsEnabled() const { return enabled; }
+
+	// Sets the distance to the camera under which the chunks are loaded, in chunks
+	void SetRadius(int radius) { this->radius = std::max(radius, 0); }
+	int GetRadius() const { return radius; }
+
+	// Sets the memory the chunks can take, in bytes
+	void SetBudget(size_t budget) { this->budget = budget; }
+	size_t GetBudget() const { return budget; }
+
+	// Gets the number of chunks with their meshes in memory, with their blocks in memory, and the memory they take (in bytes)
+	int GetResidentCount() const { return residentCount; }
+	int GetLoadedCount() const { return loadedCount; }
+	size_t GetResidentMemory() const { return residentMemory; }
+
+	// Gets the number of meshes and blocks loaded from the region files, of chunks meshed again, and of chunks evicted since the start
+	size_t GetMeshLoadCount() const { return meshLoadCount; }
+	size_t GetBlockLoadCount() const { return blockLoadCount; }
+	size_t GetRemeshedCount() const { return remeshedCount; }
+	size_t GetEvictedCount() const { return evictedCount; }
+
+private:
+	// Brings back the blocks and meshes of a chunk : the meshes from the region file if they are still valid, by marking it for the remeshing otherwise
+	void Load(World& world, int idx);
+
+	/// <summary>
+	/// Saves the meshes and the blocks of a chunk in the region files, and releases them.
+	/// The blocks are only released once they are in the file : they exist nowhere else.
+	/// </summary>
+	/// <returns>The memory released, in bytes</returns>
+	size_t Evict(World& world, int idx);
+
+	// Gets the region file holding a chunk, and the chunk's coordinates in it
+	static RegionFile* GetRegion(RegionSet& regions, int idx, bool create, int& x, int& z);
+};
@@ -0,0 +1,248 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "Engine/JobSystem.h"
+#include "Engine/MappedFile.h"
+#include "Engine/RegionSet.h"
+#include "CityFile.h"
+
+// "MCSV"
+static constexpr uint32_t SAVE_MAGIC = 0x5653434D;
+// To increment whenever the layout of the file or the meaning of its data changes
+static constexpr uint32_t SAVE_VERSION = 4;
+
+/// <summary>
+/// Start of a save. Followed by the payload :
+/// - The player (position, yaw, money, income cooldown)
+/// - The economy (energy, water, income)
+/// - The building of every tile, run-length encoded (encoded size, then the runs)
+/// - For every building type but NOTHING : the number of buildings, then their positions
+/// - For every chunk : the FNV-1a of its blob in the region files
+/// The blob of a chunk is its blocks, then its block states (see WriteBlockStates). The blobs are in the region files of the
+/// save's generation (see CityFile::GetChunksDirectory), run-length encoded by the region files.
+/// </summary>
+struct CitySaveHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t worldSize;
+	uint32_t worldHeight;
+	uint32_t chunkSize;
+	uint32_t buildingTypes;
+	// Every save writes its chunks to a new directory : the previous one stays whole until the save points to the new one
+	uint32_t generation;
+	uint32_t reserved;
+
+	uint64_t payloadSize;
+	// FNV-1a of the payload
+	uint64_t checksum;
+};
+
+static CitySaveHeader MakeHeader(const CityLayout& layout) {
+	CitySaveHeader header = {};
+	header.magic = SAVE_MAGIC;
+	header.version = SAVE_VERSION;
+	header.worldSize = layout.worldSize;
+	header.worldHeight = layout.worldHeight;
+	header.chunkSize = layout.chunkSize;
+	header.buildingTypes = layout.buildingTypes;
+	return header;
+}
+
+std::wstring CityFile::GetChunksDirectory(const std::wstring& path, uint32_t generation) {
+	return path + L".chunks." + std::to_wstring(generation);
+}
+
+// Gets the generation of the save at a path, 0 if there is none (or it can't be read)
+static uint32_t GetGeneration(const std::wstring& path) {
+	MappedFile file;
+	CitySaveHeader header;
+	if (!file.Open(path) || file.GetSize() < sizeof(header)) return 0;
+	memcpy(&header, file.GetData(), sizeof(header));
+	return header.magic == SAVE_MAGIC && header.version == SAVE_VERSION ? header.generation : 0;
+}
+
+// Gets the region file holding a chunk of the save, and the chunk's coordinates in it
+static RegionFile* GetRegion(RegionSet& regions, const CityLayout& layout, int idx, bool create, int& x, int& z) {
+	return regions.Get(idx % layout.worldSize, (idx / layout.worldSize) % layout.worldHeight, idx / (layout.worldSize * layout.worldHeight), create, x, z);
+}
+
+bool CityFile::Write(const std::wstring& path, const CityLayout& layout, const CityState& state) {
+	const int chunkCount = layout.GetChunkCount();
+	const int chunkBlocks = layout.GetChunkBlocks();
+	const int tileCount = layout.GetTileCount();
+
+	BinaryWriter writer;
+	CitySaveHeader header = MakeHeader(layout);
+	writer.Write(header);
+
+	writer.Write(state.playerPosition);
+	writer.Write(state.playerYaw);
+	writer.Write(state.money);
+	writer.Write(state.incomeCooldown);
+
+	writer.Write(state.energyGain);
+	writer.Write(state.waterGain);
+	writer.Write(state.passiveIncome);
+
+	size_t tilesSizeOffset = writer.GetSize();
+	writer.Write((uint32_t)0);
+	writer.WriteRle(state.tiles.data(), tileCount);
+	writer.WriteAt(tilesSizeOffset, (uint32_t)(writer.GetSize() - tilesSizeOffset - sizeof(uint32_t)));
+
+	for (int type = 1; type < layout.buildingTypes; type++) {
+		const std::vector<CityPosition>& positions = state.positions[type];
+		writer.Write((uint32_t)positions.size());
+		writer.WriteBytes(positions.data(), positions.size() * sizeof(CityPosition));
+	}
+
+	// The chunks go to the directory of a new generation, started from empty (a save that didn't finish may have left one).
+	// The save written over keeps its own chunks until the new file replaces it.
+	header.generation = GetGeneration(path) + 1;
+	RegionSet regions(GetChunksDirectory(path, header.generation), true);
+	for (int idx = 0; idx < chunkCount; idx++) {
+		BinaryWriter blob;
+		blob.WriteBytes(&state.blocks[(size_t)idx * chunkBlocks], chunkBlocks);
+		WriteBlockStates(blob, state.states[idx]);
+
+		int x, z;
+		RegionFile* region = GetRegion(regions, layout, idx, true, x, z);
+		if (!region || !region->Write(x, z, blob.GetData(), blob.GetSize(), true)) {
+			regions.Delete();
+			return false;
+		}
+		writer.Write(Fnv1a64(blob.GetData(), blob.GetSize()));
+	}
+
+	header.payloadSize = writer.GetSize() - sizeof(header);
+	header.checksum = Fnv1a64(writer.GetData() + sizeof(header), header.payloadSize);
+	writer.WriteAt(0, header);
+
+	if (!writer.SaveToFile(path)) {
+		regions.Delete();
+		return false;
+	}
+	regions.Close();
+
+	// The chunks of the previous generation aren't used anymore
+	if (header.generation > 1) {
+		RegionSet previous(GetChunksDirectory(path, header.generation - 1), false);
+		int x, z;
+		for (int idx = 0; idx < chunkCount; idx++) GetRegion(previous, layout, idx, false, x, z);
+		previous.Delete();
+	}
+	return true;
+}
+
+bool CityFile::Read(const std::wstring& path, const CityLayout& layout, CityState& state, std::string& error) {
+	const int chunkCount = layout.GetChunkCount();
+	const int chunkBlocks = layout.GetChunkBlocks();
+	const int tileCount = layout.GetTileCount();
+
+	MappedFile file;
+	if (!file.Open(path)) {
+		error = "Could not open the save";
+		return false;
+	}
+
+	CitySaveHeader header;
+	CitySaveHeader expected = MakeHeader(layout);
+	if (file.GetSize() < sizeof(header)) {
+		error = "The save is corrupted";
+		return false;
+	}
+	memcpy(&header, file.GetData(), sizeof(header));
+	if (header.magic != expected.magic) {
+		error = "The file isn't a save";
+		return false;
+	}
+	if (header.version != expected.version) {
+		error = "The save was made with another version of the game";
+		return false;
+	}
+	if (header.worldSize != expected.worldSize || header.worldHeight != expected.worldHeight ||
+		header.chunkSize != expected.chunkSize || header.buildingTypes != expected.buildingTypes) {
+		error = "The save was made for another world size";
+		return false;
+	}
+
+	const uint8_t* payload = file.GetData() + sizeof(header);
+	if (header.payloadSize != file.GetSize() - sizeof(header) || Fnv1a64(payload, header.payloadSize) != header.checksum) {
+		error = "The save is corrupted";
+		return false;
+	}
+
+	BinaryReader reader(payload, header.payloadSize);
+	auto corrupted = [&error]() {
+		error = "The save is corrupted";
+		return false;
+	};
+
+	state = {};
+	reader.Read(state.playerPosition);
+	reader.Read(state.playerYaw);
+	reader.Read(state.money);
+	reader.Read(state.incomeCooldown);
+
+	reader.Read(state.energyGain);
+	reader.Read(state.waterGain);
+	reader.Read(state.passiveIncome);
+
+	uint32_t tilesSize = 0;
+	reader.Read(tilesSize);
+	const uint8_t* encodedTiles = reader.Skip(tilesSize);
+	if (!encodedTiles) return corrupted();
+
+	state.tiles.resize(tileCount);
+	BinaryReader tilesReader(encodedTiles, tilesSize);
+	if (!tilesReader.ReadRle(state.tiles.data(), tileCount) || tilesReader.GetRemaining() != 0) return corrupted();
+	for (int i = 0; i < tileCount; i++) {
+		if (state.tiles[i] >= layout.buildingTypes) return corrupted();
+	}
+
+	state.positions.resize(layout.buildingTypes);
+	for (int type = 1; type < layout.buildingTypes; type++) {
+		uint32_t count = 0;
+		if (!reader.Read(count) || count > (uint32_t)tileCount) return corrupted();
+		state.positions[type].resize(count);
+		if (!reader.ReadBytes(state.positions[type].data(), count * sizeof(CityPosition))) return corrupted();
+	}
+
+	std::vector<uint64_t> checksums(chunkCount);
+	if (!reader.ReadBytes(checksums.data(), chunkCount * sizeof(uint64_t)) || reader.GetRemaining() != 0) return corrupted();
+
+	// The region files are opened here : the jobs below only read them
+	RegionSet regions(GetChunksDirectory(path, header.generation), false);
+	std::vector<RegionFile*> chunkRegions(chunkCount);
+	std::vector<int> chunkX(chunkCount), chunkZ(chunkCount);
+	for (int idx = 0; idx < chunkCount; idx++) {
+		chunkRegions[idx] = GetRegion(regions, layout, idx, false, chunkX[idx], chunkZ[idx]);
+		if (!chunkRegions[idx] || !chunkRegions[idx]->Has(chunkX[idx], chunkZ[idx])) {
+			error = "The chunks of the save are missing";
+			return false;
+		}
+	}
+
+	// Chunks are independent : they are read and decoded in parallel. A blob from another save doesn't match its checksum.
+	state.blocks.resize((size_t)chunkCount * chunkBlocks);
+	state.states.resize(chunkCount);
+	std::atomic<bool> chunksValid = true;
+	JobSystem::Get()->ParallelFor(chunkCount, 1, [&](int begin, int end) {
+		std::vector<uint8_t> blob;
+		for (int idx = begin; idx < end; idx++) {
+			if (!chunkRegions[idx]->Read(chunkX[idx], chunkZ[idx], blob) || Fnv1a64(blob.data(), blob.size()) != checksums[idx]) {
+				chunksValid = false;
+				continue;
+			}
+			BinaryReader chunkReader(blob.data(), blob.size());
+			BlockId* blocks = &state.blocks[(size_t)idx * chunkBlocks];
+			if (!chunkReader.ReadBytes(blocks, chunkBlocks) || !ReadBlockStates(chunkReader, blocks, chunkBlocks, state.states[idx]) ||
+				chunkReader.GetRemaining() != 0) {
+				chunksValid = false;
+			}
+		}
+	});
+	if (!chunksValid) return corrupted();
+
+	error.clear();
+	return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Minicraft/Block.h"
+
+/// <summary>
+/// The sizes a city file is made for. A file made for other sizes is rejected.
+/// </summary>
+struct CityLayout {
+	// Chunks along X and Z, and along Y
+	int worldSize;
+	int worldHeight;
+	// Blocks along each side of a chunk
+	int chunkSize;
+	// Building types, NOTHING included (see Building)
+	int buildingTypes;
+
+	int GetChunkCount() const { return worldSize * worldSize * worldHeight; }
+	int GetChunkBlocks() const { return chunkSize * chunkSize * chunkSize; }
+	// Tiles of the map, along X then Z
+	int GetTileCount() const { return worldSize * chunkSize * worldSize * chunkSize; }
+};
+
+// A position of a building, or of the player
+struct CityPosition {
+	float x;
+	float y;
+	float z;
+};
+
+/// <summary>
+/// Everything a save holds, outside of the world
+/// </summary>
+struct CityState {
+	// The blocks of every chunk, chunk after chunk
+	std::vector<BlockId> blocks;
+	// The block states of every chunk
+	std::vector<std::vector<BlockStateEntry>> states;
+	// The building of every tile
+	std::vector<uint8_t> tiles;
+	// The positions of the buildings of every type (none for NOTHING)
+	std::vector<std::vector<CityPosition>> positions;
+
+	int energyGain = 0;
+	int waterGain = 0;
+	int passiveIncome = 0;
+
+	CityPosition playerPosition = {};
+	float playerYaw = 0;
+	int money = 0;
+	float incomeCooldown = 0;
+};
+
+/// <summary>
+/// Writes and reads the files of the saves, without the world : see CitySave for the saves of the game.
+/// The file is versioned and checksummed. The chunks are in region files next to it (see RegionFile), each checked against
+/// its checksum in the file, and read and decoded in parallel.
+/// Every save writes its chunks to a new directory, and deletes the previous one once the file is replaced : a save that fails
+/// or doesn't finish leaves the previous one whole.
+/// </summary>
+class CityFile {
+public:
+	/// <summary>
+	/// Writes a city
+	/// </summary>
+	/// <param name="path">The file's path</param>
+	/// <param name="layout">The sizes of the world</param>
+	/// <param name="state">The city, with the sizes of the layout</param>
+	/// <returns>True if the city was written</returns>
+	static bool Write(const std::wstring& path, const CityLayout& layout, const CityState& state);
+
+	/// <summary>
+	/// Reads a city, and checks it
+	/// </summary>
+	/// <param name="path">The file's path</param>
+	/// <param name="layout">The sizes of the world</param>
+	/// <param name="state">The city</param>
+	/// <param name="error">Why the file couldn't be read</param>
+	/// <returns>True if the city was read</returns>
+	static bool Read(const std::wstring& path, const CityLayout& layout, CityState& state, std::string& error);
+
+	// Gets the directory of the region files holding the chunks of a generation of a save
+	static std::wstring GetChunksDirectory(const std::wstring& path, uint32_t generation);
+};
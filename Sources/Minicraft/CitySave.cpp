@@ -0,0 +1,98 @@
+#include "pch.h"
+
+#include "CitySave.h"
+#include "World.h"
+#include "Chunk.h"
+#include "Player.h"
+
+static constexpr int CHUNK_COUNT = WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT;
+static constexpr int CHUNK_BLOCKS = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+static constexpr int TILE_COUNT = WORLD_SIZE * CHUNK_SIZE * WORLD_SIZE * CHUNK_SIZE;
+
+// The positions of the game and of the files are both 3 floats
+static_assert(sizeof(Vector3) == sizeof(CityPosition), "The positions are copied as they are");
+
+CityLayout CitySave::GetLayout() {
+	return { WORLD_SIZE, WORLD_HEIGHT, CHUNK_SIZE, ROAD + 1 };
+}
+
+std::wstring CitySave::GetPath(const std::wstring& name) {
+	return L"Saves/" + name + L".city";
+}
+
+bool CitySave::Save(const std::wstring& path, World& world, const Player& player) {
+	CityState state;
+	state.blocks.resize((size_t)CHUNK_COUNT * CHUNK_BLOCKS);
+	state.states.resize(CHUNK_COUNT);
+	for (int idx = 0; idx < CHUNK_COUNT; idx++) {
+		const Chunk* chunk = world.LoadChunk(idx);
+		memcpy(&state.blocks[(size_t)idx * CHUNK_BLOCKS], chunk->data, CHUNK_BLOCKS);
+		state.states[idx] = chunk->states;
+	}
+
+	state.tiles.resize(TILE_COUNT);
+	for (int i = 0; i < TILE_COUNT; i++) state.tiles[i] = (uint8_t)world.buildings[i];
+	state.positions.resize(ROAD + 1);
+	for (int type = TREE; type <= ROAD; type++) {
+		const std::vector<Vector3>* positions = world.buildingsPositions.at((Building)type).positions;
+		state.positions[type].resize(positions->size());
+		memcpy(state.positions[type].data(), positions->data(), positions->size() * sizeof(Vector3));
+	}
+
+	state.energyGain = world.energyGain;
+	state.waterGain = world.waterGain;
+	state.passiveIncome = world.passiveIncome;
+
+	state.playerPosition = { player.position.x, player.position.y, player.position.z };
+	state.playerYaw = player.currentYaw;
+	state.money = player.money;
+	state.incomeCooldown = player.passiveIncomeCooldown;
+	return CityFile::Write(path, GetLayout(), state);
+}
+
+bool CitySave::Load(const std::wstring& path, World& world, Player& player, std::string& error) {
+	// Everything is read and checked before touching the world
+	CityState state;
+	if (!CityFile::Read(path, GetLayout(), state, error)) return false;
+	Apply(std::move(state), world, player);
+	return true;
+}
+
+void CitySave::Apply(CityState&& state, World& world, Player& player) {
+	for (int idx = 0; idx < CHUNK_COUNT; idx++) {
+		// The evicted chunks get their blocks back : the saved ones replace them
+		if (!world.chunks[idx]->IsLoaded()) world.chunks[idx]->AllocateBlocks();
+		memcpy(world.chunks[idx]->data, &state.blocks[(size_t)idx * CHUNK_BLOCKS], CHUNK_BLOCKS);
+		world.chunks[idx]->states = std::move(state.states[idx]);
+		world.chunks[idx]->MarkDirty();
+		world.chunks[idx]->needSave = true;
+	}
+	for (int i = 0; i < TILE_COUNT; i++) world.buildings[i] = (Building)state.tiles[i];
+	for (int type = TREE; type <= ROAD; type++) {
+		std::vector<Vector3>* positions = world.buildingsPositions[(Building)type].positions;
+		positions->resize(state.positions[type].size());
+		memcpy(positions->data(), state.positions[type].data(), positions->size() * sizeof(Vector3));
+	}
+	world.MarkBuildingPagesDirty();
+	world.placementMask.Invalidate();
+	// The flowing water is saved as water blocks : it becomes sources
+	world.water.Reset();
+	world.energyGain = state.energyGain;
+	world.waterGain = state.waterGain;
+	world.passiveIncome = state.passiveIncome;
+	// The terrain doesn't come from a height field anymore
+	world.terrainVersion = 0;
+
+	world.Create(world.deviceRes);
+	for (int type = TREE; type <= ROAD; type++) {
+		world.RegenerateBufferFor((Building)type);
+	}
+
+	player.position = Vector3(state.playerPosition.x, state.playerPosition.y, state.playerPosition.z);
+	player.currentYaw = state.playerYaw;
+	player.money = state.money;
+	player.passiveIncomeCooldown = state.incomeCooldown;
+	// The journal's changes don't apply to the loaded city
+	player.journal.Clear();
+	player.camera.SetRotation(Quaternion::CreateFromYawPitchRoll(state.playerYaw, -45, 0));
+}
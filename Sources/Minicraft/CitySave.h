@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Minicraft/CityFile.h"
+
+class World;
+class Player;
+
+/// <summary>
+/// Saves and loads a whole city : the blocks, the buildings, the economy and the player.
+/// The files are written and read by CityFile, this takes the city from the world and gives it back.
+/// </summary>
+class CitySave {
+public:
+	/// <summary>
+	/// Saves the city
+	/// </summary>
+	/// <param name="path">The save's path</param>
+	/// <param name="world">The world (its evicted chunks are loaded)</param>
+	/// <param name="player">The player</param>
+	/// <returns>True if the city was saved</returns>
+	static bool Save(const std::wstring& path, World& world, const Player& player);
+
+	/// <summary>
+	/// Loads a city
+	/// </summary>
+	/// <param name="path">The save's path</param>
+	/// <param name="world">The world</param>
+	/// <param name="player">The player</param>
+	/// <param name="error">Why the save couldn't be loaded</param>
+	/// <returns>True if the city was loaded. If it wasn't, the world and the player are unchanged.</returns>
+	static bool Load(const std::wstring& path, World& world, Player& player, std::string& error);
+
+	/// <summary>
+	/// Replaces the city with a loaded state
+	/// </summary>
+	/// <param name="state">The state, checked beforehand</param>
+	/// <param name="world">The world</param>
+	/// <param name="player">The player</param>
+	static void Apply(CityState&& state, World& world, Player& player);
+
+	// Gets the sizes of the game's world, the saves are made for
+	static CityLayout GetLayout();
+
+	// Gets the path of a save
+	static std::wstring GetPath(const std::wstring& name);
+};
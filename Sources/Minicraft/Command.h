@@ -0,0 +1,116 @@
+#pragma once
+
+using namespace DirectX::SimpleMath;
+
+/// <summary>
+/// The actions that change the state of the game
+/// </summary>
+enum CommandType : uint8_t {
+	// Generates a map from a seed (x = seed, value = tree threshold)
+	CMD_GENERATE_SEED,
+	// Generates a map from a file (name = map, value = tree threshold)
+	CMD_GENERATE_FILE,
+	// Selects a tool of the player (x = tool index)
+	CMD_SELECT_TOOL,
+	// Uses the current tool on a cube : builds on it or destroys the building above it (x, y, z = cube)
+	CMD_USE_TOOL,
+	// Moves the camera (position, value = yaw). Doesn't change the city, only recorded for the replays' camera path.
+	CMD_CAMERA,
+	// Undoes the last operation of the player
+	CMD_UNDO,
+	// Redoes the last undone operation of the player
+	CMD_REDO,
+	// Uses the current tool on an area dragged between two tiles (x, z = start, endX, endZ = end) :
+	// a path for the roads, a rectangle for the other buildings and the destruction
+	CMD_USE_TOOL_AREA,
+	// Sculpts the terrain in a circle (x, z = center, y = height to flatten to, endX = radius, endZ = brush)
+	CMD_SCULPT,
+	// Sets the state of a block with BF_ORIENTED (x, y, z = block, endX = BlockState bits)
+	CMD_SET_BLOCK_STATE,
+};
+
+/// <summary>
+/// An action that changes the state of the game. Every change goes through a command, so that sessions can be replayed.
+/// </summary>
+struct Command {
+	CommandType type;
+	int x = 0;
+	int y = 0;
+	int z = 0;
+	int endX = 0;
+	int endZ = 0;
+	float value = 0;
+	Vector3 position;
+	std::string name;
+
+	static Command GenerateSeed(int seed, float treeThreshold) {
+		Command command = { CMD_GENERATE_SEED };
+		command.x = seed;
+		command.value = treeThreshold;
+		return command;
+	}
+
+	static Command GenerateFile(const std::string& map, float treeThreshold) {
+		Command command = { CMD_GENERATE_FILE };
+		command.name = map;
+		command.value = treeThreshold;
+		return command;
+	}
+
+	static Command SelectTool(int tool) {
+		Command command = { CMD_SELECT_TOOL };
+		command.x = tool;
+		return command;
+	}
+
+	static Command UseTool(int x, int y, int z) {
+		Command command = { CMD_USE_TOOL };
+		command.x = x;
+		command.y = y;
+		command.z = z;
+		return command;
+	}
+
+	static Command UseToolArea(int x, int z, int endX, int endZ) {
+		Command command = { CMD_USE_TOOL_AREA };
+		command.x = x;
+		command.z = z;
+		command.endX = endX;
+		command.endZ = endZ;
+		return command;
+	}
+
+	static Command Sculpt(int brush, int x, int z, int radius, int height) {
+		Command command = { CMD_SCULPT };
+		command.x = x;
+		command.y = height;
+		command.z = z;
+		command.endX = radius;
+		command.endZ = brush;
+		return command;
+	}
+
+	static Command SetBlockState(int x, int y, int z, int state) {
+		Command command = { CMD_SET_BLOCK_STATE };
+		command.x = x;
+		command.y = y;
+		command.z = z;
+		command.endX = state;
+		return command;
+	}
+
+	static Command Undo() {
+		return { CMD_UNDO };
+	}
+
+	static Command Redo() {
+		return { CMD_REDO };
+	}
+
+	static Command Camera(Vector3 position, float yaw) {
+		Command command = { CMD_CAMERA };
+		command.position = position;
+		command.value = yaw;
+		return command;
+	}
+};
@@ -0,0 +1,77 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "MeshCache.h"
+#include "World.h"
+#include "Chunk.h"
+
+// To increment whenever the meshing changes : the same blocks would give another mesh
+static constexpr uint32_t MESH_VERSION = 1;
+
+uint64_t MeshCache::GetKey(const Chunk& chunk) {
+	return Fnv1a64(&MESH_VERSION, sizeof(MESH_VERSION), chunk.GetMeshHash());
+}
+
+bool MeshCache::Load(int idx, uint64_t key, Chunk& chunk) {
+	auto it = entries.find(key);
+	if (it != entries.end()) {
+		BinaryReader reader(it->second.mesh.data(), it->second.mesh.size());
+		if (chunk.ReadMesh(reader) && reader.GetRemaining() == 0) {
+			it->second.lastUsed = ++useCounter;
+			memoryHits++;
+			return true;
+		}
+	}
+
+	// The region file only has the chunk's last mesh : it is used if it was made for the same key
+	int x, z;
+	RegionFile* region = GetRegion(idx, false, x, z);
+	std::vector<uint8_t> blob;
+	uint64_t savedKey = 0;
+	if (region && region->Read(x, z, blob) && blob.size() >= sizeof(savedKey)) {
+		memcpy(&savedKey, blob.data(), sizeof(savedKey));
+		BinaryReader reader(blob.data() + sizeof(savedKey), blob.size() - sizeof(savedKey));
+		if (savedKey == key && chunk.ReadMesh(reader) && reader.GetRemaining() == 0) {
+			Insert(key, blob.data() + sizeof(savedKey), blob.size() - sizeof(savedKey));
+			diskHits++;
+			return true;
+		}
+	}
+
+	misses++;
+	return false;
+}
+
+void MeshCache::Store(int idx, uint64_t key, const Chunk& chunk) {
+	BinaryWriter writer;
+	writer.Write(key);
+	chunk.WriteMesh(writer);
+	Insert(key, writer.GetData() + sizeof(key), writer.GetSize() - sizeof(key));
+
+	// The vertices are floats : the run-length encoding wouldn't make them smaller
+	int x, z;
+	RegionFile* region = GetRegion(idx, true, x, z);
+	if (region) region->Write(x, z, writer.GetData(), writer.GetSize(), false);
+}
+
+void MeshCache::Insert(uint64_t key, const uint8_t* mesh, size_t size) {
+	Entry& entry = entries[key];
+	memory -= entry.mesh.size();
+	entry.mesh.assign(mesh, mesh + size);
+	entry.lastUsed = ++useCounter;
+	memory += size;
+
+	// The cache holds a few hundred meshes : the oldest one is looked for in all of them
+	while (memory > budget && entries.size() > 1) {
+		auto oldest = entries.end();
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			if (oldest == entries.end() || it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+		}
+		memory -= oldest->second.mesh.size();
+		entries.erase(oldest);
+	}
+}
+
+RegionFile* MeshCache::GetRegion(int idx, bool create, int& x, int& z) {
+	return regions.Get(idx % WORLD_SIZE, (idx / WORLD_SIZE) % WORLD_HEIGHT, idx / (WORLD_SIZE * WORLD_HEIGHT), create, x, z);
+}
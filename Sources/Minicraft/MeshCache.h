@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Engine/RegionSet.h"
+
+class Chunk;
+
+/// <summary>
+/// Keeps the full meshes of the chunks under a hash of what they are made from (see Chunk::GetMeshHash), so that a chunk
+/// with the same blocks and light as before (the same map loaded again, a chunk brought back by the streaming) isn't meshed again.
+/// The meshes are kept in memory, the least recently used ones dropped past a budget, and on the disk : the last mesh of every chunk
+/// is in a region file, which lasts between sessions.
+/// </summary>
+class MeshCache {
+	struct Entry {
+		// The mesh, as written by Chunk::WriteMesh
+		std::vector<uint8_t> mesh;
+		uint64_t lastUsed = 0;
+	};
+
+	bool enabled = true;
+	// Memory the meshes in memory can take, in bytes
+	size_t budget = 64u << 20;
+
+	std::map<uint64_t, Entry> entries;
+	size_t memory = 0;
+	uint64_t useCounter = 0;
+	// The last mesh of every chunk, after the key it was made for
+	RegionSet regions{ L"Cache/Meshes", false };
+
+	// Stats
+	size_t memoryHits = 0;
+	size_t diskHits = 0;
+	size_t misses = 0;
+
+public:
+	/// <summary>
+	/// Gets the key of a chunk's full mesh. Hashing the chunk costs a fraction of meshing it.
+	/// </summary>
+	/// <param name="chunk">The chunk</param>
+	/// <returns>The key</returns>
+	static uint64_t GetKey(const Chunk& chunk);
+
+	/// <summary>
+	/// Gives a chunk its cached mesh, from the memory or the disk, without uploading it
+	/// </summary>
+	/// <param name="idx">The chunk's index</param>
+	/// <param name="key">The chunk's key</param>
+	/// <param name="chunk">The chunk</param>
+	/// <returns>False if no mesh was cached under the key : the chunk must be meshed</returns>
+	bool Load(int idx, uint64_t key, Chunk& chunk);
+
+	/// <summary>
+	/// Caches the full mesh a chunk was just given, in memory and on the disk
+	/// </summary>
+	/// <param name="idx">The chunk's index</param>
+	/// <param name="key">The chunk's key</param>
+	/// <param name="chunk">The chunk</param>
+	void Store(int idx, uint64_t key, const Chunk& chunk);
+
+	// Enables or disables the cache. The cached meshes are kept.
+	void SetEnabled(bool enabled) { this->enabled = enabled; }
+	bool IsEnabled() const { return enabled; }
+
+	// Gets the memory taken by the meshes in memory, in bytes
+	size_t GetMemory() const { return memory; }
+
+	// Gets the number of meshes found in memory, found on the disk, and not found since the start
+	size_t GetMemoryHits() const { return memoryHits; }
+	size_t GetDiskHits() const { return diskHits; }
+	size_t GetMisses() const { return misses; }
+
+private:
+	// Keeps a mesh in memory, and drops the least recently used ones past the budget
+	void Insert(uint64_t key, const uint8_t* mesh, size_t size);
+
+	// Gets the region file holding a chunk, and the chunk's coordinates in it
+	RegionFile* GetRegion(int idx, bool create, int& x, int& z);
+};
@@ -0,0 +1,78 @@
+#include "pch.h"
+
+#include "Engine/JobSystem.h"
+#include "NoiseField.h"
+#include "PerlinBatch.h"
+
+const NoiseField& NoiseFieldCache::Get(const NoiseFieldKey& key) {
+	for (size_t i = 0; i < fields.size(); i++) {
+		if (fields[i]->key == key) {
+			// Move it to the front
+			std::rotate(fields.begin(), fields.begin() + i, fields.begin() + i + 1);
+			return *fields[0];
+		}
+	}
+
+	// Reuse the least recently used field when the cache is full
+	std::unique_ptr<NoiseField> field;
+	if (fields.size() >= capacity && !fields.empty()) {
+		field = std::move(fields.back());
+		fields.pop_back();
+	}
+	else {
+		field = std::make_unique<NoiseField>();
+	}
+
+	field->key = key;
+	field->version = nextVersion++;
+	Sample(*field);
+
+	fields.insert(fields.begin(), std::move(field));
+	return *fields[0];
+}
+
+void NoiseFieldCache::Sample(NoiseField& field) {
+	const NoiseFieldKey& key = field.key;
+	field.values.resize((size_t)key.width * key.height);
+
+	siv::BasicPerlinNoise<float> perlin(key.seed);
+	PerlinBatch perlinBatch(perlin);
+
+	float maxAmplitude = 0;
+	float amplitude = 1;
+	for (int octave = 0; octave < key.octaves; octave++) {
+		maxAmplitude += amplitude;
+		amplitude *= key.persistence;
+	}
+
+	// With one octave, a value is exactly (noise2D(x / scale * frequency, z / scale * frequency) + 1) / 2
+	JobSystem::Get()->ParallelFor(key.height, 8, [&](int begin, int end) {
+		std::vector<float> xs(key.width);
+		std::vector<float> octaveValues(key.width);
+		std::vector<float> total(key.width);
+
+		for (int z = begin; z < end; z++) {
+			for (int x = 0; x < key.width; x++) {
+				xs[x] = x / key.scale * key.frequency;
+				total[x] = 0;
+			}
+			float y = z / key.scale * key.frequency;
+
+			float octaveAmplitude = 1;
+			for (int octave = 0; octave < key.octaves; octave++) {
+				perlinBatch.Noise2DRow(xs.data(), y, octaveValues.data(), key.width);
+				for (int x = 0; x < key.width; x++) {
+					total[x] += octaveValues[x] * octaveAmplitude;
+					xs[x] *= 2;
+				}
+				y *= 2;
+				octaveAmplitude *= key.persistence;
+			}
+
+			float* row = &field.values[(size_t)z * key.width];
+			for (int x = 0; x < key.width; x++) {
+				row[x] = (total[x] / maxAmplitude + 1) / 2;
+			}
+		}
+	});
+}
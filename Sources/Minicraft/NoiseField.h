@@ -0,0 +1,71 @@
+#pragma once
+
+/// <summary>
+/// Settings of a noise field. Fields sampled with the same settings hold the same values.
+/// </summary>
+struct NoiseFieldKey {
+	int seed;
+	// Number of tiles for a unit of noise
+	float scale;
+	// Multiplier applied to the coordinates
+	float frequency;
+	int octaves;
+	// Amplitude multiplier between two octaves
+	float persistence;
+
+	int width;
+	int height;
+
+	bool operator==(const NoiseFieldKey& other) const {
+		return seed == other.seed && scale == other.scale && frequency == other.frequency &&
+			octaves == other.octaves && persistence == other.persistence &&
+			width == other.width && height == other.height;
+	}
+};
+
+/// <summary>
+/// A 2D grid of noise values, remapped to [0, 1]
+/// </summary>
+struct NoiseField {
+	NoiseFieldKey key;
+	// Unique for every sampled field, can be used to know if something built from a field is outdated
+	uint32_t version;
+	std::vector<float> values;
+
+	// Gets the value of a tile
+	float Get(int x, int z) const { return values[x + z * key.width]; }
+};
+
+/// <summary>
+/// Keeps the last sampled noise fields (height, tree density, ...),
+/// so that a field is only sampled again when its settings change
+/// </summary>
+class NoiseFieldCache {
+	// Most recently used first
+	std::vector<std::unique_ptr<NoiseField>> fields;
+	size_t capacity;
+	uint32_t nextVersion = 1;
+public:
+	/// <summary>
+	/// Creates the cache
+	/// </summary>
+	/// <param name="capacity">The maximum number of fields kept</param>
+	NoiseFieldCache(size_t capacity = 4) : capacity(capacity) {}
+
+	/// <summary>
+	/// Gets a noise field, sampling it if it isn't in the cache
+	/// </summary>
+	/// <param name="key">The field's settings</param>
+	/// <returns>The field. It stays valid as long as less than 'capacity' other fields are requested.</returns>
+	const NoiseField& Get(const NoiseFieldKey& key);
+
+	// Empties the cache
+	void Clear() { fields.clear(); }
+
+private:
+	/// <summary>
+	/// Samples a field on the job system
+	/// </summary>
+	/// <param name="field">The field, with its key set</param>
+	void Sample(NoiseField& field);
+};
@@ -0,0 +1,251 @@
+#include "pch.h"
+
+#include "PerlinBatch.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Checks if the CPU and the OS support AVX2
+static bool CpuHasAvx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	// The OS must save the YMM registers
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	// Checks the OS support of the YMM registers too
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+PerlinBatch::PerlinBatch(const siv::BasicPerlinNoise<float>& noise) : scalarNoise(noise) {
+	const auto& state = noise.serialize();
+	for (int i = 0; i < 512; i++) {
+		perm[i] = state[i & 255];
+	}
+
+	// Same computations as noise3D for the constant Z of noise2D
+	const float z = static_cast<float>(SIVPERLIN_DEFAULT_Z);
+	const float _z = std::floor(z);
+	iz = static_cast<int32_t>(_z) & 255;
+	fz = z - _z;
+	fadeZ = fz * fz * fz * (fz * (fz * 6 - 15) + 10);
+
+	useAvx2 = CpuHasAvx2();
+}
+
+void PerlinBatch::Noise2D(const float* xs, const float* ys, float* out, int count) const {
+	int i = useAvx2 ? Noise2DAvx2(xs, ys, out, count) : 0;
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(out + i, Noise4(_mm_loadu_ps(xs + i), _mm_loadu_ps(ys + i)));
+	}
+	for (; i < count; i++) {
+		out[i] = scalarNoise.noise2D(xs[i], ys[i]);
+	}
+}
+
+void PerlinBatch::Noise2DRow(const float* xs, float y, float* out, int count) const {
+	int i = useAvx2 ? Noise2DRowAvx2(xs, y, out, count) : 0;
+	__m128 yv = _mm_set1_ps(y);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(out + i, Noise4(_mm_loadu_ps(xs + i), yv));
+	}
+	for (; i < count; i++) {
+		out[i] = scalarNoise.noise2D(xs[i], y);
+	}
+}
+
+#pragma region SSE2
+
+// t * t * t * (t * (t * 6 - 15) + 10)
+static inline __m128 Fade4(__m128 t) {
+	__m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6)), _mm_set1_ps(15))), _mm_set1_ps(10));
+	return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+// a + (b - a) * t
+static inline __m128 Lerp4(__m128 a, __m128 b, __m128 t) {
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// mask ? a : b
+static inline __m128 Select4(__m128i mask, __m128 a, __m128 b) {
+	__m128 m = _mm_castsi128_ps(mask);
+	return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+// Same branches as perlin_detail::Grad, turned into selects. Negation flips the sign bit.
+static inline __m128 Grad4(__m128i hash, __m128 x, __m128 y, __m128 z) {
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+
+	__m128 u = Select4(_mm_cmplt_epi32(h, _mm_set1_epi32(8)), x, y);
+	__m128i xForV = _mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14)));
+	__m128 v = Select4(_mm_cmplt_epi32(h, _mm_set1_epi32(4)), y, Select4(xForV, x, z));
+
+	__m128 signU = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+	__m128 signV = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+	return _mm_add_ps(_mm_xor_ps(u, signU), _mm_xor_ps(v, signV));
+}
+
+__m128 PerlinBatch::Noise4(__m128 x, __m128 y) const {
+	// Floor (SSE2 has no floor instruction : truncate, then fix the negative values)
+	__m128 one = _mm_set1_ps(1);
+	__m128 tx = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	__m128 ty = _mm_cvtepi32_ps(_mm_cvttps_epi32(y));
+	__m128 floorX = _mm_sub_ps(tx, _mm_and_ps(_mm_cmpgt_ps(tx, x), one));
+	__m128 floorY = _mm_sub_ps(ty, _mm_and_ps(_mm_cmpgt_ps(ty, y), one));
+
+	alignas(16) int32_t ix[4], iy[4];
+	_mm_store_si128((__m128i*)ix, _mm_and_si128(_mm_cvttps_epi32(floorX), _mm_set1_epi32(255)));
+	_mm_store_si128((__m128i*)iy, _mm_and_si128(_mm_cvttps_epi32(floorY), _mm_set1_epi32(255)));
+
+	__m128 fx = _mm_sub_ps(x, floorX);
+	__m128 fy = _mm_sub_ps(y, floorY);
+	__m128 u = Fade4(fx);
+	__m128 v = Fade4(fy);
+
+	// Hashes (the permutation lookups can't be vectorized with SSE2)
+	alignas(16) int32_t hashes[8][4];
+	for (int lane = 0; lane < 4; lane++) {
+		int32_t A = (perm[ix[lane]] + iy[lane]) & 255;
+		int32_t B = (perm[ix[lane] + 1] + iy[lane]) & 255;
+		int32_t AA = (perm[A] + iz) & 255;
+		int32_t AB = (perm[A + 1] + iz) & 255;
+		int32_t BA = (perm[B] + iz) & 255;
+		int32_t BB = (perm[B + 1] + iz) & 255;
+
+		hashes[0][lane] = perm[AA];
+		hashes[1][lane] = perm[BA];
+		hashes[2][lane] = perm[AB];
+		hashes[3][lane] = perm[BB];
+		hashes[4][lane] = perm[AA + 1];
+		hashes[5][lane] = perm[BA + 1];
+		hashes[6][lane] = perm[AB + 1];
+		hashes[7][lane] = perm[BB + 1];
+	}
+
+	__m128 fx1 = _mm_sub_ps(fx, one);
+	__m128 fy1 = _mm_sub_ps(fy, one);
+	__m128 z0 = _mm_set1_ps(fz);
+	__m128 z1 = _mm_set1_ps(fz - 1);
+
+	__m128 p0 = Grad4(_mm_load_si128((__m128i*)hashes[0]), fx, fy, z0);
+	__m128 p1 = Grad4(_mm_load_si128((__m128i*)hashes[1]), fx1, fy, z0);
+	__m128 p2 = Grad4(_mm_load_si128((__m128i*)hashes[2]), fx, fy1, z0);
+	__m128 p3 = Grad4(_mm_load_si128((__m128i*)hashes[3]), fx1, fy1, z0);
+	__m128 p4 = Grad4(_mm_load_si128((__m128i*)hashes[4]), fx, fy, z1);
+	__m128 p5 = Grad4(_mm_load_si128((__m128i*)hashes[5]), fx1, fy, z1);
+	__m128 p6 = Grad4(_mm_load_si128((__m128i*)hashes[6]), fx, fy1, z1);
+	__m128 p7 = Grad4(_mm_load_si128((__m128i*)hashes[7]), fx1, fy1, z1);
+
+	__m128 q0 = Lerp4(p0, p1, u);
+	__m128 q1 = Lerp4(p2, p3, u);
+	__m128 q2 = Lerp4(p4, p5, u);
+	__m128 q3 = Lerp4(p6, p7, u);
+
+	__m128 r0 = Lerp4(q0, q1, v);
+	__m128 r1 = Lerp4(q2, q3, v);
+
+	return Lerp4(r0, r1, _mm_set1_ps(fadeZ));
+}
+
+#pragma endregion
+
+#pragma region AVX2
+
+PERLIN_AVX2 static inline __m256 Fade8(__m256 t) {
+	__m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6)), _mm256_set1_ps(15))), _mm256_set1_ps(10));
+	return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+PERLIN_AVX2 static inline __m256 Lerp8(__m256 a, __m256 b, __m256 t) {
+	return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+PERLIN_AVX2 static inline __m256 Grad8(__m256i hash, __m256 x, __m256 y, __m256 z) {
+	__m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+
+	__m256 u = _mm256_blendv_ps(y, x, _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h)));
+	__m256i xForV = _mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)), _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14)));
+	__m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, _mm256_castsi256_ps(xForV)), y, _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h)));
+
+	__m256 signU = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31));
+	__m256 signV = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+	return _mm256_add_ps(_mm256_xor_ps(u, signU), _mm256_xor_ps(v, signV));
+}
+
+int PerlinBatch::Noise2DAvx2(const float* xs, const float* ys, float* out, int count) const {
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(out + i, Noise8(_mm256_loadu_ps(xs + i), _mm256_loadu_ps(ys + i)));
+	}
+	return i;
+}
+
+int PerlinBatch::Noise2DRowAvx2(const float* xs, float y, float* out, int count) const {
+	__m256 yv = _mm256_set1_ps(y);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(out + i, Noise8(_mm256_loadu_ps(xs + i), yv));
+	}
+	return i;
+}
+
+__m256 PerlinBatch::Noise8(__m256 x, __m256 y) const {
+	__m256 floorX = _mm256_floor_ps(x);
+	__m256 floorY = _mm256_floor_ps(y);
+
+	__m256i mask = _mm256_set1_epi32(255);
+	__m256i one = _mm256_set1_epi32(1);
+	__m256i izv = _mm256_set1_epi32(iz);
+	__m256i ix = _mm256_and_si256(_mm256_cvttps_epi32(floorX), mask);
+	__m256i iy = _mm256_and_si256(_mm256_cvttps_epi32(floorY), mask);
+
+	__m256 fx = _mm256_sub_ps(x, floorX);
+	__m256 fy = _mm256_sub_ps(y, floorY);
+	__m256 u = Fade8(fx);
+	__m256 v = Fade8(fy);
+
+	// Hashes, with gathers in the permutation
+	__m256i A = _mm256_and_si256(_mm256_add_epi32(_mm256_i32gather_epi32(perm, ix, 4), iy), mask);
+	__m256i B = _mm256_and_si256(_mm256_add_epi32(_mm256_i32gather_epi32(perm, _mm256_add_epi32(ix, one), 4), iy), mask);
+	__m256i AA = _mm256_and_si256(_mm256_add_epi32(_mm256_i32gather_epi32(perm, A, 4), izv), mask);
+	__m256i AB = _mm256_and_si256(_mm256_add_epi32(_mm256_i32gather_epi32(perm, _mm256_add_epi32(A, one), 4), izv), mask);
+	__m256i BA = _mm256_and_si256(_mm256_add_epi32(_mm256_i32gather_epi32(perm, B, 4), izv), mask);
+	__m256i BB = _mm256_and_si256(_mm256_add_epi32(_mm256_i32gather_epi32(perm, _mm256_add_epi32(B, one), 4), izv), mask);
+
+	__m256 fx1 = _mm256_sub_ps(fx, _mm256_set1_ps(1));
+	__m256 fy1 = _mm256_sub_ps(fy, _mm256_set1_ps(1));
+	__m256 z0 = _mm256_set1_ps(fz);
+	__m256 z1 = _mm256_set1_ps(fz - 1);
+
+	__m256 p0 = Grad8(_mm256_i32gather_epi32(perm, AA, 4), fx, fy, z0);
+	__m256 p1 = Grad8(_mm256_i32gather_epi32(perm, BA, 4), fx1, fy, z0);
+	__m256 p2 = Grad8(_mm256_i32gather_epi32(perm, AB, 4), fx, fy1, z0);
+	__m256 p3 = Grad8(_mm256_i32gather_epi32(perm, BB, 4), fx1, fy1, z0);
+	__m256 p4 = Grad8(_mm256_i32gather_epi32(perm, _mm256_add_epi32(AA, one), 4), fx, fy, z1);
+	__m256 p5 = Grad8(_mm256_i32gather_epi32(perm, _mm256_add_epi32(BA, one), 4), fx1, fy, z1);
+	__m256 p6 = Grad8(_mm256_i32gather_epi32(perm, _mm256_add_epi32(AB, one), 4), fx, fy1, z1);
+	__m256 p7 = Grad8(_mm256_i32gather_epi32(perm, _mm256_add_epi32(BB, one), 4), fx1, fy1, z1);
+
+	__m256 q0 = Lerp8(p0, p1, u);
+	__m256 q1 = Lerp8(p2, p3, u);
+	__m256 q2 = Lerp8(p4, p5, u);
+	__m256 q3 = Lerp8(p6, p7, u);
+
+	__m256 r0 = Lerp8(q0, q1, v);
+	__m256 r1 = Lerp8(q2, q3, v);
+
+	return Lerp8(r0, r1, _mm256_set1_ps(fadeZ));
+}
+
+#pragma endregion
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <immintrin.h>
+#include "PerlinNoise.hpp"
+
+// GCC and Clang only compile the AVX2 intrinsics in the functions built for AVX2. They are only called once the CPU is checked.
+#ifdef _MSC_VER
+#define PERLIN_AVX2
+#else
+#define PERLIN_AVX2 __attribute__((target("avx2")))
+#endif
+
+/// <summary>
+/// Evaluates siv::BasicPerlinNoise&lt;float&gt;::noise2D on batches of points.
+/// Uses AVX2 (8 points at once) when the CPU supports it, SSE2 (4 points at once) otherwise,
+/// and the scalar noise for the remaining points.
+/// Every operation is done in the same order as the scalar noise, so the results are bit-identical.
+/// </summary>
+class PerlinBatch {
+	// The permutation, repeated twice so that p[i + 1] never needs a wrap
+	alignas(32) int32_t perm[512];
+
+	siv::BasicPerlinNoise<float> scalarNoise;
+
+	// noise2D samples the 3D noise at a constant Z
+	float fz;
+	float fadeZ;
+	int32_t iz;
+
+	bool useAvx2;
+public:
+	/// <summary>
+	/// Creates the batch evaluator
+	/// </summary>
+	/// <param name="noise">The noise to evaluate</param>
+	PerlinBatch(const siv::BasicPerlinNoise<float>& noise);
+
+	/// <summary>
+	/// Evaluates the noise on a batch of points : out[i] = noise.noise2D(xs[i], ys[i])
+	/// </summary>
+	/// <param name="xs">The points' X coordinates</param>
+	/// <param name="ys">The points' Y coordinates</param>
+	/// <param name="out">The noise values</param>
+	/// <param name="count">The number of points</param>
+	void Noise2D(const float* xs, const float* ys, float* out, int count) const;
+
+	/// <summary>
+	/// Evaluates the noise on a row of points : out[i] = noise.noise2D(xs[i], y)
+	/// </summary>
+	/// <param name="xs">The points' X coordinates</param>
+	/// <param name="y">The row's Y coordinate</param>
+	/// <param name="out">The noise values</param>
+	/// <param name="count">The number of points</param>
+	void Noise2DRow(const float* xs, float y, float* out, int count) const;
+
+	// Gets the instruction set used by the batches ("AVX2" or "SSE2")
+	const char* GetInstructionSet() const { return useAvx2 ? "AVX2" : "SSE2"; }
+
+	// Uses SSE2 even if the CPU supports AVX2 (to compare the two paths)
+	void DisableAvx2() { useAvx2 = false; }
+
+private:
+	/// <summary>
+	/// Evaluates 4 points with SSE2
+	/// </summary>
+	/// <param name="x">The points' X coordinates</param>
+	/// <param name="y">The points' Y coordinates</param>
+	/// <returns>The noise values</returns>
+	__m128 Noise4(__m128 x, __m128 y) const;
+
+	// Evaluates the first points of a batch or a row 8 at once with AVX2, returns the number of points done (a multiple of 8)
+	PERLIN_AVX2 int Noise2DAvx2(const float* xs, const float* ys, float* out, int count) const;
+	PERLIN_AVX2 int Noise2DRowAvx2(const float* xs, float y, float* out, int count) const;
+
+	/// <summary>
+	/// Evaluates 8 points with AVX2
+	/// </summary>
+	/// <param name="x">The points' X coordinates</param>
+	/// <param name="y">The points' Y coordinates</param>
+	/// <returns>The noise values</returns>
+	PERLIN_AVX2 __m256 Noise8(__m256 x, __m256 y) const;
+};
@@ -0,0 +1,74 @@
+#include "pch.h"
+
+#include "PlacementMask.h"
+#include "World.h"
+#include "Chunk.h"
+
+void PlacementMask::UpdateColumn(World& world, int x, int z) {
+	if (needRebuild) return;
+
+	// The water of a column changes the neighbours' layer too
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	ComputeColumn(world, x, z);
+	if (x > 0) ComputeColumn(world, x - 1, z);
+	if (x < mapSize - 1) ComputeColumn(world, x + 1, z);
+	if (z > 0) ComputeColumn(world, x, z - 1);
+	if (z < mapSize - 1) ComputeColumn(world, x, z + 1);
+	version++;
+}
+
+void PlacementMask::UpdateBuilding(int x, int z, bool hasBuilding) {
+	if (needRebuild) return;
+
+	empty.Set(x, z, !hasBuilding);
+	occupied.Set(x, z, hasBuilding);
+	version++;
+}
+
+const BitGrid& PlacementMask::Get(World& world, PlacementTool tool) {
+	if (needRebuild) Rebuild(world);
+
+	if (toolVersions[tool] != version) {
+		BitGrid& mask = toolMasks[tool];
+		switch (tool) {
+		case PT_BUILD:
+			BitGrid::And(heightValid, empty, mask);
+			break;
+		case PT_WATERPLANT:
+			BitGrid::And(heightValid, empty, mask);
+			BitGrid::And(mask, nearWater, mask);
+			break;
+		case PT_DESTROY:
+			BitGrid::And(heightValid, occupied, mask);
+			break;
+		}
+		toolVersions[tool] = version;
+	}
+	return toolMasks[tool];
+}
+
+void PlacementMask::Rebuild(World& world) {
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	heightValid.Resize(mapSize, mapSize);
+	empty.Resize(mapSize, mapSize);
+	occupied.Resize(mapSize, mapSize);
+	nearWater.Resize(mapSize, mapSize);
+
+	for (int z = 0; z < mapSize; z++) {
+		for (int x = 0; x < mapSize; x++) {
+			ComputeColumn(world, x, z);
+			bool hasBuilding = world.GetBuilding(x, z) != NOTHING;
+			empty.Set(x, z, !hasBuilding);
+			occupied.Set(x, z, hasBuilding);
+		}
+	}
+
+	needRebuild = false;
+	version++;
+}
+
+void PlacementMask::ComputeColumn(World& world, int x, int z) {
+	int y = world.GetSurfaceHeight(x, z);
+	heightValid.Set(x, z, y == 1 || y == 2);
+	nearWater.Set(x, z, y >= 0 && world.IsAdjacentToWater(x, y, z));
+}
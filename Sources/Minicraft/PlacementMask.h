@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Engine/BitGrid.h"
+
+class World;
+
+/// <summary>
+/// The kinds of tools, by the tiles they can be used on
+/// </summary>
+enum PlacementTool {
+	// Empty tiles at the buildings' height
+	PT_BUILD,
+	// Empty tiles at the buildings' height, next to water
+	PT_WATERPLANT,
+	// Tiles with a building, at the buildings' height
+	PT_DESTROY,
+
+	PT_COUNT
+};
+
+/// <summary>
+/// Tells on which tiles each tool can be used, as one bit per tile.
+/// It is built from layers (height, empty tiles, water nearby) kept up to date when the terrain or the buildings change,
+/// and the mask of a tool is the AND of the layers it needs.
+/// </summary>
+class PlacementMask {
+	// Tiles whose top cube is at the buildings' height (1 - 2)
+	BitGrid heightValid;
+	// Tiles without a building
+	BitGrid empty;
+	// Tiles with a building
+	BitGrid occupied;
+	// Tiles next to water (at the height of their top cube)
+	BitGrid nearWater;
+
+	BitGrid toolMasks[PT_COUNT];
+	// Version of the layers, and the version each tool mask was computed from
+	uint32_t version = 1;
+	uint32_t toolVersions[PT_COUNT] = {};
+
+	// The layers must be built again from the whole world
+	bool needRebuild = true;
+public:
+	// The layers will be built again from the whole world before the next use
+	void Invalidate() { needRebuild = true; }
+
+	/// <summary>
+	/// Updates the layers after a change of the blocks of a column (the column and its neighbours)
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="x">The column's X position</param>
+	/// <param name="z">The column's Z position</param>
+	void UpdateColumn(World& world, int x, int z);
+
+	/// <summary>
+	/// Updates the layers after a change of a tile's building
+	/// </summary>
+	/// <param name="x">The tile's X position</param>
+	/// <param name="z">The tile's Z position</param>
+	/// <param name="hasBuilding">True if there is a building on the tile now</param>
+	void UpdateBuilding(int x, int z, bool hasBuilding);
+
+	/// <summary>
+	/// Gets the tiles where a tool can be used
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="tool">The tool</param>
+	/// <returns>The mask, valid until the next change of the world</returns>
+	const BitGrid& Get(World& world, PlacementTool tool);
+
+	// Gets the version of the layers : it changes whenever a mask may have changed
+	uint32_t GetVersion() const { return version; }
+
+private:
+	// Builds the layers from the whole world
+	void Rebuild(World& world);
+
+	// Computes the terrain layers of a column from its blocks
+	void ComputeColumn(World& world, int x, int z);
+};
@@ -2,6 +2,7 @@
 
 #include "Engine/DefaultResources.h"
 #include "Player.h"
+#include "Chunk.h"
 #include "Utils.h"
 #include <Engine/StepTimer.h>
 #include "string"
@@ -9,8 +10,13 @@
 
 using ButtonState = Mouse::ButtonStateTracker::ButtonState;
 
+// Time between two steps of a brush stroke
+static constexpr float STROKE_INTERVAL = 0.1f;
+
 void Player::GenerateGPUResources(DeviceResources* deviceRes) {
 	highlightCube.Generate(deviceRes);
+	placementGhost.Generate(deviceRes);
+	dragGhost.Generate(deviceRes);
 
 	camera.SetRotation(Quaternion::CreateFromYawPitchRoll(currentYaw,-45,0));
 }
@@ -19,12 +25,13 @@ void Player::Update(float dt, DirectX::Keyboard::State kb, DirectX::Mouse::State
 	keyboardTracker.Update(kb);
 	mouseTracker.Update(ms);
 
+	// Undo / redo (Ctrl + Z / Ctrl + Y)
+	if (kb.LeftControl || kb.RightControl) {
+		if (keyboardTracker.pressed.Z) commands.push_back(Command::Undo());
+		else if (keyboardTracker.pressed.Y) commands.push_back(Command::Redo());
 
-	// Add passive income if needed
-	passiveIncomeCooldown -= dt;
-	if (passiveIncomeCooldown <= 0) {
-		passiveIncomeCooldown = 10.0f;
-		money += world->GetPassiveIncome();
+		// The shortcuts don't move the player
+		kb = Keyboard::State();
 	}
 
 	// Movements
@@ -64,57 +71,233 @@ void Player::Update(float dt, DirectX::Keyboard::State kb, DirectX::Mouse::State
 
 
 	// Change current building
-	if (kb.D1) currentBuildingIdx = 0;
-	else if (kb.D2) currentBuildingIdx = 1;
-	else if (kb.D3) currentBuildingIdx = 2;
-	else if (kb.D4) currentBuildingIdx = 3;
-	else if (kb.D5) currentBuildingIdx = 4;
-	else if (kb.D6) currentBuildingIdx = 5;
-	else if (kb.D7) currentBuildingIdx = 6;
+	int tool = currentBuildingIdx;
+	if (kb.D1) tool = 0;
+	else if (kb.D2) tool = 1;
+	else if (kb.D3) tool = 2;
+	else if (kb.D4) tool = 3;
+	else if (kb.D5) tool = 4;
+	else if (kb.D6) tool = 5;
+	else if (kb.D7) tool = 6;
+	if (tool != currentBuildingIdx) {
+		commands.push_back(Command::SelectTool(tool));
+		// Selected right away, so that the next checks use it
+		currentBuildingIdx = tool;
+		brush = -1;
+	}
 
 	// Raycast for a cube to place a building on
+	bool hover = false;
+	int hoverX = 0, hoverY = 0, hoverZ = 0;
+	// First cube hit, at any height (for the brushes)
+	bool terrainHover = false;
+	int terrainX = 0, terrainY = 0, terrainZ = 0;
 	auto cubes = Raycast(camera.GetPosition(), camera.Forward(), 100);
 	for (int i = 0; i < cubes.size(); i++) {
-		BlockId* block = world->GetCube(cubes[i][0], cubes[i][1], cubes[i][2]);
-		if (block == nullptr || cubes[i][1] >= 16 || cubes[i][1] < 0) continue; 
-		BlockData blockData = BlockData::Get(*block);
-		if (blockData.flags & BF_NO_RAYCAST) continue;
+		if (!world->IsSolid(cubes[i][0], cubes[i][1], cubes[i][2])) continue;
 
 		// Cube exists AND its raycastable
 
 		highlightCube.model = Matrix::CreateTranslation(cubes[i][0], cubes[i][1], cubes[i][2]);
+		if (!terrainHover) {
+			terrainHover = true;
+			terrainX = cubes[i][0];
+			terrainY = cubes[i][1];
+			terrainZ = cubes[i][2];
+		}
 
 		if ((cubes[i][1] != 1 && cubes[i][1] != 2)) continue;
 
 		// The cube is a the required height (1 - 2)
+		hover = true;
+		hoverX = cubes[i][0];
+		hoverY = cubes[i][1];
+		hoverZ = cubes[i][2];
+		break;
+	}
 
-		if (mouseTracker.leftButton == ButtonState::PRESSED && money >= prices[currentBuildingIdx]) {
-			// Player wants to place or destroy a building, an he can pay the price
-
-			// Water plant can only be built near water
-			if (possibleBuildings[currentBuildingIdx] == WATERPLANT && !world->IsAdjacentToWater(cubes[i][0], cubes[i][1], cubes[i][2])) continue; 
-			
-			// You can only destroy a building 
-			if (possibleBuildings[currentBuildingIdx] == NOTHING && world->GetBuilding(cubes[i][0], cubes[i][2]) == NOTHING) continue;
+	// Player turns (R) or lights (F) the block looked at, if it has a state (a furnace, a dispenser)
+	if (terrainHover && (keyboardTracker.pressed.R || keyboardTracker.pressed.F)) {
+		BlockId* cube = world->GetCube(terrainX, terrainY, terrainZ);
+		if (cube && BLOCK_REGISTRY.oriented.Has(*cube)) {
+			uint8_t state = world->GetBlockState(terrainX, terrainY, terrainZ);
+			if (keyboardTracker.pressed.R) state = (uint8_t)((state & ~BS_FACING_MASK) | ((state + 1) & BS_FACING_MASK));
+			if (keyboardTracker.pressed.F) state ^= BS_ON;
+			commands.push_back(Command::SetBlockState(terrainX, terrainY, terrainZ, state));
+		}
+	}
 
-			// You need an empty space to build something
-			Building other = world->GetBuilding(cubes[i][0], cubes[i][2]);
-			if (possibleBuildings[currentBuildingIdx] != NOTHING && world->GetBuilding(cubes[i][0], cubes[i][2]) != NOTHING) continue;
+	// Player sculpts the terrain : the brush is applied at a fixed rate while the button is held
+	if (brush >= 0) {
+		dragging = false;
+		dragPreview.clear();
+		if (!terrainHover) return;
 
-			if (possibleBuildings[currentBuildingIdx] != NOTHING) {
-				// Adding a building
-				money -= prices[currentBuildingIdx];
-				world->PlaceBuilding(possibleBuildings[currentBuildingIdx], cubes[i][0], cubes[i][1] + 1, cubes[i][2]);
-			}
-			else {
-				// Remove a building
-				money -= prices[currentBuildingIdx];
-				world->RemoveBuilding(cubes[i][0], cubes[i][1] + 1, cubes[i][2]);
+		if (mouseTracker.leftButton == ButtonState::PRESSED) {
+			strokeHeight = terrainY;
+			strokeCooldown = 0;
+		}
+		if (ms.leftButton) {
+			strokeCooldown -= dt;
+			if (strokeCooldown <= 0) {
+				commands.push_back(Command::Sculpt(brush, terrainX, terrainZ, brushRadius, strokeHeight));
+				strokeCooldown = STROKE_INTERVAL;
 			}
 		}
+		return;
+	}
+
+	// Player wants to place or destroy buildings : he drags from the pressed cube to the released one
+	if (mouseTracker.leftButton == ButtonState::PRESSED && hover) {
+		dragging = true;
+		dragStartX = dragEndX = hoverX;
+		dragStartY = hoverY;
+		dragStartZ = dragEndZ = hoverZ;
+	}
+	if (!dragging) return;
+
+	if (hover) {
+		dragEndX = hoverX;
+		dragEndZ = hoverZ;
+	}
+
+	bool single = dragStartX == dragEndX && dragStartZ == dragEndZ;
+	dragPreview.clear();
+	if (!single) GetAreaChanges(dragStartX, dragStartZ, dragEndX, dragEndZ, dragPreview);
+
+	if (mouseTracker.leftButton == ButtonState::RELEASED) {
+		// The command is executed on the next tick
+		dragging = false;
+		dragPreview.clear();
+		if (single) {
+			if (CanUseTool(dragStartX, dragStartY, dragStartZ)) commands.push_back(Command::UseTool(dragStartX, dragStartY, dragStartZ));
+		}
+		else commands.push_back(Command::UseToolArea(dragStartX, dragStartZ, dragEndX, dragEndZ));
+	}
+}
+
+void Player::Tick(float dt) {
+	// Add passive income if needed
+	passiveIncomeCooldown -= dt;
+	if (passiveIncomeCooldown <= 0) {
+		passiveIncomeCooldown = 10.0f;
+		money += world->GetPassiveIncome();
+	}
+}
+
+bool Player::CanUseTool(int x, int y, int z) {
+	// He must be able to pay the price
+	return money >= prices[currentBuildingIdx] && CanUseToolOn(x, y, z);
+}
+
+bool Player::CanUseToolOn(int x, int y, int z) {
+	// The cube must be at the required height (1 - 2)
+	if (y != 1 && y != 2) return false;
+
+	// Water plant can only be built near water, you can only destroy a building, and you need an empty space to build something
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	if (x < 0 || z < 0 || x >= mapSize || z >= mapSize) return false;
+	return world->GetPlacementMask(possibleBuildings[currentBuildingIdx]).Get(x, z);
+}
+
+void Player::GetAreaChanges(int x, int z, int endX, int endZ, std::vector<BuildingChange>& changes) {
+	Building type = possibleBuildings[currentBuildingIdx];
+	auto tiles = type == ROAD ? ManhattanPath(x, z, endX, endZ) : FilledRect(x, z, endX, endZ);
+
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	areaMask.Resize(mapSize, mapSize);
+	for (const auto& tile : tiles) {
+		if (tile[0] >= 0 && tile[1] >= 0 && tile[0] < mapSize && tile[1] < mapSize) areaMask.Set(tile[0], tile[1], true);
+	}
+
+	// Only keeps the tiles where the tool can be used
+	BitGrid::And(areaMask, world->GetPlacementMask(type), areaMask);
+	areaMask.ForEach([&](int tileX, int tileZ) {
+		int y = world->GetSurfaceHeight(tileX, tileZ);
+		changes.push_back({ (uint32_t)(tileX + tileZ * mapSize), (uint8_t)(y + 1), (uint8_t)world->GetBuilding(tileX, tileZ), (uint8_t)type });
+	});
+}
+
+void Player::Execute(const Command& command) {
+	switch (command.type) {
+	case CMD_SELECT_TOOL:
+		if (command.x >= 0 && command.x < 7) currentBuildingIdx = command.x;
+		break;
+
+	case CMD_USE_TOOL:
+		// Checked again : the world may have changed since the command was made
+		if (!CanUseTool(command.x, command.y, command.z)) break;
+
+	{
+		int mapSize = CHUNK_SIZE * WORLD_SIZE;
+		BuildingChange change = { (uint32_t)(command.x + command.z * mapSize), (uint8_t)(command.y + 1), (uint8_t)world->GetBuilding(command.x, command.z), (uint8_t)possibleBuildings[currentBuildingIdx] };
+
+		money -= prices[currentBuildingIdx];
+		if (possibleBuildings[currentBuildingIdx] != NOTHING) {
+			// Adding a building
+			world->PlaceBuilding(possibleBuildings[currentBuildingIdx], command.x, command.y + 1, command.z);
+		}
+		else {
+			// Remove a building
+			world->RemoveBuilding(command.x, command.y + 1, command.z);
+		}
+
+		journal.Begin();
+		journal.Add(change);
+		journal.End(-prices[currentBuildingIdx]);
+		break;
+	}
+
+	case CMD_USE_TOOL_AREA:
+	{
+		// The whole area is checked, paid and placed at once
+		std::vector<BuildingChange> changes;
+		GetAreaChanges(command.x, command.z, command.endX, command.endZ, changes);
+		int cost = (int)changes.size() * prices[currentBuildingIdx];
+		if (changes.empty() || money < cost) break;
+
+		money -= cost;
+		world->ApplyBuildingChanges(changes.data(), changes.size(), false);
+
+		journal.Begin();
+		for (const BuildingChange& change : changes) journal.Add(change);
+		journal.End(-cost);
+		break;
+	}
+
+	case CMD_SCULPT:
+		if (command.endZ < 0 || command.endZ >= BRUSH_COUNT) break;
+		world->Sculpt((BrushMode)command.endZ, command.x, command.z, std::clamp(command.endX, 1, 16), command.y);
+		break;
+
+	case CMD_SET_BLOCK_STATE:
+		if (command.endX < 0 || (command.endX & ~(BS_FACING_MASK | BS_ON)) != 0) break;
+		world->SetBlockState(command.x, command.y, command.z, (uint8_t)command.endX);
+		break;
+
+	case CMD_UNDO:
+		journal.Undo(*world, money);
+		break;
+
+	case CMD_REDO:
+		journal.Redo(*world, money);
+		break;
+
+	case CMD_CAMERA:
+		position = command.position;
+		currentYaw = command.value;
+		camera.SetRotation(Quaternion::CreateFromYawPitchRoll(currentYaw, -45, 0));
+		camera.SetPosition(position + Vector3(0, 1.25f, 0));
+		break;
+
+	default:
 		break;
 	}
+}
 
+void Player::TakeCommands(std::vector<Command>& out) {
+	out.insert(out.end(), commands.begin(), commands.end());
+	commands.clear();
 }
 
 void Player::Draw(DeviceResources* deviceRes) {
@@ -129,6 +312,47 @@ void Player::Draw(DeviceResources* deviceRes) {
 	gpuRes->cbModel.UpdateBuffer(deviceRes);
 	highlightCube.Draw(deviceRes);
 
+	// The tiles where the current tool can be used
+	if (showPlacement) {
+		const BitGrid& mask = world->GetPlacementMask(possibleBuildings[currentBuildingIdx]);
+		if (placementGhostVersion != world->GetPlacementVersion() || placementGhostTool != currentBuildingIdx) {
+			placementGhostPositions.clear();
+			mask.ForEach([&](int x, int z) {
+				placementGhostPositions.push_back(Vector3(x, world->GetSurfaceHeight(x, z), z));
+			});
+			placementGhost.ResetInstanceBuffer(deviceRes, &placementGhostPositions);
+			placementGhostVersion = world->GetPlacementVersion();
+			placementGhostTool = currentBuildingIdx;
+		}
+
+		if (!placementGhostPositions.empty()) {
+			gpuRes->cbModel.data.model = Matrix::Identity;
+			gpuRes->cbModel.data.isInstance = true;
+			gpuRes->cbModel.UpdateBuffer(deviceRes);
+			placementGhost.Draw(deviceRes, true);
+			gpuRes->cbModel.data.isInstance = false;
+		}
+	}
+
+	// The cubes of the area being dragged, in a single draw
+	if (!dragPreview.empty()) {
+		int mapSize = CHUNK_SIZE * WORLD_SIZE;
+		dragGhostNextPositions.clear();
+		for (const BuildingChange& change : dragPreview) {
+			dragGhostNextPositions.push_back(Vector3((float)(change.tile % mapSize), (float)(change.y - 1), (float)(change.tile / mapSize)));
+		}
+		if (dragGhostNextPositions != dragGhostPositions) {
+			std::swap(dragGhostPositions, dragGhostNextPositions);
+			dragGhost.ResetInstanceBuffer(deviceRes, &dragGhostPositions);
+		}
+
+		gpuRes->cbModel.data.model = Matrix::Identity;
+		gpuRes->cbModel.data.isInstance = true;
+		gpuRes->cbModel.UpdateBuffer(deviceRes);
+		dragGhost.Draw(deviceRes, true);
+		gpuRes->cbModel.data.isInstance = false;
+	}
+
 	gpuRes->cbModel.data.model = Matrix::Identity;
 	gpuRes->cbModel.UpdateBuffer(deviceRes);
 	gpuRes->defaultDepth.Apply(deviceRes);
@@ -138,6 +362,7 @@ void Player::Reset()
 {
 	money = 100;
 	passiveIncomeCooldown = 10;
+	journal.Clear();
 }
 
 void Player::Im(DX::StepTimer const& timer)
@@ -187,5 +412,32 @@ void Player::Im(DX::StepTimer const& timer)
 			ImGui::SameLine();
 			ImGui::TextColored(color, std::to_string(prices[i]).c_str());
 		}
+
+		ImGui::Spacing();
+		ImGui::Spacing();
+
+		if (dragging && !dragPreview.empty()) {
+			int cost = (int)dragPreview.size() * prices[currentBuildingIdx];
+			color = cost <= money ? ImVec4(1, 1, 1, 1) : ImVec4(1, 0, 0, 1);
+			ImGui::TextColored(color, "Area : %zu tiles, %d", dragPreview.size(), cost);
+		}
+
+		ImGui::Checkbox("Show where the tool can be used", &showPlacement);
+
+		ImGui::Spacing();
+		ImGui::Spacing();
+
+		// Terrain brushes, used instead of the tools
+		const char* brushNames[BRUSH_COUNT + 1] = { "No brush", "Raise", "Lower", "Flatten", "Water" };
+		for (int i = -1; i < BRUSH_COUNT; i++) {
+			if (ImGui::RadioButton(brushNames[i + 1], brush == i)) brush = i;
+			if (i != BRUSH_COUNT - 1) ImGui::SameLine();
+		}
+		ImGui::SliderInt("Brush radius", &brushRadius, 1, 16);
+
+		if (ImGui::Button("Undo")) commands.push_back(Command::Undo());
+		ImGui::SameLine();
+		if (ImGui::Button("Redo")) commands.push_back(Command::Redo());
+		ImGui::Text("Journal : %zu undo, %zu redo, %zu changes, %.1f KB", journal.GetUndoCount(), journal.GetRedoCount(), journal.GetChangeCount(), journal.GetMemoryUsage() / 1024.0f);
 	}
 }
@@ -5,6 +5,8 @@
 #include "Engine/StepTimer.h"
 #include "Minicraft/World.h"
 #include "Minicraft/Cube3D.h"
+#include "Minicraft/Command.h"
+#include "Minicraft/UndoJournal.h"
 
 using namespace DirectX::SimpleMath;
 
@@ -33,6 +35,40 @@ class Player {
 
 	DirectX::Mouse::ButtonStateTracker      mouseTracker;
 	DirectX::Keyboard::KeyboardStateTracker keyboardTracker;
+
+	// Commands made from the inputs, waiting for the next tick
+	std::vector<Command> commands;
+
+	// Operations of the player that can be undone
+	UndoJournal journal;
+
+	// Area being dragged with the mouse
+	bool dragging = false;
+	int dragStartX = 0, dragStartY = 0, dragStartZ = 0;
+	int dragEndX = 0, dragEndZ = 0;
+	std::vector<BuildingChange> dragPreview;
+	// Tiles of the dragged area
+	BitGrid areaMask;
+	// Cubes of the dragged area, drawn instanced. The positions are built every frame, the instance buffer only when they change.
+	Cube3D dragGhost = Cube3D(NOTHING);
+	std::vector<Vector3> dragGhostPositions;
+	std::vector<Vector3> dragGhostNextPositions;
+
+	// Terrain brush used instead of the tools (-1 if none)
+	int brush = -1;
+	int brushRadius = 3;
+	// Height the flatten brush brings the terrain to (the height where the stroke started)
+	int strokeHeight = 0;
+	// Time before the next step of the stroke
+	float strokeCooldown = 0;
+
+	// Ghost overlay of the tiles where the current tool can be used
+	bool showPlacement = false;
+	Cube3D placementGhost = Cube3D(NOTHING);
+	std::vector<Vector3> placementGhostPositions;
+	// Placement version and tool the ghost was built for
+	uint32_t placementGhostVersion = 0;
+	int placementGhostTool = -1;
 public:
 	Player(World* w, Vector3 pos) : world(w), position(pos){}
 
@@ -43,13 +79,34 @@ public:
 	void GenerateGPUResources(DeviceResources* deviceRes);
 
 	/// <summary>
-	/// Updates the player
+	/// Updates the player from the inputs : moves the camera, and makes commands for the actions that change the city
 	/// </summary>
 	/// <param name="dt">The delta time</param>
 	/// <param name="kb">The keyboard's state</param>
 	/// <param name="ms">The mouse's state</param>
 	void Update(float dt, DirectX::Keyboard::State kb, DirectX::Mouse::State ms);
 
+	/// <summary>
+	/// Simulates a tick (passive income)
+	/// </summary>
+	/// <param name="dt">The duration of a tick</param>
+	void Tick(float dt);
+
+	/// <summary>
+	/// Executes a command of the player (tools and camera)
+	/// </summary>
+	/// <param name="command">The command</param>
+	void Execute(const Command& command);
+
+	// Moves the commands made since the last call
+	void TakeCommands(std::vector<Command>& out);
+
+	// Gets the player's money
+	int GetMoney() const { return money; }
+
+	// Gets the index of the current tool
+	int GetTool() const { return currentBuildingIdx; }
+
 	/// <summary>
 	/// Draws the player
 	/// </summary>
@@ -64,4 +121,43 @@ public:
 
 	// Gets the player's camera
 	PerspectiveCamera* GetCamera() { return &camera; }
+
+	// Gets the player's yaw
+	float GetYaw() const { return currentYaw; }
+
+	// Gets the player's position
+	Vector3 GetPosition() const { return position; }
+
+private:
+	/// <summary>
+	/// Checks if the current tool can be used on a cube
+	/// </summary>
+	/// <param name="x">The cube's X position</param>
+	/// <param name="y">The cube's Y position</param>
+	/// <param name="z">The cube's Z position</param>
+	/// <returns>True if it can be used</returns>
+	bool CanUseTool(int x, int y, int z);
+
+	/// <summary>
+	/// Checks if the current tool can be used on a cube, without checking the price (from the world's placement mask)
+	/// </summary>
+	/// <param name="x">The cube's X position</param>
+	/// <param name="y">The cube's Y position</param>
+	/// <param name="z">The cube's Z position</param>
+	/// <returns>True if it can be used</returns>
+	bool CanUseToolOn(int x, int y, int z);
+
+	/// <summary>
+	/// Gets the changes the current tool would make on an area : a path for the roads, a rectangle for the other buildings and the destruction.
+	/// The area's tiles are ANDed with the placement mask, so the tiles where the tool can't be used are skipped.
+	/// </summary>
+	/// <param name="x">The start's X position</param>
+	/// <param name="z">The start's Z position</param>
+	/// <param name="endX">The end's X position</param>
+	/// <param name="endZ">The end's Z position</param>
+	/// <param name="changes">The building changes</param>
+	void GetAreaChanges(int x, int z, int endX, int endZ, std::vector<BuildingChange>& changes);
+
+	friend class CitySave;
+	friend class Autosave;
 };
@@ -0,0 +1,288 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "Engine/MappedFile.h"
+#include "Replay.h"
+#include "World.h"
+#include "Player.h"
+
+// "MCRP"
+static constexpr uint32_t REPLAY_MAGIC = 0x5052434D;
+// To increment whenever the layout of the file or the meaning of the commands changes
+static constexpr uint32_t REPLAY_VERSION = 1;
+
+/// <summary>
+/// Start of a replay. Followed by the commands : the ticks since the previous command (var uint), the type (1 byte), then :
+/// - GENERATE_SEED : seed, threshold
+/// - GENERATE_FILE : threshold, name's length (1 byte), name
+/// - SELECT_TOOL : tool (1 byte)
+/// - USE_TOOL : x, y, z (2 bytes each)
+/// - CAMERA : position, yaw
+/// - UNDO, REDO : nothing
+/// - USE_TOOL_AREA : x, z, end x, end z (2 bytes each)
+/// - SCULPT : x, y, z (2 bytes each), radius, brush (1 byte each)
+/// - SET_BLOCK_STATE : x, y, z (2 bytes each), state (1 byte)
+/// </summary>
+struct ReplayHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t tickRate;
+	uint32_t commandCount;
+	uint32_t length;
+	uint32_t padding;
+	uint64_t finalHash;
+};
+
+void Replay::StartRecording() {
+	commands.clear();
+	length = 0;
+	finalHash = 0;
+	tick = 0;
+	mode = REPLAY_RECORDING;
+}
+
+void Replay::Record(const Command& command) {
+	if (mode != REPLAY_RECORDING) return;
+	commands.push_back({ tick, command });
+}
+
+void Replay::StopRecording(uint64_t hash) {
+	length = tick;
+	finalHash = hash;
+	mode = REPLAY_NONE;
+}
+
+void Replay::StartPlaying() {
+	tick = 0;
+	next = 0;
+	mode = REPLAY_PLAYING;
+}
+
+void Replay::GetTickCommands(std::vector<Command>& out) {
+	if (mode != REPLAY_PLAYING) return;
+	while (next < commands.size() && commands[next].tick == tick) {
+		out.push_back(commands[next].command);
+		next++;
+	}
+}
+
+bool Replay::NextTick() {
+	tick++;
+	if (mode == REPLAY_PLAYING && tick >= length) {
+		mode = REPLAY_NONE;
+		return false;
+	}
+	return true;
+}
+
+std::wstring Replay::GetPath(const std::wstring& name) {
+	return L"Replays/" + name + L".replay";
+}
+
+bool Replay::Save(const std::wstring& path) const {
+	BinaryWriter writer;
+	ReplayHeader header = {};
+	header.magic = REPLAY_MAGIC;
+	header.version = REPLAY_VERSION;
+	header.tickRate = TICK_RATE;
+	header.commandCount = (uint32_t)commands.size();
+	header.length = length;
+	header.finalHash = finalHash;
+	writer.Write(header);
+
+	uint32_t previousTick = 0;
+	for (const TimedCommand& timed : commands) {
+		const Command& command = timed.command;
+		writer.WriteVarUint(timed.tick - previousTick);
+		previousTick = timed.tick;
+		writer.Write(command.type);
+
+		switch (command.type) {
+		case CMD_GENERATE_SEED:
+			writer.Write((int32_t)command.x);
+			writer.Write(command.value);
+			break;
+		case CMD_GENERATE_FILE:
+			writer.Write(command.value);
+			writer.Write((uint8_t)std::min<size_t>(command.name.size(), 255));
+			writer.WriteBytes(command.name.data(), std::min<size_t>(command.name.size(), 255));
+			break;
+		case CMD_SELECT_TOOL:
+			writer.Write((uint8_t)command.x);
+			break;
+		case CMD_USE_TOOL:
+			writer.Write((int16_t)command.x);
+			writer.Write((int16_t)command.y);
+			writer.Write((int16_t)command.z);
+			break;
+		case CMD_CAMERA:
+			writer.Write(command.position);
+			writer.Write(command.value);
+			break;
+		case CMD_UNDO:
+		case CMD_REDO:
+			break;
+		case CMD_USE_TOOL_AREA:
+			writer.Write((int16_t)command.x);
+			writer.Write((int16_t)command.z);
+			writer.Write((int16_t)command.endX);
+			writer.Write((int16_t)command.endZ);
+			break;
+		case CMD_SCULPT:
+			writer.Write((int16_t)command.x);
+			writer.Write((int16_t)command.y);
+			writer.Write((int16_t)command.z);
+			writer.Write((uint8_t)command.endX);
+			writer.Write((uint8_t)command.endZ);
+			break;
+		case CMD_SET_BLOCK_STATE:
+			writer.Write((int16_t)command.x);
+			writer.Write((int16_t)command.y);
+			writer.Write((int16_t)command.z);
+			writer.Write((uint8_t)command.endX);
+			break;
+		}
+	}
+
+	CreateDirectoryW(L"Replays", nullptr);
+	return writer.SaveToFile(path);
+}
+
+bool Replay::Load(const std::wstring& path, std::string& error) {
+	MappedFile file;
+	if (!file.Open(path)) {
+		error = "Could not open the replay";
+		return false;
+	}
+
+	BinaryReader reader(file.GetData(), file.GetSize());
+	ReplayHeader header;
+	if (!reader.Read(header) || header.magic != REPLAY_MAGIC) {
+		error = "The file isn't a replay";
+		return false;
+	}
+	if (header.version != REPLAY_VERSION || header.tickRate != TICK_RATE) {
+		error = "The replay was made with another version of the game";
+		return false;
+	}
+
+	std::vector<TimedCommand> loaded;
+	uint32_t currentTick = 0;
+	for (uint32_t i = 0; i < header.commandCount; i++) {
+		uint64_t delta = 0;
+		TimedCommand timed = {};
+		reader.ReadVarUint(delta);
+		reader.Read(timed.command.type);
+		currentTick += (uint32_t)delta;
+		timed.tick = currentTick;
+
+		Command& command = timed.command;
+		switch (command.type) {
+		case CMD_GENERATE_SEED: {
+			int32_t seed = 0;
+			reader.Read(seed);
+			reader.Read(command.value);
+			command.x = seed;
+			break;
+		}
+		case CMD_GENERATE_FILE: {
+			uint8_t nameSize = 0;
+			reader.Read(command.value);
+			reader.Read(nameSize);
+			const uint8_t* name = reader.Skip(nameSize);
+			if (name) command.name.assign((const char*)name, nameSize);
+			break;
+		}
+		case CMD_SELECT_TOOL: {
+			uint8_t tool = 0;
+			reader.Read(tool);
+			command.x = tool;
+			break;
+		}
+		case CMD_USE_TOOL: {
+			int16_t x = 0, y = 0, z = 0;
+			reader.Read(x);
+			reader.Read(y);
+			reader.Read(z);
+			command.x = x;
+			command.y = y;
+			command.z = z;
+			break;
+		}
+		case CMD_CAMERA:
+			reader.Read(command.position);
+			reader.Read(command.value);
+			break;
+		case CMD_UNDO:
+		case CMD_REDO:
+			break;
+		case CMD_USE_TOOL_AREA: {
+			int16_t x = 0, z = 0, endX = 0, endZ = 0;
+			reader.Read(x);
+			reader.Read(z);
+			reader.Read(endX);
+			reader.Read(endZ);
+			command.x = x;
+			command.z = z;
+			command.endX = endX;
+			command.endZ = endZ;
+			break;
+		}
+		case CMD_SCULPT: {
+			int16_t x = 0, y = 0, z = 0;
+			uint8_t radius = 0, brush = 0;
+			reader.Read(x);
+			reader.Read(y);
+			reader.Read(z);
+			reader.Read(radius);
+			reader.Read(brush);
+			command.x = x;
+			command.y = y;
+			command.z = z;
+			command.endX = radius;
+			command.endZ = brush;
+			break;
+		}
+		case CMD_SET_BLOCK_STATE: {
+			int16_t x = 0, y = 0, z = 0;
+			uint8_t state = 0;
+			reader.Read(x);
+			reader.Read(y);
+			reader.Read(z);
+			reader.Read(state);
+			command.x = x;
+			command.y = y;
+			command.z = z;
+			command.endX = state;
+			break;
+		}
+		default:
+			error = "Unknown command in the replay";
+			return false;
+		}
+
+		if (reader.HasFailed() || timed.tick >= header.length) {
+			error = "The replay is corrupted";
+			return false;
+		}
+		loaded.push_back(std::move(timed));
+	}
+
+	if (loaded.empty() || (loaded[0].command.type != CMD_GENERATE_SEED && loaded[0].command.type != CMD_GENERATE_FILE)) {
+		error = "The replay doesn't start with a map";
+		return false;
+	}
+
+	commands = std::move(loaded);
+	length = header.length;
+	finalHash = header.finalHash;
+	mode = REPLAY_NONE;
+	error.clear();
+	return true;
+}
+
+uint64_t Replay::ComputeStateHash(World& world, const Player& player) {
+	uint64_t hash = world.GetStateHash();
+	int money = player.GetMoney();
+	return Fnv1a64(&money, sizeof(money), hash);
+}
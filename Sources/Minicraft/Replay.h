@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Minicraft/Command.h"
+
+class World;
+class Player;
+
+/// <summary>
+/// Records the commands of a session with their tick, to play them again.
+/// A replay starts with a map generation and ends with the hash of the state it reached.
+/// </summary>
+class Replay {
+public:
+	enum Mode {
+		REPLAY_NONE,
+		REPLAY_RECORDING,
+		REPLAY_PLAYING
+	};
+
+	// Simulation ticks per second
+	static constexpr int TICK_RATE = 60;
+
+private:
+	struct TimedCommand {
+		uint32_t tick;
+		Command command;
+	};
+
+	std::vector<TimedCommand> commands;
+	// Number of ticks
+	uint32_t length = 0;
+	uint64_t finalHash = 0;
+
+	Mode mode = REPLAY_NONE;
+	// Current tick, and next command to play
+	uint32_t tick = 0;
+	size_t next = 0;
+public:
+	// Gets the current mode
+	Mode GetMode() const { return mode; }
+
+	// Gets the current tick of the recording / playback
+	uint32_t GetTick() const { return tick; }
+
+	// Gets the number of ticks of the replay
+	uint32_t GetLength() const { return length; }
+
+	// Gets the hash of the state at the end of the replay
+	uint64_t GetFinalHash() const { return finalHash; }
+
+	// Gets the number of commands
+	size_t GetCommandCount() const { return commands.size(); }
+
+	// Starts a new recording (the first command must be a map generation)
+	void StartRecording();
+
+	// Records a command for the current tick
+	void Record(const Command& command);
+
+	/// <summary>
+	/// Ends the recording
+	/// </summary>
+	/// <param name="hash">The hash of the current state</param>
+	void StopRecording(uint64_t hash);
+
+	// Plays the replay from the start
+	void StartPlaying();
+
+	/// <summary>
+	/// Gets the commands of the current tick when playing
+	/// </summary>
+	/// <param name="out">The commands</param>
+	void GetTickCommands(std::vector<Command>& out);
+
+	// Moves to the next tick. Returns false when the replay is over.
+	bool NextTick();
+
+	// Stops recording or playing
+	void Stop() { mode = REPLAY_NONE; }
+
+	/// <summary>
+	/// Saves the replay
+	/// </summary>
+	/// <param name="path">The file's path</param>
+	/// <returns>True if the replay was saved</returns>
+	bool Save(const std::wstring& path) const;
+
+	/// <summary>
+	/// Loads a replay
+	/// </summary>
+	/// <param name="path">The file's path</param>
+	/// <param name="error">Why the replay couldn't be loaded</param>
+	/// <returns>True if the replay was loaded</returns>
+	bool Load(const std::wstring& path, std::string& error);
+
+	// Gets the path of a replay
+	static std::wstring GetPath(const std::wstring& name);
+
+	/// <summary>
+	/// Computes the hash of the state of the game (blocks, buildings, economy, money)
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="player">The player</param>
+	/// <returns>The hash</returns>
+	static uint64_t ComputeStateHash(World& world, const Player& player);
+};
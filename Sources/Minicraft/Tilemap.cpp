@@ -0,0 +1,476 @@
+#include "pch.h"
+
+#include "Engine/MappedFile.h"
+#include "Tilemap.h"
+
+std::string TilemapError::ToString() const {
+	if (line == 0) return message;
+	return "Line " + std::to_string(line) + ", column " + std::to_string(column) + " : " + message;
+}
+
+// Skips spaces, tabs and carriage returns
+static inline const char* SkipBlanks(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	return p;
+}
+
+/// <summary>
+/// Parses an integer. Tile values are small, so the common case is handled by hand
+/// and std::from_chars is only used for the values that could overflow.
+/// </summary>
+/// <param name="p">The start of the number</param>
+/// <param name="end">The end of the text</param>
+/// <param name="value">The parsed value</param>
+/// <returns>The end of the number, nullptr if there is no number, p if the number is out of range</returns>
+static inline const char* ParseInt(const char* p, const char* end, int& value) {
+	const char* digits = (p < end && *p == '-') ? p + 1 : p;
+	const char* q = digits;
+	int result = 0;
+	while (q < end && q - digits < 9 && (unsigned)(*q - '0') < 10) {
+		result = result * 10 + (*q - '0');
+		q++;
+	}
+	if (q == digits) return nullptr;
+
+	if (q < end && (unsigned)(*q - '0') < 10) {
+		// Long number : let the standard library check the range
+		auto [next, ec] = std::from_chars(p, end, value);
+		return ec == std::errc() ? next : p;
+	}
+
+	value = digits != p ? -result : result;
+	return q;
+}
+
+// Tiled keeps the flips and rotation of a tile in the top bits of its global id
+static constexpr uint32_t TMX_GID_MASK = 0x0FFFFFFF;
+
+/// <summary>
+/// Parses a TMX global tile id : 32 bits unsigned, without the flip and rotation bits (the game doesn't flip tiles)
+/// </summary>
+/// <returns>The end of the number, nullptr if there is no number, p if the number is out of range</returns>
+static inline const char* ParseGid(const char* p, const char* end, int& value) {
+	uint32_t gid = 0;
+	auto [next, ec] = std::from_chars(p, end, gid);
+	if (next == p) return nullptr;
+	if (ec != std::errc()) return p;
+	value = (int)(gid & TMX_GID_MASK);
+	return next;
+}
+
+// Sets the error of a file that couldn't be opened
+static bool OpenFailed(const std::wstring& path, TilemapError& error) {
+	error = {};
+	error.message = "Could not open " + ToUtf8(path);
+	return false;
+}
+
+bool LoadCsvTilemap(const std::wstring& path, Tilemap& tilemap, TilemapError& error) {
+	MappedFile file;
+	if (!file.Open(path)) return OpenFailed(path, error);
+
+	const char* begin = (const char*)file.GetData();
+	return ParseCsvTilemap(begin, begin + file.GetSize(), tilemap, error);
+}
+
+bool ParseCsvTilemap(const char* begin, const char* end, Tilemap& tilemap, TilemapError& error, int firstLine, bool gids) {
+	tilemap.width = 0;
+	tilemap.height = 0;
+	tilemap.tiles.clear();
+	// A value takes at least 2 characters with its separator
+	tilemap.tiles.reserve((end - begin) / 2 + 1);
+
+	const char* p = begin;
+	const char* lineStart = begin;
+	int line = firstLine;
+	// Line of the first blank line after the rows (only allowed at the end)
+	int blankLine = 0;
+
+	auto fail = [&](const char* at, std::string message) {
+		error.line = line;
+		error.column = (int)(at - lineStart) + 1;
+		error.message = std::move(message);
+		return false;
+	};
+
+	while (p < end) {
+		lineStart = p;
+		p = SkipBlanks(p, end);
+		if (p == end) break;
+
+		if (*p == '\n') {
+			if (tilemap.height > 0 && blankLine == 0) blankLine = line;
+			p++;
+			line++;
+			continue;
+		}
+
+		if (blankLine != 0) {
+			line = blankLine;
+			lineStart = p;
+			return fail(p, "Empty line inside the tilemap");
+		}
+
+		// Parse a row
+		int count = 0;
+		while (true) {
+			p = SkipBlanks(p, end);
+
+			int value;
+			const char* next = gids ? ParseGid(p, end, value) : ParseInt(p, end, value);
+			if (!next) return fail(p, "Expected a number");
+			if (next == p) return fail(p, "Value out of range");
+
+			tilemap.tiles.push_back(value);
+			count++;
+
+			p = SkipBlanks(next, end);
+			if (p == end || *p == '\n') break;
+			if (*p != ',') return fail(p, "Expected ',' or the end of the line");
+
+			// A comma can end the row
+			p = SkipBlanks(p + 1, end);
+			if (p == end || *p == '\n') break;
+		}
+
+		if (tilemap.height == 0) {
+			tilemap.width = count;
+		}
+		else if (count != tilemap.width) {
+			return fail(p, "The row has " + std::to_string(count) + " values, expected " + std::to_string(tilemap.width));
+		}
+		tilemap.height++;
+
+		if (p < end) {
+			p++;
+			line++;
+		}
+	}
+
+	if (tilemap.height == 0) {
+		error = {};
+		error.message = "The tilemap is empty";
+		return false;
+	}
+	return true;
+}
+
+// --- TMX ---
+
+static bool EqualsNoCase(const std::string& a, const std::string& b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+	}
+	return true;
+}
+
+const TmxLayer* TmxMap::FindLayer(const std::string& name) const {
+	for (const TmxLayer& layer : layers) {
+		if (EqualsNoCase(layer.name, name)) return &layer;
+	}
+	return nullptr;
+}
+
+const std::string* TmxMap::FindProperty(const std::string& name) const {
+	for (const auto& [key, value] : properties) {
+		if (key == name) return &value;
+	}
+	return nullptr;
+}
+
+namespace {
+	/// <summary>
+	/// A tag read by the XML scanner. Views point in the file's text.
+	/// </summary>
+	struct XmlTag {
+		std::string_view name;
+		std::vector<std::pair<std::string_view, std::string_view>> attributes;
+		// </name>
+		bool closing = false;
+		// <name/>
+		bool selfClosing = false;
+
+		// Gets the value of an attribute, nullptr if the tag doesn't have it
+		const std::string_view* Get(std::string_view attribute) const {
+			for (const auto& [key, value] : attributes) {
+				if (key == attribute) return &value;
+			}
+			return nullptr;
+		}
+	};
+
+	/// <summary>
+	/// Minimal XML scanner, reads the tags one after the other and keeps track of the position for the errors
+	/// </summary>
+	struct XmlScanner {
+		const char* p;
+		const char* end;
+		const char* lineStart;
+		int line = 1;
+		TilemapError& error;
+
+		XmlScanner(const char* begin, const char* end, TilemapError& error) : p(begin), end(end), lineStart(begin), error(error) {}
+
+		// Moves forward, counting the lines
+		void MoveTo(const char* to) {
+			for (; p < to; p++) {
+				if (*p == '\n') {
+					line++;
+					lineStart = p + 1;
+				}
+			}
+		}
+
+		bool Fail(std::string message) {
+			error.line = line;
+			error.column = (int)(p - lineStart) + 1;
+			error.message = std::move(message);
+			return false;
+		}
+
+		bool StartsWith(const char* text) const {
+			size_t length = strlen(text);
+			return (size_t)(end - p) >= length && memcmp(p, text, length) == 0;
+		}
+
+		// Moves after the next occurrence of a text
+		bool SkipPast(const char* text) {
+			std::string_view rest(p, end - p);
+			size_t found = rest.find(text);
+			if (found == std::string_view::npos) return Fail("Unexpected end of file");
+			MoveTo(p + found + strlen(text));
+			return true;
+		}
+
+		void SkipSpaces() {
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) MoveTo(p + 1);
+		}
+
+		static bool IsNameChar(char c) {
+			return c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '=' && c != '>' && c != '/' && c != '"' && c != '\'';
+		}
+
+		/// <summary>
+		/// Reads the next element tag, skipping declarations and comments
+		/// </summary>
+		/// <param name="tag">The tag</param>
+		/// <param name="found">False if there are no tags left</param>
+		/// <returns>False if the text isn't valid</returns>
+		bool Next(XmlTag& tag, bool& found) {
+			while (true) {
+				const char* open = (const char*)memchr(p, '<', end - p);
+				if (!open) {
+					found = false;
+					return true;
+				}
+				MoveTo(open);
+
+				if (StartsWith("<?")) {
+					if (!SkipPast("?>")) return false;
+				}
+				else if (StartsWith("<!--")) {
+					if (!SkipPast("-->")) return false;
+				}
+				else if (StartsWith("<!")) {
+					if (!SkipPast(">")) return false;
+				}
+				else {
+					break;
+				}
+			}
+
+			found = true;
+			tag.attributes.clear();
+			tag.selfClosing = false;
+			MoveTo(p + 1);
+			tag.closing = p < end && *p == '/';
+			if (tag.closing) MoveTo(p + 1);
+
+			const char* nameStart = p;
+			while (p < end && IsNameChar(*p)) p++;
+			if (p == nameStart) return Fail("Expected a tag name");
+			tag.name = std::string_view(nameStart, p - nameStart);
+
+			while (true) {
+				SkipSpaces();
+				if (p == end) return Fail("Unexpected end of file");
+				if (*p == '>') {
+					MoveTo(p + 1);
+					return true;
+				}
+				if (StartsWith("/>")) {
+					tag.selfClosing = true;
+					MoveTo(p + 2);
+					return true;
+				}
+
+				// Attribute
+				const char* keyStart = p;
+				while (p < end && IsNameChar(*p)) p++;
+				if (p == keyStart) return Fail("Expected an attribute");
+				std::string_view key(keyStart, p - keyStart);
+
+				SkipSpaces();
+				if (p == end || *p != '=') return Fail("Expected '=' after the attribute");
+				MoveTo(p + 1);
+				SkipSpaces();
+				if (p == end || (*p != '"' && *p != '\'')) return Fail("Expected a quoted value");
+
+				char quote = *p;
+				const char* valueStart = p + 1;
+				const char* valueEnd = (const char*)memchr(valueStart, quote, end - valueStart);
+				if (!valueEnd) return Fail("Unexpected end of file");
+				MoveTo(valueEnd + 1);
+
+				tag.attributes.push_back({ key, std::string_view(valueStart, valueEnd - valueStart) });
+			}
+		}
+	};
+
+	// Replaces the predefined XML entities
+	std::string DecodeXml(std::string_view text) {
+		static const std::pair<const char*, char> entities[] = {
+			{ "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' }
+		};
+
+		std::string result;
+		result.reserve(text.size());
+		for (size_t i = 0; i < text.size(); i++) {
+			bool replaced = false;
+			if (text[i] == '&') {
+				for (const auto& [entity, c] : entities) {
+					if (text.compare(i, strlen(entity), entity) == 0) {
+						result += c;
+						i += strlen(entity) - 1;
+						replaced = true;
+						break;
+					}
+				}
+			}
+			if (!replaced) result += text[i];
+		}
+		return result;
+	}
+
+	// Reads an integer attribute
+	bool GetInt(const XmlTag& tag, std::string_view attribute, int& value) {
+		const std::string_view* text = tag.Get(attribute);
+		if (!text) return false;
+		auto [next, ec] = std::from_chars(text->data(), text->data() + text->size(), value);
+		return ec == std::errc() && next == text->data() + text->size();
+	}
+}
+
+bool LoadTmxMap(const std::wstring& path, TmxMap& map, TilemapError& error) {
+	MappedFile file;
+	if (!file.Open(path)) return OpenFailed(path, error);
+
+	const char* begin = (const char*)file.GetData();
+	return ParseTmxMap(begin, begin + file.GetSize(), map, error);
+}
+
+bool ParseTmxMap(const char* begin, const char* end, TmxMap& map, TilemapError& error) {
+	map = {};
+	error = {};
+
+	XmlScanner scanner(begin, end, error);
+	// Open elements
+	std::vector<std::string_view> stack;
+	// First global tile id of every tileset
+	std::vector<int> firstGids;
+	bool mapFound = false;
+
+	XmlTag tag;
+	bool found;
+	while (true) {
+		if (!scanner.Next(tag, found)) return false;
+		if (!found) break;
+
+		if (tag.closing) {
+			if (stack.empty() || stack.back() != tag.name) return scanner.Fail("Unexpected </" + std::string(tag.name) + ">");
+			stack.pop_back();
+			continue;
+		}
+
+		std::string_view parent = stack.empty() ? std::string_view() : stack.back();
+
+		if (tag.name == "map") {
+			if (!stack.empty()) return scanner.Fail("Unexpected <map>");
+			if (!GetInt(tag, "width", map.width) || !GetInt(tag, "height", map.height) || map.width <= 0 || map.height <= 0) {
+				return scanner.Fail("The map needs a valid width and height");
+			}
+			const std::string_view* infinite = tag.Get("infinite");
+			if (infinite && *infinite == "1") return scanner.Fail("Infinite maps are not supported");
+			mapFound = true;
+		}
+		else if (stack.empty()) {
+			return scanner.Fail("Expected <map>");
+		}
+		else if (tag.name == "tileset") {
+			int firstGid;
+			if (!GetInt(tag, "firstgid", firstGid) || firstGid < 1) return scanner.Fail("The tileset needs a valid firstgid");
+			firstGids.push_back(firstGid);
+		}
+		else if (tag.name == "layer") {
+			TmxLayer layer;
+			const std::string_view* name = tag.Get("name");
+			if (name) layer.name = DecodeXml(*name);
+
+			int width = map.width;
+			int height = map.height;
+			GetInt(tag, "width", width);
+			GetInt(tag, "height", height);
+			if (width != map.width || height != map.height) return scanner.Fail("The layer's size doesn't match the map's size");
+
+			map.layers.push_back(std::move(layer));
+		}
+		else if (tag.name == "data" && parent == "layer") {
+			const std::string_view* encoding = tag.Get("encoding");
+			if (!encoding || *encoding != "csv" || tag.Get("compression")) return scanner.Fail("Only CSV encoded layers are supported");
+			if (tag.selfClosing) return scanner.Fail("The layer is empty");
+
+			// The CSV goes until the closing tag
+			const char* dataEnd = (const char*)memchr(scanner.p, '<', end - scanner.p);
+			if (!dataEnd) return scanner.Fail("Unexpected end of file");
+
+			Tilemap& tiles = map.layers.back().tiles;
+			if (!ParseCsvTilemap(scanner.p, dataEnd, tiles, error, scanner.line, true)) {
+				// The first line of the CSV starts after the tag
+				if (error.line == scanner.line) error.column += (int)(scanner.p - scanner.lineStart);
+				return false;
+			}
+			if (tiles.width != map.width || tiles.height != map.height) {
+				return scanner.Fail("The layer has " + std::to_string(tiles.width) + "x" + std::to_string(tiles.height) +
+					" tiles, expected " + std::to_string(map.width) + "x" + std::to_string(map.height));
+			}
+
+			// Global ids to ids in the tileset (the tileset with the highest firstgid below the id)
+			for (int& tile : tiles.tiles) {
+				if (tile == 0) {
+					tile = -1;
+					continue;
+				}
+				int firstGid = 1;
+				for (int gid : firstGids) {
+					if (gid <= tile && gid > firstGid) firstGid = gid;
+				}
+				tile -= firstGid;
+			}
+			scanner.MoveTo(dataEnd);
+		}
+		else if (tag.name == "property" && parent == "properties" && stack.size() == 2) {
+			// Property of the map (<map><properties><property>)
+			const std::string_view* name = tag.Get("name");
+			const std::string_view* value = tag.Get("value");
+			if (!name) return scanner.Fail("The property needs a name");
+			map.properties.push_back({ DecodeXml(*name), value ? DecodeXml(*value) : std::string() });
+		}
+
+		if (!tag.selfClosing) stack.push_back(tag.name);
+	}
+
+	if (!mapFound) return scanner.Fail("The file doesn't contain a map");
+	if (!stack.empty()) return scanner.Fail("Unexpected end of file, <" + std::string(stack.back()) + "> isn't closed");
+	return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+/// <summary>
+/// Represents a grid of tile values loaded from a tilemap
+/// </summary>
+struct Tilemap {
+	int width = 0;
+	int height = 0;
+	std::vector<int> tiles;
+
+	// Gets the value of a tile
+	int Get(int x, int y) const { return tiles[x + y * width]; }
+};
+
+/// <summary>
+/// Represents an error found while loading a tilemap
+/// </summary>
+struct TilemapError {
+	// 1-based position of the error (0 if it isn't linked to a position)
+	int line = 0;
+	int column = 0;
+	std::string message;
+
+	// Gets a readable version of the error
+	std::string ToString() const;
+};
+
+/// <summary>
+/// Loads a CSV tilemap (one row per line, comma separated integers).
+/// The file is memory-mapped and parsed in a single pass.
+/// </summary>
+/// <param name="path">The file's path</param>
+/// <param name="tilemap">The loaded tilemap</param>
+/// <param name="error">The error, if the tilemap couldn't be loaded</param>
+/// <returns>True if the tilemap was loaded</returns>
+bool LoadCsvTilemap(const std::wstring& path, Tilemap& tilemap, TilemapError& error);
+
+/// <summary>
+/// Parses CSV tile values. Every row must have the same number of values.
+/// Blank lines at the start and end, spaces, carriage returns and a comma at the end of a row are allowed.
+/// </summary>
+/// <param name="begin">The start of the text</param>
+/// <param name="end">The end of the text</param>
+/// <param name="tilemap">The parsed tilemap</param>
+/// <param name="error">The error, if the text couldn't be parsed</param>
+/// <param name="firstLine">The line number of the text's first line (for the errors)</param>
+/// <param name="gids">True if the values are TMX global ids : unsigned, their flip and rotation bits are dropped</param>
+/// <returns>True if the text was parsed</returns>
+bool ParseCsvTilemap(const char* begin, const char* end, Tilemap& tilemap, TilemapError& error, int firstLine = 1, bool gids = false);
+
+/// <summary>
+/// A tile layer of a TMX map. Tiles hold the tile's id in its tileset, -1 for empty tiles.
+/// </summary>
+struct TmxLayer {
+	std::string name;
+	Tilemap tiles;
+};
+
+/// <summary>
+/// A map made with Tiled (only the parts used by the game)
+/// </summary>
+struct TmxMap {
+	int width = 0;
+	int height = 0;
+	std::vector<TmxLayer> layers;
+	// Custom properties of the map
+	std::vector<std::pair<std::string, std::string>> properties;
+
+	// Finds a layer by its name (case insensitive), nullptr if there is none
+	const TmxLayer* FindLayer(const std::string& name) const;
+
+	// Finds a property of the map, nullptr if there is none
+	const std::string* FindProperty(const std::string& name) const;
+};
+
+/// <summary>
+/// Loads a TMX map. The file is memory-mapped and read in a single pass, without building a DOM.
+/// Only finite maps with CSV encoded tile layers are supported.
+/// </summary>
+/// <param name="path">The file's path</param>
+/// <param name="map">The loaded map</param>
+/// <param name="error">The error, if the map couldn't be loaded</param>
+/// <returns>True if the map was loaded</returns>
+bool LoadTmxMap(const std::wstring& path, TmxMap& map, TilemapError& error);
+
+/// <summary>
+/// Parses the text of a TMX map
+/// </summary>
+/// <param name="begin">The start of the text</param>
+/// <param name="end">The end of the text</param>
+/// <param name="map">The parsed map</param>
+/// <param name="error">The error, if the text couldn't be parsed</param>
+/// <returns>True if the text was parsed</returns>
+bool ParseTmxMap(const char* begin, const char* end, TmxMap& map, TilemapError& error);
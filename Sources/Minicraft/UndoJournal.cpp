@@ -0,0 +1,150 @@
+#include "pch.h"
+
+#include "UndoJournal.h"
+
+UndoJournal::UndoJournal(size_t maxChanges, size_t maxEntries) {
+	changes.resize(maxChanges);
+	entries.resize(maxEntries);
+}
+
+void UndoJournal::Begin() {
+	// A new operation replaces the entries that were undone
+	entryEnd = entryCursor;
+	if (entryEnd > entryBegin) {
+		const Entry& last = entries[(entryEnd - 1) % entries.size()];
+		changeEnd = last.first + last.count;
+	}
+
+	recording = true;
+	overflow = false;
+	recordFirst = changeEnd;
+}
+
+void UndoJournal::Add(const BuildingChange& change) {
+	if (!recording || overflow) return;
+
+	if (changeEnd - recordFirst >= changes.size()) {
+		// The operation alone doesn't fit in the journal
+		overflow = true;
+		return;
+	}
+
+	// Makes room by dropping the oldest entries
+	while (entryEnd > entryBegin && changeEnd + 1 - entries[entryBegin % entries.size()].first > changes.size())
+		DropOldest();
+
+	changes[changeEnd % changes.size()] = change;
+	changeEnd++;
+}
+
+void UndoJournal::End(int money) {
+	if (!recording) return;
+	recording = false;
+
+	if (overflow) {
+		// The older entries can't be undone without this one
+		Clear();
+		return;
+	}
+
+	uint32_t count = (uint32_t)(changeEnd - recordFirst);
+	if (count == 0 && money == 0) return;
+
+	if (entryEnd - entryBegin == entries.size()) DropOldest();
+	entries[entryEnd % entries.size()] = { recordFirst, count, money };
+	entryEnd++;
+	entryCursor = entryEnd;
+}
+
+bool UndoJournal::Undo(World& world, int& money) {
+	if (entryCursor == entryBegin) return false;
+
+	// Giving back the money of a sale can't make it negative
+	const Entry& entry = entries[(entryCursor - 1) % entries.size()];
+	if (entry.money > 0 && money < entry.money) return false;
+
+	const BuildingChange* entryChanges = GetChanges(entry);
+	if (!CanApply(world, entryChanges, entry.count, true)) {
+		// The world changed under the entry : the older entries can't be undone without it
+		Clear();
+		return false;
+	}
+
+	entryCursor--;
+	world.ApplyBuildingChanges(entryChanges, entry.count, true);
+	money -= entry.money;
+	return true;
+}
+
+bool UndoJournal::Redo(World& world, int& money) {
+	if (entryCursor == entryEnd) return false;
+
+	// The operation is paid again : it waits until the player has the money
+	const Entry& entry = entries[entryCursor % entries.size()];
+	if (entry.money < 0 && money < -entry.money) return false;
+
+	const BuildingChange* entryChanges = GetChanges(entry);
+	if (!CanApply(world, entryChanges, entry.count, false)) {
+		// The world changed under the entry : the next ones can't be redone without it
+		entryEnd = entryCursor;
+		return false;
+	}
+
+	entryCursor++;
+	world.ApplyBuildingChanges(entryChanges, entry.count, false);
+	money += entry.money;
+	return true;
+}
+
+void UndoJournal::Clear() {
+	changeEnd = 0;
+	entryBegin = 0;
+	entryCursor = 0;
+	entryEnd = 0;
+	recording = false;
+	overflow = false;
+}
+
+size_t UndoJournal::GetChangeCount() const {
+	if (entryEnd == entryBegin) return 0;
+	return (size_t)(changeEnd - entries[entryBegin % entries.size()].first);
+}
+
+size_t UndoJournal::GetMemoryUsage() const {
+	return changes.capacity() * sizeof(BuildingChange) + entries.capacity() * sizeof(Entry) + scratch.capacity() * sizeof(BuildingChange);
+}
+
+void UndoJournal::DropOldest() {
+	entryBegin++;
+	if (entryCursor < entryBegin) entryCursor = entryBegin;
+}
+
+const BuildingChange* UndoJournal::GetChanges(const Entry& entry) {
+	size_t start = (size_t)(entry.first % changes.size());
+	if (start + entry.count <= changes.size()) return changes.data() + start;
+
+	// The entry wraps around the ring
+	size_t firstPart = changes.size() - start;
+	scratch.assign(changes.begin() + start, changes.end());
+	scratch.insert(scratch.end(), changes.begin(), changes.begin() + (entry.count - firstPart));
+	return scratch.data();
+}
+
+bool UndoJournal::CanApply(World& world, const BuildingChange* entryChanges, size_t count, bool reverse) {
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	for (size_t i = 0; i < count; i++) {
+		const BuildingChange& change = entryChanges[i];
+		int x = (int)(change.tile % mapSize);
+		int z = (int)(change.tile / mapSize);
+		Building from = (Building)(reverse ? change.after : change.before);
+		Building to = (Building)(reverse ? change.before : change.after);
+
+		// The tile must still hold what the change replaces
+		if (world.GetBuilding(x, z) != from) return false;
+		if (to == NOTHING || from != NOTHING) continue;
+
+		// A building put back on an empty tile : the terrain must still be at its height, and the tile valid for it (water nearby, ...)
+		if (world.GetSurfaceHeight(x, z) + 1 != change.y || !world.GetPlacementMask(to).Get(x, z)) return false;
+	}
+	return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Minicraft/World.h"
+
+/// <summary>
+/// Keeps the changes made by the player to undo and redo them.
+/// An entry holds the building changes of an operation (a single tile, or a whole area) and the money it cost.
+/// Changes and entries are stored in fixed size ring buffers : the oldest entries are dropped when they are full.
+/// </summary>
+class UndoJournal {
+	struct Entry {
+		// Position of the entry's first change (wraps around the ring)
+		uint64_t first;
+		uint32_t count;
+		// Money gained by the operation (negative when it was paid)
+		int money;
+	};
+
+	std::vector<BuildingChange> changes;
+	std::vector<Entry> entries;
+	// Position after the last change written
+	uint64_t changeEnd = 0;
+	// Oldest entry kept, next entry to redo, and end of the entries
+	uint64_t entryBegin = 0;
+	uint64_t entryCursor = 0;
+	uint64_t entryEnd = 0;
+
+	// Entry being recorded
+	bool recording = false;
+	bool overflow = false;
+	uint64_t recordFirst = 0;
+
+	// Changes of the entry being undone / redone, when they wrap around the ring (grows up to the ring's size)
+	std::vector<BuildingChange> scratch;
+public:
+	/// <summary>
+	/// Creates the journal
+	/// </summary>
+	/// <param name="maxChanges">The maximum number of building changes kept</param>
+	/// <param name="maxEntries">The maximum number of entries kept</param>
+	UndoJournal(size_t maxChanges = 16384, size_t maxEntries = 256);
+
+	// Starts an entry. The entries that could be redone are dropped.
+	void Begin();
+
+	// Adds a change to the current entry
+	void Add(const BuildingChange& change);
+
+	/// <summary>
+	/// Ends the current entry. If it has more changes than the journal can hold, the whole journal is cleared.
+	/// </summary>
+	/// <param name="money">The money gained by the operation (negative when it was paid)</param>
+	void End(int money);
+
+	/// <summary>
+	/// Undoes the last entry. Nothing is done if the player couldn't give back the money of a sale.
+	/// If the world changed under the entry (a tile with another building, a sculpted terrain), the whole journal is cleared.
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="money">The player's money, the entry's money is given back</param>
+	/// <returns>False if nothing was undone</returns>
+	bool Undo(World& world, int& money);
+
+	/// <summary>
+	/// Redoes the last undone entry. Nothing is done if the player can't pay for it.
+	/// If the world changed under the entry, the entries that could be redone are dropped.
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="money">The player's money</param>
+	/// <returns>False if nothing was redone</returns>
+	bool Redo(World& world, int& money);
+
+	// Removes every entry
+	void Clear();
+
+	// Gets the number of entries that can be undone
+	size_t GetUndoCount() const { return (size_t)(entryCursor - entryBegin); }
+
+	// Gets the number of entries that can be redone
+	size_t GetRedoCount() const { return (size_t)(entryEnd - entryCursor); }
+
+	// Gets the number of building changes kept
+	size_t GetChangeCount() const;
+
+	// Gets the memory used by the journal, in bytes
+	size_t GetMemoryUsage() const;
+
+private:
+	// Drops the oldest entry
+	void DropOldest();
+
+	// Gets the changes of an entry as a contiguous array (copied in the scratch buffer if they wrap around the ring)
+	const BuildingChange* GetChanges(const Entry& entry);
+
+	/// <summary>
+	/// Checks that changes can still be applied to the world : every tile holds the building they replace,
+	/// and the buildings put back on empty tiles are at the terrain's height, on tiles valid for them.
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="entryChanges">The changes</param>
+	/// <param name="count">The number of changes</param>
+	/// <param name="reverse">Checks the changes to undo them</param>
+	/// <returns>True if the changes can be applied</returns>
+	bool CanApply(World& world, const BuildingChange* entryChanges, size_t count, bool reverse);
+};
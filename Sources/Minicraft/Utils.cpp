@@ -96,3 +96,33 @@ std::vector<std::array<int, 3>> Raycast(Vector3 pos, Vector3 dir, float maxDist)
 		[](auto& v) { return v.second; });
 	return res;
 }
+
+std::vector<std::array<int, 2>> ManhattanPath(int x0, int z0, int x1, int z1) {
+	std::vector<std::array<int, 2>> tiles;
+	tiles.reserve(abs(x1 - x0) + abs(z1 - z0) + 1);
+
+	int x = x0;
+	int z = z0;
+	tiles.push_back({ x, z });
+	if (abs(x1 - x0) >= abs(z1 - z0)) {
+		while (x != x1) tiles.push_back({ x += signInt(x1 - x0), z });
+		while (z != z1) tiles.push_back({ x, z += signInt(z1 - z0) });
+	}
+	else {
+		while (z != z1) tiles.push_back({ x, z += signInt(z1 - z0) });
+		while (x != x1) tiles.push_back({ x += signInt(x1 - x0), z });
+	}
+	return tiles;
+}
+
+std::vector<std::array<int, 2>> FilledRect(int x0, int z0, int x1, int z1) {
+	int minX = std::min(x0, x1), maxX = std::max(x0, x1);
+	int minZ = std::min(z0, z1), maxZ = std::max(z0, z1);
+
+	std::vector<std::array<int, 2>> tiles;
+	tiles.reserve((maxX - minX + 1) * (maxZ - minZ + 1));
+	for (int z = minZ; z <= maxZ; z++) {
+		for (int x = minX; x <= maxX; x++) tiles.push_back({ x, z });
+	}
+	return tiles;
+}
@@ -18,4 +18,25 @@ int signInt(int v);
 /// <param name="dir">The direction</param>
 /// <param name="maxDist">The maximum distance</param>
 /// <returns>The points used by the raycast</returns>
-std::vector<std::array<int, 3>> Raycast(Vector3 pos, Vector3 dir, float maxDist);
\ No newline at end of file
+std::vector<std::array<int, 3>> Raycast(Vector3 pos, Vector3 dir, float maxDist);
+
+/// <summary>
+/// Gets the tiles of a path between two tiles, along the longest axis first then along the other one.
+/// Consecutive tiles share a side, so that a road built on them is connected.
+/// </summary>
+/// <param name="x0">The start's X position</param>
+/// <param name="z0">The start's Z position</param>
+/// <param name="x1">The end's X position</param>
+/// <param name="z1">The end's Z position</param>
+/// <returns>The tiles, from the start to the end</returns>
+std::vector<std::array<int, 2>> ManhattanPath(int x0, int z0, int x1, int z1);
+
+/// <summary>
+/// Gets the tiles of a filled rectangle
+/// </summary>
+/// <param name="x0">The X position of a corner</param>
+/// <param name="z0">The Z position of a corner</param>
+/// <param name="x1">The X position of the opposite corner</param>
+/// <param name="z1">The Z position of the opposite corner</param>
+/// <returns>The tiles, row by row</returns>
+std::vector<std::array<int, 2>> FilledRect(int x0, int z0, int x1, int z1);
\ No newline at end of file
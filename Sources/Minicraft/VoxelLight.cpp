@@ -0,0 +1,246 @@
+#include "pch.h"
+
+#include "VoxelLight.h"
+#include "World.h"
+#include "Chunk.h"
+
+static constexpr int MAP_SIZE = CHUNK_SIZE * WORLD_SIZE;
+static constexpr int MAP_HEIGHT = CHUNK_SIZE * WORLD_HEIGHT;
+
+// Position of each channel in the light byte
+static constexpr int SKY_SHIFT = 4;
+static constexpr int BLOCK_SHIFT = 0;
+
+// The six neighbours of a cell. Index 3 is the one below.
+static constexpr int DIRECTIONS[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+// Cells are stored layer by layer, like the water levels
+static uint32_t CellIndex(int x, int y, int z) {
+	return (uint32_t)(x + z * MAP_SIZE + y * MAP_SIZE * MAP_SIZE);
+}
+
+static bool IsInMap(int x, int y, int z) {
+	return x >= 0 && y >= 0 && z >= 0 && x < MAP_SIZE && y < MAP_HEIGHT && z < MAP_SIZE;
+}
+
+// The light spreads in any chunk : the evicted ones are loaded back
+static Chunk* ChunkAt(World& world, int x, int y, int z) {
+	int idx = x / CHUNK_SIZE + (y / CHUNK_SIZE) * WORLD_SIZE + (z / CHUNK_SIZE) * WORLD_SIZE * WORLD_HEIGHT;
+	Chunk* chunk = world.chunks[idx];
+	return chunk->IsLoaded() ? chunk : world.LoadChunk(idx);
+}
+
+static uint8_t& LightAt(World& world, int x, int y, int z) {
+	return ChunkAt(world, x, y, z)->LightAt(x % CHUNK_SIZE, y % CHUNK_SIZE, z % CHUNK_SIZE);
+}
+
+static uint8_t LevelAt(World& world, int x, int y, int z, int shift) {
+	return (LightAt(world, x, y, z) >> shift) & 0xF;
+}
+
+static BlockId BlockAt(World& world, int x, int y, int z) {
+	return ChunkAt(world, x, y, z)->At(x % CHUNK_SIZE, y % CHUNK_SIZE, z % CHUNK_SIZE);
+}
+
+// Levels lost by the light going through a block, on top of the level lost per block
+static int GetAbsorption(BlockId block) {
+	return BLOCK_REGISTRY.water.Has(block) ? 1 : 0;
+}
+
+// Gets the level a cell gives to a neighbour
+static uint8_t SpreadLevel(uint8_t level, BlockId neighbour, bool down, bool sky) {
+	if (!VoxelLight::IsTransparent(neighbour)) return 0;
+	int absorption = GetAbsorption(neighbour);
+	// The sky light goes straight down through the air
+	if (sky && down && level == VoxelLight::MAX_LEVEL && absorption == 0) return level;
+	return (uint8_t)std::max(level - 1 - absorption, 0);
+}
+
+bool VoxelLight::IsTransparent(BlockId block) {
+	return BLOCK_REGISTRY.lightTransparent.Has(block);
+}
+
+uint8_t VoxelLight::GetEmission(BlockId block) {
+	return BLOCK_REGISTRY.lightSource.Has(block) ? SOURCE_LEVEL : 0;
+}
+
+void VoxelLight::Rebuild(World& world) {
+	auto start = std::chrono::steady_clock::now();
+
+	touched.clear();
+	addQueue.clear();
+	removeQueue.clear();
+	rebuilding = true;
+	for (Chunk* chunk : world.chunks) chunk->ClearLight();
+
+	// The sky lights the top layer, the flood fill brings it down the columns and under the overhangs
+	for (int z = 0; z < MAP_SIZE; z++) {
+		for (int x = 0; x < MAP_SIZE; x++) {
+			uint8_t level = SpreadLevel(MAX_LEVEL, BlockAt(world, x, MAP_HEIGHT - 1, z), true, true);
+			if (level == 0) continue;
+			SetLevel(world, x, MAP_HEIGHT - 1, z, SKY_SHIFT, level);
+			addQueue.push_back(CellIndex(x, MAP_HEIGHT - 1, z));
+		}
+	}
+	Propagate(world, SKY_SHIFT);
+
+	for (int y = 0; y < MAP_HEIGHT; y++) {
+		for (int z = 0; z < MAP_SIZE; z++) {
+			for (int x = 0; x < MAP_SIZE; x++) {
+				uint8_t emission = GetEmission(BlockAt(world, x, y, z));
+				if (emission == 0) continue;
+				SetLevel(world, x, y, z, BLOCK_SHIFT, emission);
+				addQueue.push_back(CellIndex(x, y, z));
+			}
+		}
+	}
+	Propagate(world, BLOCK_SHIFT);
+
+	// Every cell was unlit : the lit ones changed
+	rebuilding = false;
+	built = true;
+	lastChangedCount = 0;
+	for (Chunk* chunk : world.chunks) {
+		for (int lz = 0; lz < CHUNK_SIZE; lz++) {
+			for (int ly = 0; ly < CHUNK_SIZE; ly++) {
+				for (int lx = 0; lx < CHUNK_SIZE; lx++) lastChangedCount += chunk->LightAt(lx, ly, lz) != 0;
+			}
+		}
+	}
+	lastUpdateTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void VoxelLight::OnBlockChanged(World& world, int x, int y, int z, BlockId before, BlockId after) {
+	if (!built) {
+		Rebuild(world);
+		return;
+	}
+	// Most changes (stone to dirt, ...) don't change the light at all
+	if (IsTransparent(before) == IsTransparent(after) && GetAbsorption(before) == GetAbsorption(after) &&
+		GetEmission(before) == GetEmission(after)) {
+		lastChangedCount = 0;
+		lastUpdateTime = 0;
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	uint32_t cell = CellIndex(x, y, z);
+	for (int shift : { SKY_SHIFT, BLOCK_SHIFT }) {
+		// The light the cell was giving is removed...
+		uint8_t level = LevelAt(world, x, y, z, shift);
+		if (level > 0) {
+			SetLevel(world, x, y, z, shift, 0);
+			removeQueue.push_back({ cell, level });
+			Unpropagate(world, shift);
+		}
+
+		// ...then the cell is lit again by its own light and its neighbours
+		uint8_t own = shift == SKY_SHIFT
+			? (y == MAP_HEIGHT - 1 ? SpreadLevel(MAX_LEVEL, after, true, true) : 0)
+			: GetEmission(after);
+		if (own > LevelAt(world, x, y, z, shift)) {
+			SetLevel(world, x, y, z, shift, own);
+			addQueue.push_back(cell);
+		}
+		for (const auto& dir : DIRECTIONS) {
+			int nx = x + dir[0], ny = y + dir[1], nz = z + dir[2];
+			if (IsInMap(nx, ny, nz) && LevelAt(world, nx, ny, nz, shift) > 0) addQueue.push_back(CellIndex(nx, ny, nz));
+		}
+		Propagate(world, shift);
+	}
+
+	FlushTouched(world);
+	lastUpdateTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void VoxelLight::Propagate(World& world, int shift) {
+	bool sky = shift == SKY_SHIFT;
+
+	// The queue grows while it is read : it is a FIFO, so every cell is reached by its highest level first
+	for (size_t i = 0; i < addQueue.size(); i++) {
+		uint32_t cell = addQueue[i];
+		int x = cell % MAP_SIZE;
+		int z = (cell / MAP_SIZE) % MAP_SIZE;
+		int y = cell / (MAP_SIZE * MAP_SIZE);
+
+		uint8_t level = LevelAt(world, x, y, z, shift);
+		if (level <= 1) continue;
+
+		for (int d = 0; d < 6; d++) {
+			int nx = x + DIRECTIONS[d][0], ny = y + DIRECTIONS[d][1], nz = z + DIRECTIONS[d][2];
+			if (!IsInMap(nx, ny, nz)) continue;
+
+			uint8_t next = SpreadLevel(level, BlockAt(world, nx, ny, nz), d == 3, sky);
+			if (next <= LevelAt(world, nx, ny, nz, shift)) continue;
+			SetLevel(world, nx, ny, nz, shift, next);
+			addQueue.push_back(CellIndex(nx, ny, nz));
+		}
+	}
+	addQueue.clear();
+}
+
+void VoxelLight::Unpropagate(World& world, int shift) {
+	bool sky = shift == SKY_SHIFT;
+
+	for (size_t i = 0; i < removeQueue.size(); i++) {
+		RemovedCell removed = removeQueue[i];
+		int x = removed.cell % MAP_SIZE;
+		int z = (removed.cell / MAP_SIZE) % MAP_SIZE;
+		int y = removed.cell / (MAP_SIZE * MAP_SIZE);
+
+		for (int d = 0; d < 6; d++) {
+			int nx = x + DIRECTIONS[d][0], ny = y + DIRECTIONS[d][1], nz = z + DIRECTIONS[d][2];
+			if (!IsInMap(nx, ny, nz)) continue;
+
+			uint8_t level = LevelAt(world, nx, ny, nz, shift);
+			if (level == 0) continue;
+
+			// A lower level may come from the removed cell (so may the full sky level below it) : it is removed too.
+			// A neighbour at least as bright is lit from elsewhere, and lights the removed cells again.
+			bool dependent = level < removed.level || (sky && d == 3 && removed.level == MAX_LEVEL && level == MAX_LEVEL);
+			if (!dependent) {
+				addQueue.push_back(CellIndex(nx, ny, nz));
+				continue;
+			}
+
+			SetLevel(world, nx, ny, nz, shift, 0);
+			removeQueue.push_back({ CellIndex(nx, ny, nz), level });
+
+			uint8_t emission = sky ? 0 : GetEmission(BlockAt(world, nx, ny, nz));
+			if (emission > 0) {
+				SetLevel(world, nx, ny, nz, shift, emission);
+				addQueue.push_back(CellIndex(nx, ny, nz));
+			}
+		}
+	}
+	removeQueue.clear();
+}
+
+void VoxelLight::SetLevel(World& world, int x, int y, int z, int shift, uint8_t level) {
+	uint8_t& light = LightAt(world, x, y, z);
+	if (!rebuilding) touched.push_back({ CellIndex(x, y, z), light });
+	light = (uint8_t)((light & ~(0xF << shift)) | (level << shift));
+}
+
+void VoxelLight::FlushTouched(World& world) {
+	// The entries of a cell end up together, the first one first
+	std::stable_sort(touched.begin(), touched.end(), [](const TouchedCell& a, const TouchedCell& b) { return a.cell < b.cell; });
+
+	lastChangedCount = 0;
+	for (size_t i = 0; i < touched.size(); i++) {
+		const TouchedCell& cell = touched[i];
+		if (i > 0 && touched[i - 1].cell == cell.cell) continue;
+
+		int x = cell.cell % MAP_SIZE;
+		int z = (cell.cell / MAP_SIZE) % MAP_SIZE;
+		int y = cell.cell / (MAP_SIZE * MAP_SIZE);
+		// A cell removed then lit again to the same light didn't change
+		if (LightAt(world, x, y, z) == cell.light) continue;
+		lastChangedCount++;
+
+		// The faces lit by a cell are the ones of its neighbours : they belong to the neighbour sections on the borders
+		world.MarkFacesDirty(x, y, z);
+	}
+	touched.clear();
+}
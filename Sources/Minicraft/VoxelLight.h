@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Minicraft/Block.h"
+
+class World;
+
+/// <summary>
+/// Propagates the light of the sky and of the light sources (the blocks with BF_LIGHT_SOURCE) through the blocks, by flood fill.
+/// Every block has a sky level and a block level (0 - 15), packed as two nibbles in the chunks (see Chunk::LightAt).
+/// The sky light goes down without losing any level, the light loses a level per block otherwise (more through water).
+/// A change of block only updates the cells around it : the light it was giving is removed, then the light around it spreads again.
+/// The chunk sections are marked for the remeshing only when a cell's light really changed.
+/// </summary>
+class VoxelLight {
+public:
+	// Level of the sky, and of the cells it reaches straight down
+	static constexpr uint8_t MAX_LEVEL = 15;
+	// Level of the light sources
+	static constexpr uint8_t SOURCE_LEVEL = 14;
+
+private:
+	// A cell whose light was removed, with the level it had
+	struct RemovedCell {
+		uint32_t cell;
+		uint8_t level;
+	};
+	// A cell changed by the current update, with the light it had before
+	struct TouchedCell {
+		uint32_t cell;
+		uint8_t light;
+	};
+
+	// Cells whose light spreads to their neighbours
+	std::vector<uint32_t> addQueue;
+	std::vector<RemovedCell> removeQueue;
+	// Cells changed by the current update, once per change : the first entry of a cell has the light it had before.
+	// Sized to the update, not to the world.
+	std::vector<TouchedCell> touched;
+
+	// The light was computed once : the updates start from it
+	bool built = false;
+	// A rebuild is setting the levels : every lit cell changes, they aren't listed
+	bool rebuilding = false;
+
+	// Stats of the last update
+	size_t lastChangedCount = 0;
+	float lastUpdateTime = 0;
+public:
+	/// <summary>
+	/// Computes the light of the whole world from the blocks. The chunks aren't marked : the caller remeshes them.
+	/// Only called once every chunk was written (a generation, a load) : the chunks are all in memory, the light loads none.
+	/// </summary>
+	/// <param name="world">The world</param>
+	void Rebuild(World& world);
+
+	/// <summary>
+	/// Updates the light around a changed block
+	/// </summary>
+	/// <param name="world">The world, with the new block</param>
+	/// <param name="x">The block's X position</param>
+	/// <param name="y">The block's Y position</param>
+	/// <param name="z">The block's Z position</param>
+	/// <param name="before">The block's previous ID</param>
+	/// <param name="after">The block's new ID</param>
+	void OnBlockChanged(World& world, int x, int y, int z, BlockId before, BlockId after);
+
+	// Gets the number of cells whose light changed during the last update (or rebuild)
+	size_t GetLastChangedCount() const { return lastChangedCount; }
+
+	// Gets the duration of the last update (or rebuild), in milliseconds
+	float GetLastUpdateTime() const { return lastUpdateTime; }
+
+	// True if the light goes through a block
+	static bool IsTransparent(BlockId block);
+
+	// Gets the level of block light a block gives
+	static uint8_t GetEmission(BlockId block);
+
+private:
+	/// <summary>
+	/// Spreads the light of the queued cells
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="shift">The channel's position in the light byte (4 for the sky, 0 for the blocks)</param>
+	void Propagate(World& world, int shift);
+
+	/// <summary>
+	/// Removes the light that came from the removed cells. The cells lit from elsewhere are queued to spread their light again.
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="shift">The channel's position in the light byte (4 for the sky, 0 for the blocks)</param>
+	void Unpropagate(World& world, int shift);
+
+	// Changes a channel of a cell, remembering its previous light
+	void SetLevel(World& world, int x, int y, int z, int shift, uint8_t level);
+
+	// Counts the cells whose light changed, marks their sections for the remeshing, and forgets them
+	void FlushTouched(World& world);
+};
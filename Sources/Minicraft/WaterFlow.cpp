@@ -0,0 +1,185 @@
+#include "pch.h"
+
+#include "Engine/JobSystem.h"
+#include "WaterFlow.h"
+#include "World.h"
+#include "Chunk.h"
+
+static constexpr int MAP_SIZE = CHUNK_SIZE * WORLD_SIZE;
+static constexpr int MAP_HEIGHT = CHUNK_SIZE * WORLD_HEIGHT;
+
+// Cells are stored layer by layer
+static uint32_t CellIndex(int x, int y, int z) {
+	return (uint32_t)(x + z * MAP_SIZE + y * MAP_SIZE * MAP_SIZE);
+}
+
+static int ChunkIndex(int x, int y, int z) {
+	return x / CHUNK_SIZE + (y / CHUNK_SIZE) * WORLD_SIZE + (z / CHUNK_SIZE) * WORLD_SIZE * WORLD_HEIGHT;
+}
+
+// Index of a cell in the levels of its chunk, as the blocks
+static int LocalIndex(int x, int y, int z) {
+	return x % CHUNK_SIZE + (y % CHUNK_SIZE) * CHUNK_SIZE + (z % CHUNK_SIZE) * CHUNK_SIZE * CHUNK_SIZE;
+}
+
+// True if water can go in a block (air, or water)
+static bool IsOpen(BlockId block) {
+	return block == EMPTY || BLOCK_REGISTRY.water.Has(block);
+}
+
+void WaterFlow::OnBlockChanged(World& world, int x, int y, int z, BlockId block) {
+	if (needRebuild) return;
+
+	if (!applying) {
+		PrepareChunk(world, ChunkIndex(x, y, z));
+		if (!(BlockData::Get(block).flags & BF_GRAVITY_WATER)) SetLevel(world, x, y, z, 0);
+		else if (GetLevel(world, x, y, z) == 0) SetLevel(world, x, y, z, SOURCE_LEVEL);
+	}
+	Activate(x, y, z);
+}
+
+void WaterFlow::Step(World& world) {
+	// The chunks read their levels again as the flow reaches them : nothing flows until a block changes
+	if (needRebuild) {
+		version++;
+		active.clear();
+		nextActive.clear();
+		needRebuild = false;
+	}
+
+	// The cells queued during the last step are updated now, once each
+	std::swap(active, nextActive);
+	nextActive.clear();
+	std::sort(active.begin(), active.end());
+	active.erase(std::unique(active.begin(), active.end()), active.end());
+	if (active.empty()) return;
+
+	// The jobs read the levels around the cells, and the blocks of the cells and of the cells under their neighbours :
+	// their chunks are prepared first, on this thread. The cells are sorted : the ones of a chunk follow each other.
+	int lastKey = -1;
+	for (uint32_t cell : active) {
+		int x = cell % MAP_SIZE;
+		int z = (cell / MAP_SIZE) % MAP_SIZE;
+		int y = cell / (MAP_SIZE * MAP_SIZE);
+		bool bottom = y > 0 && y % CHUNK_SIZE == 0;
+		int key = ChunkIndex(x, y, z) * 2 + bottom;
+		if (key == lastKey) continue;
+		lastKey = key;
+		PrepareChunksAround(world, x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE);
+		if (bottom) world.LoadChunksAround(x / CHUNK_SIZE, (y - 1) / CHUNK_SIZE, z / CHUNK_SIZE);
+	}
+
+	// Every new level is computed from the current levels only, so the cells can be split between the workers
+	results.resize(active.size());
+	JobSystem::Get()->ParallelFor((int)active.size(), 256, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			uint32_t cell = active[i];
+			int x = cell % MAP_SIZE;
+			int z = (cell / MAP_SIZE) % MAP_SIZE;
+			int y = cell / (MAP_SIZE * MAP_SIZE);
+			results[i] = ComputeLevel(world, x, y, z);
+		}
+	});
+
+	applying = true;
+	for (size_t i = 0; i < active.size(); i++) {
+		uint32_t cell = active[i];
+		int x = cell % MAP_SIZE;
+		int z = (cell / MAP_SIZE) % MAP_SIZE;
+		int y = cell / (MAP_SIZE * MAP_SIZE);
+		uint8_t level = GetLevel(world, x, y, z);
+		if (results[i] == level) continue;
+
+		bool hadWater = level > 0;
+		SetLevel(world, x, y, z, results[i]);
+
+		if (hadWater != (results[i] > 0)) {
+			// SetBlock activates the neighbours through OnBlockChanged
+			world.SetBlock(x, y, z, results[i] > 0 ? WATER : EMPTY);
+			world.placementMask.UpdateColumn(world, x, z);
+		}
+		else Activate(x, y, z);
+	}
+	applying = false;
+}
+
+Chunk* WaterFlow::PrepareChunk(World& world, int idx) {
+	Chunk* chunk = world.LoadChunk(idx);
+	if (chunk->waterVersion == version) return chunk;
+
+	// Every water block is a source. The chunks without water (most of them, from their columns) keep no levels.
+	chunk->waterLevels.reset();
+	chunk->waterVersion = version;
+	chunk->waterChanged = true;
+	bool hasWater = false;
+	for (uint16_t column : chunk->waterColumns) hasWater |= column != 0;
+	if (!hasWater) return chunk;
+
+	chunk->waterLevels = std::make_unique<uint8_t[]>(Chunk::BLOCK_COUNT);
+	for (int i = 0; i < Chunk::BLOCK_COUNT; i++) {
+		if (BlockData::Get(chunk->data[i]).flags & BF_GRAVITY_WATER) chunk->waterLevels[i] = SOURCE_LEVEL;
+	}
+	return chunk;
+}
+
+void WaterFlow::PrepareChunksAround(World& world, int cx, int cy, int cz) {
+	static const int offsets[7][3] = { { 0, 0, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+	for (const auto& offset : offsets) {
+		int x = cx + offset[0], y = cy + offset[1], z = cz + offset[2];
+		if (x < 0 || y < 0 || z < 0 || x >= WORLD_SIZE || y >= WORLD_HEIGHT || z >= WORLD_SIZE) continue;
+		PrepareChunk(world, x + y * WORLD_SIZE + z * WORLD_SIZE * WORLD_HEIGHT);
+	}
+}
+
+uint8_t WaterFlow::GetLevel(World& world, int x, int y, int z) {
+	const Chunk* chunk = world.chunks[ChunkIndex(x, y, z)];
+	return chunk->waterLevels ? chunk->waterLevels[LocalIndex(x, y, z)] : 0;
+}
+
+void WaterFlow::SetLevel(World& world, int x, int y, int z, uint8_t level) {
+	Chunk* chunk = PrepareChunk(world, ChunkIndex(x, y, z));
+	if (!chunk->waterLevels) {
+		if (level == 0) return;
+		chunk->waterLevels = std::make_unique<uint8_t[]>(Chunk::BLOCK_COUNT);
+	}
+	chunk->waterLevels[LocalIndex(x, y, z)] = level;
+	chunk->waterChanged = true;
+}
+
+void WaterFlow::Activate(int x, int y, int z) {
+	auto queue = [this](int x, int y, int z) {
+		if (x < 0 || y < 0 || z < 0 || x >= MAP_SIZE || y >= MAP_HEIGHT || z >= MAP_SIZE) return;
+		nextActive.push_back(CellIndex(x, y, z));
+	};
+	queue(x, y, z);
+	queue(x - 1, y, z);
+	queue(x + 1, y, z);
+	queue(x, y - 1, z);
+	queue(x, y + 1, z);
+	queue(x, y, z - 1);
+	queue(x, y, z + 1);
+}
+
+uint8_t WaterFlow::ComputeLevel(World& world, int x, int y, int z) {
+	uint8_t level = GetLevel(world, x, y, z);
+	if (level == SOURCE_LEVEL) return level;
+	if (!IsOpen(*world.GetCube(x, y, z))) return 0;
+
+	// Water falls from the cell above
+	if (y + 1 < MAP_HEIGHT && GetLevel(world, x, y + 1, z) > 0) return FALLING_LEVEL;
+
+	// Or spreads from a neighbour lying on something (ground, or water)
+	uint8_t best = 0;
+	auto spread = [&](int nx, int nz) {
+		if (nx < 0 || nz < 0 || nx >= MAP_SIZE || nz >= MAP_SIZE) return;
+		uint8_t neighbour = GetLevel(world, nx, y, nz);
+		if (neighbour <= 1) return;
+		if (y > 0 && *world.GetCube(nx, y - 1, nz) == EMPTY) return;
+		best = std::max<uint8_t>(best, neighbour == SOURCE_LEVEL ? FALLING_LEVEL : neighbour - 1);
+	};
+	spread(x - 1, z);
+	spread(x + 1, z);
+	spread(x, z - 1);
+	spread(x, z + 1);
+	return best;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Minicraft/Block.h"
+
+class World;
+class Chunk;
+
+/// <summary>
+/// Simulates the flow of water (the blocks with BF_GRAVITY_WATER) as a cellular automaton on water levels.
+/// Source cells keep their level, the other cells take the level the water above or next to them gives them :
+/// water falls down, and spreads sideways on solid ground, losing a level per cell.
+/// Only the active cells (the ones next to a change) are updated, so a step costs the size of the moving front.
+/// The levels are kept by the chunks, with their blocks (see Chunk::waterLevels) : the chunks without water have none,
+/// and the evicted ones take theirs along. After a reset, a chunk reads its levels from its blocks when the flow next reaches it.
+/// </summary>
+class WaterFlow {
+public:
+	// Level of the source cells (placed by the generators and the water brush)
+	static constexpr uint8_t SOURCE_LEVEL = 8;
+	// Level of the water falling from above
+	static constexpr uint8_t FALLING_LEVEL = 7;
+
+private:
+	// Cells to update in this step and the next one. A cell can be queued several times : a step updates it once.
+	std::vector<uint32_t> active;
+	std::vector<uint32_t> nextActive;
+	// New levels of the active cells
+	std::vector<uint8_t> results;
+
+	// Version of the levels : the chunks with levels of another version read them again from their blocks
+	uint32_t version = 0;
+	// The levels must be read again from the blocks
+	bool needRebuild = true;
+	// A step is applying its results (the blocks it changes are its own)
+	bool applying = false;
+public:
+	// The levels will be read again from the blocks from the next step (every water block becomes a source)
+	void Reset() { needRebuild = true; }
+
+	/// <summary>
+	/// Tells the simulation that a block changed : a new water block is a source, and the cells around it are activated
+	/// </summary>
+	/// <param name="world">The world, with the new block</param>
+	/// <param name="x">The block's X position</param>
+	/// <param name="y">The block's Y position</param>
+	/// <param name="z">The block's Z position</param>
+	/// <param name="block">The block's new ID</param>
+	void OnBlockChanged(World& world, int x, int y, int z, BlockId block);
+
+	/// <summary>
+	/// Updates the active cells once. The new levels are computed in parallel from the current ones, then applied.
+	/// </summary>
+	/// <param name="world">The world</param>
+	void Step(World& world);
+
+	// Gets the number of cells queued for the next step (a cell queued twice counts twice)
+	size_t GetActiveCount() const { return nextActive.size(); }
+
+private:
+	// Loads a chunk, and reads its levels from its blocks if they are of another version. Only on the main thread.
+	Chunk* PrepareChunk(World& world, int idx);
+
+	// Prepares a chunk and its six neighbours, so that the levels around the chunk can be read from the jobs
+	void PrepareChunksAround(World& world, int cx, int cy, int cz);
+
+	// Gets the level of a cell, in a prepared chunk
+	static uint8_t GetLevel(World& world, int x, int y, int z);
+
+	// Changes the level of a cell. Only on the main thread.
+	void SetLevel(World& world, int x, int y, int z, uint8_t level);
+
+	// Queues a cell and its neighbours for the next step
+	void Activate(int x, int y, int z);
+
+	// Computes the new level of a cell
+	uint8_t ComputeLevel(World& world, int x, int y, int z);
+};
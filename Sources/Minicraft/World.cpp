@@ -1,14 +1,19 @@
 #include "pch.h"
 
+#include "Engine/BinaryStream.h"
 #include "Engine/DefaultResources.h"
+#include "Engine/JobSystem.h"
+#include "Engine/RegionFile.h"
 #include "World.h"
-#include "PerlinNoise.hpp"
-#include "iostream"
-#include "fstream"
-#include "sstream"
+#include "NoiseField.h"
+#include "Tilemap.h"
+#include "WorldCache.h"
 #include "Chunk.h"
 #include "Cube3D.h"
 
+// Ticks between two steps of the water flow
+static constexpr int WATER_TICK_INTERVAL = 6;
+
 World::World() {
 
 	// Generate empty world
@@ -37,6 +42,7 @@ World::World() {
 	for (int x = 0; x < WORLD_SIZE * CHUNK_SIZE * WORLD_SIZE * CHUNK_SIZE; x++) {
 		buildings[x] = NOTHING;
 	}
+	MarkBuildingPagesDirty();
 
 	// Generate building datas
 
@@ -84,6 +90,8 @@ World::World() {
 }
 
 World::~World() {
+	// The LOD jobs write in the chunks
+	JobSystem::Get()->Wait(&lodJobs);
 	for (int idx = 0; idx < WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT; idx++) {
 		delete chunks[idx];
 		chunks[idx] = nullptr;
@@ -94,145 +102,300 @@ void World::Generate(DeviceResources* deviceRes,int seed, float treeThreshold) {
 	
 	this->deviceRes = deviceRes;
 
-	Reset();
+	float scale = WORLD_SIZE * CHUNK_SIZE / 2.5;
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
 
-	siv::BasicPerlinNoise<float> perlin(seed);
-	float noiseValue;
-	int yMax;
+	// Noise fields are only sampled again when their settings change
+	const NoiseField& heightField = noiseFields.Get({ seed, scale, 1.0f, 1, 0.5f, mapSize, mapSize });
 
-	float treeNoiseValue;
+	bool terrainChanged = terrainVersion != heightField.version;
+	if (!terrainChanged) {
+		// Same terrain as the current one, not changed since (only the threshold changed) : only the trees need to be placed again.
+		// The simulation starts over as after a full generation, so that a replay gives the same state either way.
+		ResetBuildings();
+		water.Reset();
+		tickCount = 0;
+	}
+	else {
+		Reset();
+
+		// Each job generates a column of chunks and writes directly in their storage.
+		// Columns don't share any block, so the result is the same whatever the number of threads.
+		JobSystem::Get()->ParallelFor(WORLD_SIZE * WORLD_SIZE, 1, [&](int begin, int end) {
+			for (int column = begin; column < end; column++) {
+				int cx = column % WORLD_SIZE;
+				int cz = column / WORLD_SIZE;
+
+				Chunk* columnChunks[WORLD_HEIGHT];
+				for (int cy = 0; cy < WORLD_HEIGHT; cy++) columnChunks[cy] = GetChunk(cx, cy, cz);
+
+				for (int lx = 0; lx < CHUNK_SIZE; lx++) {
+					for (int lz = 0; lz < CHUNK_SIZE; lz++) {
+						int yMax = (int)(heightField.Get(cx * CHUNK_SIZE + lx, cz * CHUNK_SIZE + lz) * 6);
+
+						// 0 = Sand
+						// 1 - 2 = Grass
+						// 3 - 4 = Rocks
+						// If y == 0, then there will be water at (x,1,z)
+
+						if (yMax <= 1) {
+							columnChunks[0]->At(lx, 1, lz) = WATER;
+							columnChunks[0]->At(lx, 0, lz) = SAND;
+							continue;
+						}
 
-	float scale = WORLD_SIZE * CHUNK_SIZE / 2.5;
+						for (int y = 0; y < yMax && y < 7; y++) {
+							BlockId& block = columnChunks[y / CHUNK_SIZE]->At(lx, y % CHUNK_SIZE, lz);
+
+							if (y == 0) {
+								block = SAND;
+							}
+							else {
+								block = y < 3 ? GRASS : STONE;
+							}
+						}
+					}
+				}
+			}
+		});
+	}
+
+	// Classification pass for the trees, in chunk-column order
+	const NoiseField& treeField = noiseFields.Get({ seed, scale, 2.0f, 1, 0.5f, mapSize, mapSize });
+	std::vector<Vector3> trees;
+
+	for (int column = 0; column < WORLD_SIZE * WORLD_SIZE; column++) {
+		int cx = column % WORLD_SIZE;
+		int cz = column / WORLD_SIZE;
+		for (int x = cx * CHUNK_SIZE; x < (cx + 1) * CHUNK_SIZE; x++) {
+			for (int z = cz * CHUNK_SIZE; z < (cz + 1) * CHUNK_SIZE; z++) {
+				int yMax = (int)(heightField.Get(x, z) * 6);
+				if (yMax > 1 && treeField.Get(x, z) <= treeThreshold && yMax <= 3) {
+					// Place tree
+					trees.push_back(Vector3(x, yMax, z));
+				}
+			}
+		}
+	}
+	PlaceBuildings(TREE, trees);
 
+	if (terrainChanged) {
+		terrainVersion = heightField.version;
+		Create(deviceRes);
+	}
+}
 
-	for (int x = 0; x < CHUNK_SIZE * WORLD_SIZE; x++) {
-		for (int z = 0; z < CHUNK_SIZE * WORLD_SIZE; z++) {
-			// Sample noise
-			noiseValue = (perlin.noise2D(x / scale, z / scale) + 1) / 2;
-			treeNoiseValue = (perlin.noise2D(x / scale * 2, z / scale * 2) + 1) / 2;
-			yMax = (int)(noiseValue * 6);
+/// <summary>
+/// Reads the layers of a TMX map :
+/// - "Terrain" (or the first other layer) : the height of the tiles, like the CSV files
+/// - "Buildings" (optional) : the tile's id is the building (see Building)
+/// - "Trees" and "Roads" (optional) : any tile is a tree / a road
+/// When several layers have something on the same tile, the last one wins.
+/// </summary>
+/// <param name="map">The map</param>
+/// <param name="terrain">The terrain's tiles</param>
+/// <param name="mapBuildings">The building of every tile</param>
+/// <param name="hasTrees">True if the trees come from the map</param>
+/// <param name="error">The error, if the map isn't valid</param>
+/// <returns>True if the map is valid</returns>
+static bool ReadTmxLayers(const TmxMap& map, Tilemap& terrain, std::vector<Building>& mapBuildings, bool& hasTrees, std::string& error)
+{
+	static const char* buildingLayers[] = { "Buildings", "Trees", "Roads" };
+
+	const TmxLayer* terrainLayer = map.FindLayer("Terrain");
+	for (const TmxLayer& layer : map.layers) {
+		if (terrainLayer) break;
+		bool isBuildingLayer = false;
+		for (const char* name : buildingLayers) isBuildingLayer |= map.FindLayer(name) == &layer;
+		if (!isBuildingLayer) terrainLayer = &layer;
+	}
+	if (!terrainLayer) {
+		error = "The map doesn't have a terrain layer";
+		return false;
+	}
 
-			// 0 = Sand
-			// 1 - 2 = Grass
-			// 3 - 4 = Rocks
-			// If y == 0, then there will be water at (x,1,z)
+	// Empty tiles are flat ground
+	terrain = terrainLayer->tiles;
+	for (int& tile : terrain.tiles) tile = std::max(tile, 0);
 
-			if (yMax <= 1 ) {
-				auto block = GetCube(x, 1, z);
-				*block = WATER;
+	mapBuildings.assign(terrain.tiles.size(), NOTHING);
+	hasTrees = map.FindLayer("Trees") != nullptr;
 
-				block = GetCube(x, 0, z);
-				*block = SAND;
-				continue;
-			}
+	for (const TmxLayer& layer : map.layers) {
+		Building layerBuilding;
+		if (&layer == map.FindLayer("Buildings")) layerBuilding = NOTHING;
+		else if (&layer == map.FindLayer("Trees")) layerBuilding = TREE;
+		else if (&layer == map.FindLayer("Roads")) layerBuilding = ROAD;
+		else continue;
 
-			for (int y = 0; y < yMax && y < 7; y++) {
-				auto block = GetCube(x, y, z);
+		for (size_t i = 0; i < layer.tiles.tiles.size(); i++) {
+			int tile = layer.tiles.tiles[i];
+			if (tile < 0) continue;
 
-				if (y == 0) {
-					*block = SAND;
-				}
-				else {
-					*block = y < 3 ? GRASS : STONE;
-				}
+			if (layerBuilding != NOTHING) {
+				mapBuildings[i] = layerBuilding;
 			}
-
-			if (treeNoiseValue <= treeThreshold && yMax <= 3) {
-				// Place tree
-				PlaceBuilding(TREE, x,yMax, z);
+			else if (tile > NOTHING && tile <= ROAD) {
+				mapBuildings[i] = (Building)tile;
+				hasTrees |= tile == TREE;
+			}
+			else if (tile != NOTHING) {
+				error = "Unknown building " + std::to_string(tile) + " in layer " + layer.name +
+					" at (" + std::to_string(i % layer.tiles.width) + ", " + std::to_string(i / layer.tiles.width) + ")";
+				return false;
 			}
 		}
 	}
-
-	Create(deviceRes);
+	return true;
 }
 
-void World::GenerateFromFile(DeviceResources* deviceRes, std::wstring filePath, float treeThreshold)
+bool World::GenerateFromFile(DeviceResources* deviceRes, std::wstring filePath, float treeThreshold)
 {
 	this->deviceRes = deviceRes;
 
-	Reset();
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
 
-	// The seed is generated from the filename
+	// The seed is generated from the filename, unless the map has a "seed" property
 	int treeSeed = 0;
 	for (int i = 0; i < filePath.size(); i++) {
 		treeSeed += filePath.c_str()[i];
 	}
 
-	siv::BasicPerlinNoise<float> perlin(treeSeed);
-	float treeNoiseValue;
-	float scale = WORLD_SIZE * CHUNK_SIZE / 2.5;
+	// The file is loaded before touching the world, so that a bad file leaves it as it was.
+	// The TMX map is used if there is one, the exported CSV otherwise.
+	Tilemap tilemap;
+	std::vector<Building> mapBuildings;
+	bool hasTrees = false;
+	TilemapError error;
+
+	std::wstring tmxPath = std::wstring(L"Tilemap/") + filePath + L".tmx";
+	std::wstring csvPath = std::wstring(L"Tilemap/") + filePath + L".csv";
+	bool isTmx = GetFileAttributesW(tmxPath.c_str()) != INVALID_FILE_ATTRIBUTES;
+
+	// The compiled map is used if it was made from the same file and threshold
+	WorldCacheKey cacheKey;
+	bool hasCacheKey = WorldCacheKey::FromFile(isTmx ? tmxPath : csvPath, treeThreshold, cacheKey);
+	if (hasCacheKey && WorldCache::Load(*this, WorldCache::GetPath(filePath), cacheKey)) {
+		loadError.clear();
+		terrainVersion = 0;
+		return true;
+	}
 
+	if (isTmx) {
+		TmxMap map;
+		if (!LoadTmxMap(tmxPath, map, error)) {
+			loadError = error.ToString();
+			return false;
+		}
+		if (!ReadTmxLayers(map, tilemap, mapBuildings, hasTrees, loadError)) return false;
 
-	std::fstream fin;
-	std::wstring file = std::wstring(L"Tilemap/") + filePath + L".csv";
-
-	fin.open(file.c_str(), std::ios::in);
-	std::string line, word;
-	int x = 0;
-	int y = 0;
-	int xInChunck = 0;
-	int yInChunck = 0;
-	int yMax;
-	int value;
-	BlockData dataSand = BlockData::Get(SAND);
-	BlockData dataGrass = BlockData::Get(GRASS);
-	BlockData dataMountain = BlockData::Get(STONE);
-
-	while (getline(fin, line))
-	{
-		x = 0;
-		std::stringstream s(line);
-
-		while (getline(s, word, ','))
-		{
-			value = atoi(word.c_str());
-			// Sample tree noise
-			treeNoiseValue = (perlin.noise2D(x / scale * 2, y / scale * 2) + 1) / 2;
-
-			auto block = GetCube(x, 0, y);
-			*block = SAND;
-
-			switch (value) {
-			case 1:
-				yMax = 0;
-				break;
-			case 0:
-				yMax = 1;
-				break;
-			default:
-				yMax = value;
-				break;
+		if (const std::string* seed = map.FindProperty("seed")) {
+			auto [next, ec] = std::from_chars(seed->data(), seed->data() + seed->size(), treeSeed);
+			if (ec != std::errc()) {
+				loadError = "The seed property isn't a number";
+				return false;
 			}
+		}
+	}
+	else if (!LoadCsvTilemap(csvPath, tilemap, error)) {
+		loadError = error.ToString();
+		return false;
+	}
 
-			for (int up = 1; up <= yMax; up++) {
-				auto block = GetCube(x, up, y);
-				*block = up < 3 ? GRASS : STONE;
-			}
+	if (tilemap.width > mapSize || tilemap.height > mapSize) {
+		loadError = "The tilemap is " + std::to_string(tilemap.width) + "x" + std::to_string(tilemap.height) +
+			", the world is only " + std::to_string(mapSize) + "x" + std::to_string(mapSize);
+		return false;
+	}
+	loadError.clear();
+
+	Reset();
 
-			if (yMax == 0) {
-				// Add water
-				auto block = GetCube(x, 1, y);
-				*block = WATER;
+	float scale = WORLD_SIZE * CHUNK_SIZE / 2.5;
+	const NoiseField& treeField = noiseFields.Get({ treeSeed, scale, 2.0f, 1, 0.5f, mapSize, mapSize });
+
+	// The terrain doesn't come from a height field anymore
+	terrainVersion = 0;
+
+	// Height of a tile :
+	// 1 = Water (yMax = 0)
+	// 0 = Flat ground (yMax = 1)
+	// Other values = The height
+	auto getHeight = [&](int x, int z) {
+		int value = tilemap.Get(x, z);
+		return value == 1 ? 0 : value == 0 ? 1 : value;
+	};
+
+	// Same as the procedural generator : one job per chunk column
+	JobSystem::Get()->ParallelFor(WORLD_SIZE * WORLD_SIZE, 1, [&](int begin, int end) {
+		for (int column = begin; column < end; column++) {
+			int cx = column % WORLD_SIZE;
+			int cz = column / WORLD_SIZE;
+
+			Chunk* columnChunks[WORLD_HEIGHT];
+			for (int cy = 0; cy < WORLD_HEIGHT; cy++) columnChunks[cy] = GetChunk(cx, cy, cz);
+
+			for (int lx = 0; lx < CHUNK_SIZE; lx++) {
+				int x = cx * CHUNK_SIZE + lx;
+				if (x >= tilemap.width) break;
+
+				for (int lz = 0; lz < CHUNK_SIZE; lz++) {
+					int z = cz * CHUNK_SIZE + lz;
+					if (z >= tilemap.height) break;
+
+					int yMax = std::min(getHeight(x, z), CHUNK_SIZE * WORLD_HEIGHT - 1);
+
+					columnChunks[0]->At(lx, 0, lz) = SAND;
+					for (int up = 1; up <= yMax; up++) {
+						columnChunks[up / CHUNK_SIZE]->At(lx, up % CHUNK_SIZE, lz) = up < 3 ? GRASS : STONE;
+					}
+
+					if (yMax == 0) {
+						// Add water
+						columnChunks[0]->At(lx, 1, lz) = WATER;
+					}
+				}
 			}
-			else if(treeNoiseValue <= treeThreshold && yMax <= 2) {
+		}
+	});
+
+	// Buildings of the map, then the generated trees if the map doesn't have any, in the file's order.
+	// Everything is placed in one batch per building type.
+	std::vector<Vector3> positions[ROAD + 1];
+	for (int z = 0; z < tilemap.height; z++) {
+		for (int x = 0; x < tilemap.width; x++) {
+			int yMax = getHeight(x, z);
+			// Nothing can be built on water
+			if (yMax == 0) continue;
+
+			Building type = mapBuildings.empty() ? NOTHING : mapBuildings[x + z * tilemap.width];
+			if (type == NOTHING && !hasTrees && treeField.Get(x, z) <= treeThreshold && yMax <= 2) {
 				// Place tree
-				PlaceBuilding(TREE, x, yMax+1, y);
+				type = TREE;
 			}
-
-			x++;
+			if (type != NOTHING) positions[type].push_back(Vector3(x, yMax + 1, z));
 		}
-
-		y++;
+	}
+	// Every type is placed, so that the buildings of the previous map aren't drawn anymore
+	for (int type = TREE; type <= ROAD; type++) {
+		PlaceBuildings((Building)type, positions[type]);
 	}
 
 	Create(deviceRes);
+
+	// Compiled for the next time (the map still works if it can't be saved)
+	if (hasCacheKey) WorldCache::Save(*this, WorldCache::GetPath(filePath), cacheKey);
+	return true;
 }
 
 void World::Draw(Camera* camera, DeviceResources* deviceRes) {
 	auto gpuRes = DefaultResources::Get();
 	gpuRes->cbModel.ApplyToVS(deviceRes, 0);
 
+	streamer.Update(*this, camera->GetPosition());
+	RegenerateChunks(deviceRes, true);
+	UpdateLods(camera, deviceRes);
+
 	for (int pass = SP_OPAQUE; pass < SP_COUNT; pass++) {
 		switch (pass) {
 		case SP_OPAQUE:
@@ -246,11 +409,10 @@ void World::Draw(Camera* camera, DeviceResources* deviceRes) {
 		}
 
 		for (int idx = 0; idx < WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT; idx++) {
-			if (chunks[idx]->needRegen) chunks[idx]->Generate(deviceRes);
-
-			if (chunks[idx]->bounds.Intersects(camera->bounds)) {
+			if (chunks[idx]->resident && chunks[idx]->bounds.Intersects(camera->bounds)) {
 				gpuRes->cbModel.data.model = chunks[idx]->model.Transpose();
 				gpuRes->cbModel.data.isInstance = false;
+				gpuRes->cbModel.data.lodTint = showLods ? chunks[idx]->GetDrawnLod() : 0;
 				gpuRes->cbModel.UpdateBuffer(deviceRes);
 				chunks[idx]->Draw(deviceRes, (ShaderPass)pass);
 			}
@@ -260,6 +422,7 @@ void World::Draw(Camera* camera, DeviceResources* deviceRes) {
 	// Clean
 
 	gpuRes->cbModel.data.model = Matrix::Identity;
+	gpuRes->cbModel.data.lodTint = 0;
 	gpuRes->cbModel.UpdateBuffer(deviceRes);
 }
 
@@ -285,6 +448,68 @@ void World::DrawBuildings(Camera* camera, DeviceResources* deviceRes)
 }
 
 void World::Reset()
+{
+	ResetBuildings();
+	water.Reset();
+	tickCount = 0;
+
+	// Reset chunks
+	JobSystem::Get()->ParallelFor(WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT, 64, [this](int begin, int end) {
+		for (int idx = begin; idx < end; idx++) chunks[idx]->Reset();
+	});
+	light.Rebuild(*this);
+}
+
+void World::Tick()
+{
+	tickCount++;
+	if (tickCount % WATER_TICK_INTERVAL == 0) water.Step(*this);
+}
+
+// Largest error of a coarse level, in blocks per block of distance to the camera : a block off every 20 blocks away.
+// With the hysteresis, the 2x level starts 27 blocks away and the 4x level 80 blocks away : both show zoomed out over the city.
+static constexpr float LOD_ERROR_PER_DISTANCE = 1.0f / 20.0f;
+// Part of the error under which a chunk goes to a coarser level
+static constexpr float LOD_HYSTERESIS = 0.75f;
+
+// Largest distance between a coarse mesh and the blocks, in blocks : a cell is full up to its top when any of its blocks is
+static float GetLodError(int level) {
+	return (float)((1 << level) - 1);
+}
+
+void World::UpdateLods(Camera* camera, DeviceResources* deviceRes)
+{
+	// The error allowed grows with the distance, whatever the resolution. An orthographic camera sees every chunk as a perspective one
+	// would from half the height it shows.
+	Matrix projection = camera->GetProjectionMatrix();
+	bool perspective = projection._44 == 0;
+	Vector3 eye = camera->GetPosition();
+
+	lodStats = {};
+	for (Chunk* chunk : chunks) {
+		if (!chunk->resident || !chunk->bounds.Intersects(camera->bounds)) continue;
+
+		float distance = 1.0f / projection._22;
+		if (perspective) {
+			Vector3 boxMin = chunk->bounds.Center - chunk->bounds.Extents;
+			Vector3 boxMax = chunk->bounds.Center + chunk->bounds.Extents;
+			Vector3 closest = Vector3::Min(Vector3::Max(eye, boxMin), boxMax);
+			distance = std::max(Vector3::Distance(eye, closest), 1.0f);
+		}
+		float allowed = distance * LOD_ERROR_PER_DISTANCE;
+
+		int level = chunk->lod;
+		while (level > 0 && GetLodError(level) > allowed) level--;
+		while (level < LOD_COUNT - 1 && GetLodError(level + 1) < allowed * LOD_HYSTERESIS) level++;
+		chunk->lod = level;
+		if (level > 0) chunk->UpdateLod(deviceRes, level, &lodJobs);
+
+		lodStats.chunks[chunk->GetDrawnLod()]++;
+		lodStats.vertices += chunk->GetDrawnVertexCount();
+	}
+}
+
+void World::ResetBuildings()
 {
 	passiveIncome = 0;
 	energyGain = 0;
@@ -300,21 +525,20 @@ void World::Reset()
 	for (const auto& [key, value] : buildingsPositions) {
 		value.positions->clear();
 	}
-	
-	// Reset chunks
-	for (int x = 0; x < WORLD_SIZE; x++) {
-		for (int y = 0; y < WORLD_HEIGHT; y++) {
-			for (int z = 0; z < WORLD_SIZE; z++) {
-				chunks[x + y * WORLD_SIZE + z * WORLD_SIZE * WORLD_HEIGHT]->Reset();
-			}
-		}
+	MarkBuildingPagesDirty();
+	placementMask.Invalidate();
+}
+
+void World::MarkBuildingPagesDirty()
+{
+	for (int page = 0; page < WORLD_SIZE * WORLD_SIZE; page++) {
+		dirtyBuildingPages[page] = true;
 	}
-	
 }
 
 Chunk* World::GetChunk(int cx, int cy, int cz) {
 	if (cx < 0 || cy < 0 || cz < 0) return nullptr;
-	if (cx > WORLD_SIZE - 1 || cy > WORLD_SIZE - 1 || cz > WORLD_SIZE - 1) return nullptr;
+	if (cx > WORLD_SIZE - 1 || cy > WORLD_HEIGHT - 1 || cz > WORLD_SIZE - 1) return nullptr;
 	return chunks[cx + cy * WORLD_SIZE + cz * WORLD_SIZE * WORLD_HEIGHT];
 }
 
@@ -328,18 +552,87 @@ BlockId* World::GetCube(int gx, int gy, int gz) {
 
 	Chunk* chunk = GetChunk(cx, cy, cz);
 	if (!chunk) return nullptr;
+	if (!chunk->IsLoaded()) LoadChunk(cx + cy * WORLD_SIZE + cz * WORLD_SIZE * WORLD_HEIGHT);
 	return chunk->GetCubeLocal(lx, ly, lz);
 }
 
+Chunk* World::LoadChunk(int idx) {
+	Chunk* chunk = chunks[idx];
+	if (!chunk->IsLoaded()) streamer.LoadBlocks(*this, idx);
+	return chunk;
+}
+
+void World::LoadChunksAround(int cx, int cy, int cz) {
+	static const int offsets[7][3] = { { 0, 0, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+	for (const auto& offset : offsets) {
+		Chunk* chunk = GetChunk(cx + offset[0], cy + offset[1], cz + offset[2]);
+		if (chunk && !chunk->IsLoaded()) LoadChunk((cx + offset[0]) + (cy + offset[1]) * WORLD_SIZE + (cz + offset[2]) * WORLD_SIZE * WORLD_HEIGHT);
+	}
+}
+
+void World::LoadResidentNeighbours() {
+	for (int idx = 0; idx < WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT; idx++) {
+		if (chunks[idx]->resident) LoadChunksAround(idx % WORLD_SIZE, (idx / WORLD_SIZE) % WORLD_HEIGHT, idx / (WORLD_SIZE * WORLD_HEIGHT));
+	}
+}
+
+void World::LoadAllChunks() {
+	for (int idx = 0; idx < WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT; idx++) LoadChunk(idx);
+}
+
 void World::MakeChunkDirty(int gx, int gy, int gz) {
+	// An evicted chunk is only marked : its mesh is made again once it is loaded
+	if (gx < 0 || gy < 0 || gz < 0) return;
 	Chunk* chunk = GetChunkFromCoordinates(gx, gy, gz);
-	if (chunk) chunk->needRegen = true;
+	if (chunk) chunk->MarkSectionDirty(gy % CHUNK_SIZE);
+}
+
+void World::MarkFacesDirty(int gx, int gy, int gz) {
+	// The faces touching a cube are its own and the ones of its neighbours facing it
+	MakeChunkDirty(gx, gy, gz);
+	MakeChunkDirty(gx - 1, gy, gz);
+	MakeChunkDirty(gx + 1, gy, gz);
+	MakeChunkDirty(gx, gy - 1, gz);
+	MakeChunkDirty(gx, gy + 1, gz);
+	MakeChunkDirty(gx, gy, gz - 1);
+	MakeChunkDirty(gx, gy, gz + 1);
 }
 
 bool World::IsAdjacentToWater(int gx, int gy, int gz)
 {
-	return *GetCube(gx + 1, gy, gz) == WATER || *GetCube(gx - 1, gy, gz) == WATER ||
-		*GetCube(gx, gy, gz + 1) == WATER || *GetCube(gx, gy, gz - 1) == WATER;
+	// The cubes out of the map aren't water
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	if (gy < 0 || gy >= CHUNK_SIZE * WORLD_HEIGHT) return false;
+	Chunk* const* layer = &chunks[(gy / CHUNK_SIZE) * WORLD_SIZE];
+	uint16_t bit = (uint16_t)(1 << (gy % CHUNK_SIZE));
+	auto isWater = [&](int x, int z) {
+		if (x < 0 || z < 0 || x >= mapSize || z >= mapSize) return false;
+		const Chunk* chunk = layer[x / CHUNK_SIZE + (z / CHUNK_SIZE) * WORLD_SIZE * WORLD_HEIGHT];
+		return (chunk->GetWaterColumn(x % CHUNK_SIZE, z % CHUNK_SIZE) & bit) != 0;
+	};
+	return isWater(gx + 1, gz) || isWater(gx - 1, gz) || isWater(gx, gz + 1) || isWater(gx, gz - 1);
+}
+
+bool World::IsSolid(int gx, int gy, int gz)
+{
+	if (!GetCube(gx, gy, gz)) return false;
+	return (GetChunkFromCoordinates(gx, gy, gz)->GetSolidColumn(gx % CHUNK_SIZE, gz % CHUNK_SIZE) >> (gy % CHUNK_SIZE)) & 1;
+}
+
+int World::GetSurfaceHeight(int gx, int gz)
+{
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	if (gx < 0 || gz < 0 || gx >= mapSize || gz >= mapSize) return -1;
+
+	// The highest solid bit of the highest chunk with one
+	int lx = gx % CHUNK_SIZE;
+	int lz = gz % CHUNK_SIZE;
+	for (int cy = WORLD_HEIGHT - 1; cy >= 0; cy--) {
+		uint16_t solid = GetChunk(gx / CHUNK_SIZE, cy, gz / CHUNK_SIZE)->GetSolidColumn(lx, lz);
+		unsigned long top;
+		if (_BitScanReverse(&top, solid)) return cy * CHUNK_SIZE + (int)top;
+	}
+	return -1;
 }
 
 Chunk* World::GetChunkFromCoordinates(int gx, int gy, int gz) {
@@ -350,17 +643,100 @@ Chunk* World::GetChunkFromCoordinates(int gx, int gy, int gz) {
 }
 
 void World::UpdateBlock(int gx, int gy, int gz, BlockId block) {
+	if (SetBlock(gx, gy, gz, block)) placementMask.UpdateColumn(*this, gx, gz);
+}
+
+bool World::SetBlock(int gx, int gy, int gz, BlockId block) {
 	BlockId* cube = GetCube(gx, gy, gz);
-	if (!cube) return;
+	if (!cube || *cube == block) return false;
+	BlockId before = *cube;
 	*cube = block;
+	// The terrain isn't the generated one anymore : generating it again must rebuild it
+	terrainVersion = 0;
+	water.OnBlockChanged(*this, gx, gy, gz, block);
+	light.OnBlockChanged(*this, gx, gy, gz, before, block);
 
-	MakeChunkDirty(gx, gy, gz);
-	MakeChunkDirty(gx + 1, gy, gz);
-	MakeChunkDirty(gx - 1, gy, gz);
-	MakeChunkDirty(gx, gy + 1, gz);
-	MakeChunkDirty(gx, gy - 1, gz);
-	MakeChunkDirty(gx, gy, gz + 1);
-	MakeChunkDirty(gx, gy, gz - 1);
+	int lx = gx % CHUNK_SIZE;
+	int ly = gy % CHUNK_SIZE;
+	int lz = gz % CHUNK_SIZE;
+	Chunk* chunk = GetChunkFromCoordinates(gx, gy, gz);
+	chunk->SetState(lx, ly, lz, 0);
+	chunk->UpdateColumnBit(lx, ly, lz);
+	chunk->needSave = true;
+
+	// Only the block's section, and the neighbour section (or chunk) when the block is on their border
+	MarkFacesDirty(gx, gy, gz);
+	return true;
+}
+
+uint8_t World::GetBlockState(int gx, int gy, int gz) {
+	if (!GetCube(gx, gy, gz)) return 0;
+	return GetChunkFromCoordinates(gx, gy, gz)->GetState(gx % CHUNK_SIZE, gy % CHUNK_SIZE, gz % CHUNK_SIZE);
+}
+
+void World::SetBlockState(int gx, int gy, int gz, uint8_t state) {
+	BlockId* cube = GetCube(gx, gy, gz);
+	if (!cube || !BLOCK_REGISTRY.oriented.Has(*cube)) return;
+
+	// Only the block's own faces change
+	Chunk* chunk = GetChunkFromCoordinates(gx, gy, gz);
+	if (chunk->GetState(gx % CHUNK_SIZE, gy % CHUNK_SIZE, gz % CHUNK_SIZE) == state) return;
+	chunk->SetState(gx % CHUNK_SIZE, gy % CHUNK_SIZE, gz % CHUNK_SIZE, state);
+	// Generating the terrain again must reset the state
+	terrainVersion = 0;
+	chunk->needSave = true;
+	chunk->MarkSectionDirty(gy % CHUNK_SIZE);
+}
+
+void World::Sculpt(BrushMode brush, int gx, int gz, int radius, int targetHeight) {
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	int maxHeight = CHUNK_SIZE * WORLD_HEIGHT - 1;
+	targetHeight = std::clamp(targetHeight, 1, maxHeight);
+
+	for (int z = std::max(gz - radius, 0); z <= std::min(gz + radius, mapSize - 1); z++) {
+		for (int x = std::max(gx - radius, 0); x <= std::min(gx + radius, mapSize - 1); x++) {
+			if ((x - gx) * (x - gx) + (z - gz) * (z - gz) > radius * radius) continue;
+
+			// The buildings would float or be buried
+			if (buildings[x + z * mapSize] != NOTHING) continue;
+
+			int y = GetSurfaceHeight(x, z);
+			if (y < 0) continue;
+			// The new top blocks are made of the same block as the current top
+			BlockId top = *GetCube(x, y, z);
+
+			bool changed = false;
+			switch (brush) {
+			case BRUSH_RAISE:
+				if (y < maxHeight) changed = SetBlock(x, y + 1, z, top);
+				break;
+
+			case BRUSH_LOWER:
+				if (y > 1) {
+					changed = SetBlock(x, y, z, EMPTY);
+					SetBlock(x, y - 1, z, top);
+				}
+				break;
+
+			case BRUSH_FLATTEN:
+				for (int h = y + 1; h <= targetHeight; h++) changed |= SetBlock(x, h, z, top);
+				if (y > targetHeight) {
+					for (int h = y; h > targetHeight; h--) changed |= SetBlock(x, h, z, EMPTY);
+					SetBlock(x, targetHeight, z, top);
+				}
+				break;
+
+			case BRUSH_WATER:
+				if (y < maxHeight && *GetCube(x, y + 1, z) == EMPTY) changed = SetBlock(x, y + 1, z, WATER);
+				break;
+
+			default:
+				break;
+			}
+
+			if (changed) placementMask.UpdateColumn(*this, x, z);
+		}
+	}
 }
 
 Building World::GetBuilding(int x, int y)
@@ -371,9 +747,24 @@ Building World::GetBuilding(int x, int y)
 
 void World::PlaceBuilding(Building type, int x, int y, int z)
 {
+	AddBuilding(type, x, y, z);
+	RegenerateBufferFor(type);
+}
+
+void World::PlaceBuildings(Building type, const std::vector<Vector3>& positions)
+{
+	for (const Vector3& position : positions) {
+		AddBuilding(type, (int)position.x, (int)position.y, (int)position.z);
+	}
+	RegenerateBufferFor(type);
+}
 
+void World::AddBuilding(Building type, int x, int y, int z)
+{
 	buildings[x + z * CHUNK_SIZE * WORLD_SIZE] = type;
 	buildingsPositions[type].positions->push_back(Vector3(x,y,z));
+	placementMask.UpdateBuilding(x, z, true);
+	dirtyBuildingPages[x / CHUNK_SIZE + (z / CHUNK_SIZE) * WORLD_SIZE] = true;
 	
 	energyGain += buildingsPositions[type].energy;
 	waterGain += buildingsPositions[type].water;
@@ -395,14 +786,113 @@ void World::PlaceBuilding(Building type, int x, int y, int z)
 	else {
 		if (GetAmountOfAdjacentRoads(x, z) > 0) passiveIncome += buildingsPositions[type].income;
 	}
-
-	RegenerateBufferFor(type);
 }
 
 void World::RemoveBuilding(int x, int y, int z)
 {
+	Building type = EraseBuilding(x, y, z);
+	if (type != NOTHING) RegenerateBufferFor(type);
+}
+
+void World::ApplyBuildingChanges(const BuildingChange* changes, size_t count, bool reverse)
+{
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	if (changedTileMarks.empty()) {
+		changedTileMarks.resize(mapSize * mapSize);
+		changedTileHeights.resize(mapSize * mapSize);
+	}
+
+	// The income can only change on the changed tiles and their neighbours : it is removed before and added back after
+	incomeTiles.clear();
+	for (size_t i = 0; i < count; i++) {
+		uint32_t tile = changes[i].tile;
+		int x = tile % mapSize;
+		int z = tile / mapSize;
+		incomeTiles.push_back(tile);
+		if (x > 0) incomeTiles.push_back(tile - 1);
+		if (x < mapSize - 1) incomeTiles.push_back(tile + 1);
+		if (z > 0) incomeTiles.push_back(tile - mapSize);
+		if (z < mapSize - 1) incomeTiles.push_back(tile + mapSize);
+	}
+	std::sort(incomeTiles.begin(), incomeTiles.end());
+	incomeTiles.erase(std::unique(incomeTiles.begin(), incomeTiles.end()), incomeTiles.end());
+	passiveIncome -= GetIncomeOf(incomeTiles);
+
+	// Changes the grid, keeping the building each tile had before (+ 1, 0 for the tiles that don't change)
+	changedTiles.clear();
+	for (size_t i = 0; i < count; i++) {
+		const BuildingChange& change = changes[reverse ? count - 1 - i : i];
+		if (changedTileMarks[change.tile] == 0) {
+			changedTileMarks[change.tile] = (uint8_t)(buildings[change.tile] + 1);
+			changedTiles.push_back(change.tile);
+		}
+		buildings[change.tile] = (Building)(reverse ? change.before : change.after);
+		changedTileHeights[change.tile] = change.y;
+	}
+
+	uint32_t removedTypes = 0;
+	uint32_t changedTypes = 0;
+	for (uint32_t tile : changedTiles) {
+		Building before = (Building)(changedTileMarks[tile] - 1);
+		Building after = buildings[tile];
+		if (before != NOTHING) {
+			energyGain -= buildingsPositions[before].energy;
+			waterGain -= buildingsPositions[before].water;
+			removedTypes |= 1u << before;
+		}
+		if (after != NOTHING) {
+			energyGain += buildingsPositions[after].energy;
+			waterGain += buildingsPositions[after].water;
+		}
+		changedTypes |= (1u << before) | (1u << after);
+		placementMask.UpdateBuilding(tile % mapSize, tile / mapSize, after != NOTHING);
+		dirtyBuildingPages[(tile % mapSize) / CHUNK_SIZE + (tile / mapSize / CHUNK_SIZE) * WORLD_SIZE] = true;
+	}
+
+	// Removes the buildings of the changed tiles, in a single pass per type
+	for (int type = TREE; type <= ROAD; type++) {
+		if (!(removedTypes & (1u << type))) continue;
+		std::vector<Vector3>& positions = *buildingsPositions[(Building)type].positions;
+		positions.erase(std::remove_if(positions.begin(), positions.end(), [&](const Vector3& position) {
+			return changedTileMarks[(int)position.x + (int)position.z * mapSize] != 0;
+		}), positions.end());
+	}
+
+	// Then adds the new ones
+	for (uint32_t tile : changedTiles) {
+		Building after = buildings[tile];
+		if (after != NOTHING) buildingsPositions[after].positions->push_back(Vector3(tile % mapSize, changedTileHeights[tile], tile / mapSize));
+		changedTileMarks[tile] = 0;
+	}
+
+	passiveIncome += GetIncomeOf(incomeTiles);
+
+	for (int type = TREE; type <= ROAD; type++) {
+		if (changedTypes & (1u << type)) RegenerateBufferFor((Building)type);
+	}
+}
+
+const BitGrid& World::GetPlacementMask(Building tool)
+{
+	PlacementTool kind = tool == NOTHING ? PT_DESTROY : tool == WATERPLANT ? PT_WATERPLANT : PT_BUILD;
+	return placementMask.Get(*this, kind);
+}
+
+int World::GetIncomeOf(const std::vector<uint32_t>& tiles)
+{
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	int income = 0;
+	for (uint32_t tile : tiles) {
+		Building type = buildings[tile];
+		if (type != NOTHING && GetAmountOfAdjacentRoads(tile % mapSize, tile / mapSize) > 0) income += buildingsPositions[type].income;
+	}
+	return income;
+}
 
+Building World::EraseBuilding(int x, int y, int z)
+{
 	Building type = GetBuilding(x, z);
+	if (type == NOTHING) return NOTHING;
 
 	int size = buildingsPositions[type].positions->size();
 	Vector3 position;
@@ -412,6 +902,8 @@ void World::RemoveBuilding(int x, int y, int z)
 			buildingsPositions[type].positions->erase(buildingsPositions[type].positions->begin() + i);
 
 			buildings[x + z * CHUNK_SIZE * WORLD_SIZE] = NOTHING;
+			placementMask.UpdateBuilding(x, z, false);
+			dirtyBuildingPages[x / CHUNK_SIZE + (z / CHUNK_SIZE) * WORLD_SIZE] = true;
 			energyGain -= buildingsPositions[type].energy;
 			waterGain -= buildingsPositions[type].water;
 
@@ -432,11 +924,10 @@ void World::RemoveBuilding(int x, int y, int z)
 				if (GetAmountOfAdjacentRoads(x, z) > 0) passiveIncome -= buildingsPositions[type].income;
 			}
 
-			RegenerateBufferFor(type);
-
-			return;
+			return type;
 		}
 	}
+	return NOTHING;
 }
 
 int World::GetWaterDelta()
@@ -477,9 +968,19 @@ void World::RegenerateBufferFor(Building building)
 
 void World::Create(DeviceResources* deviceRes)
 {
-	for (int idx = 0; idx < WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT; idx++)
-		chunks[idx]->Generate(deviceRes);
+	// The blocks were written directly : the column masks are computed again first, every chunk is meshed right after with the new light.
+	// The whole world is read : the streaming evicts the chunks far from the camera afterward.
+	LoadAllChunks();
+	JobSystem::Get()->ParallelFor(WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT, 8, [this](int begin, int end) {
+		for (int idx = begin; idx < end; idx++) chunks[idx]->RebuildColumns();
+	});
+	light.Rebuild(*this);
+	RegenerateChunks(deviceRes, false);
+	CreateModels(deviceRes);
+}
 
+void World::CreateModels(DeviceResources* deviceRes)
+{
 	buildingsPositions[TREE].model->Generate(deviceRes);
 	buildingsPositions[HOUSE].model->Generate(deviceRes);
 	buildingsPositions[SHOP].model->Generate(deviceRes);
@@ -490,3 +991,214 @@ void World::Create(DeviceResources* deviceRes)
 
 	DefaultResources::Get()->cbModel.Create(deviceRes);
 }
+
+void World::RegenerateChunks(DeviceResources* deviceRes, bool onlyDirty)
+{
+	std::vector<int> toRegen;
+	for (int idx = 0; idx < WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT; idx++) {
+		// The evicted chunks are meshed when they are loaded again
+		if (!onlyDirty || (chunks[idx]->NeedsRegen() && chunks[idx]->resident)) toRegen.push_back(idx);
+	}
+	if (toRegen.empty()) return;
+
+	// The meshing reads the borders of the neighbours, on the jobs : they are loaded first
+	for (int idx : toRegen) LoadChunksAround(idx % WORLD_SIZE, (idx / WORLD_SIZE) % WORLD_HEIGHT, idx / (WORLD_SIZE * WORLD_HEIGHT));
+
+	// A chunk meshed in full may have its mesh in the cache : it is hashed in parallel, then looked up on this thread.
+	// The edits only mesh a few sections again, which is cheaper than hashing the chunk.
+	int count = (int)toRegen.size();
+	std::vector<uint8_t> sections(count);
+	std::vector<uint8_t> cached(count, 0);
+	std::vector<uint64_t> keys(count, 0);
+	for (int i = 0; i < count; i++) sections[i] = onlyDirty ? chunks[toRegen[i]]->dirtySections : ALL_SECTIONS;
+	if (meshCache.IsEnabled()) {
+		JobSystem::Get()->ParallelFor(count, 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				if (sections[i] == ALL_SECTIONS) keys[i] = MeshCache::GetKey(*chunks[toRegen[i]]);
+			}
+		});
+		for (int i = 0; i < count; i++) {
+			if (sections[i] == ALL_SECTIONS) cached[i] = meshCache.Load(toRegen[i], keys[i], *chunks[toRegen[i]]);
+		}
+	}
+
+	// Meshing only reads blocks, so chunks can be meshed at the same time.
+	// The GPU buffers are created afterward on this thread.
+	JobSystem::Get()->ParallelFor(count, 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			if (!cached[i]) chunks[toRegen[i]]->BuildMesh(sections[i]);
+		}
+	});
+
+	for (int i = 0; i < count; i++) {
+		Chunk* chunk = chunks[toRegen[i]];
+		if (meshCache.IsEnabled() && sections[i] == ALL_SECTIONS && !cached[i]) meshCache.Store(toRegen[i], keys[i], *chunk);
+		chunk->Upload(deviceRes);
+	}
+}
+
+float World::BenchmarkMeshing(int iterations)
+{
+	// The evicted chunks would get meshes without being loaded. The neighbours of the others are loaded before the timing,
+	// as RegenerateChunks does, so that their borders are meshed.
+	LoadResidentNeighbours();
+	int meshed = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		for (Chunk* chunk : chunks) {
+			if (!chunk->resident) continue;
+			chunk->BuildMesh();
+			meshed++;
+		}
+	}
+	std::chrono::duration<float, std::micro> time = std::chrono::steady_clock::now() - start;
+	return time.count() / std::max(meshed, 1);
+}
+
+float World::BenchmarkSectionMeshing(int iterations)
+{
+	LoadResidentNeighbours();
+	int meshed = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		for (Chunk* chunk : chunks) {
+			if (!chunk->resident) continue;
+			for (int section = 0; section < SECTION_COUNT; section++) chunk->BuildMesh((uint8_t)(1 << section));
+			meshed += SECTION_COUNT;
+		}
+	}
+	std::chrono::duration<float, std::micro> time = std::chrono::steady_clock::now() - start;
+	return time.count() / std::max(meshed, 1);
+}
+
+RegionBenchmark World::BenchmarkRegionFile(int iterations)
+{
+	RegionBenchmark result;
+	const int chunkCount = WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT;
+	const size_t blocksSize = Chunk::BLOCK_COUNT * sizeof(BlockId);
+	static_assert(WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT <= RegionFile::ENTRY_COUNT, "The benchmark writes every chunk to a single region");
+	CreateDirectoryW(L"Cache", nullptr);
+	LoadAllChunks();
+	RegionFile blocksRegion, meshesRegion;
+	if (!blocksRegion.Open(L"Cache/Benchmark.blocks.region", true) || !meshesRegion.Open(L"Cache/Benchmark.meshes.region", true)) return result;
+
+	std::vector<BinaryWriter> meshes(chunkCount);
+	for (int idx = 0; idx < chunkCount; idx++) chunks[idx]->WriteMesh(meshes[idx]);
+
+	// Every write after the first replaces a blob : the sectors it frees are taken by the next one
+	size_t written = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		for (int idx = 0; idx < chunkCount; idx++) {
+			int x = idx % RegionFile::REGION_SIZE, z = idx / RegionFile::REGION_SIZE;
+			if (!blocksRegion.Write(x, z, chunks[idx]->data, blocksSize, true) ||
+				!meshesRegion.Write(x, z, meshes[idx].GetData(), meshes[idx].GetSize(), false)) return result;
+			written += blocksSize + meshes[idx].GetSize();
+		}
+	}
+	std::chrono::duration<float> writeTime = std::chrono::steady_clock::now() - start;
+
+	size_t read = 0;
+	std::vector<uint8_t> blob;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		for (int idx = 0; idx < chunkCount; idx++) {
+			int x = idx % RegionFile::REGION_SIZE, z = idx / RegionFile::REGION_SIZE;
+			if (!blocksRegion.Read(x, z, blob) || blob.size() != blocksSize || memcmp(blob.data(), chunks[idx]->data, blob.size()) != 0) return result;
+			read += blob.size();
+			if (!meshesRegion.Read(x, z, blob) || blob.size() != meshes[idx].GetSize() || memcmp(blob.data(), meshes[idx].GetData(), blob.size()) != 0) return result;
+			read += blob.size();
+		}
+	}
+	std::chrono::duration<float> readTime = std::chrono::steady_clock::now() - start;
+
+	size_t encodedSize = 0;
+	for (int idx = 0; idx < chunkCount; idx++) {
+		BinaryWriter encoded;
+		encoded.WriteRle((const uint8_t*)chunks[idx]->data, blocksSize);
+		encodedSize += std::min(encoded.GetSize(), blocksSize);
+	}
+
+	result.writeThroughput = written / (1024.0f * 1024.0f) / std::max(writeTime.count(), 1e-6f);
+	result.readThroughput = read / (1024.0f * 1024.0f) / std::max(readTime.count(), 1e-6f);
+	result.blocksRatio = (float)encodedSize / (chunkCount * blocksSize);
+	result.sectors = blocksRegion.GetSectorCount() + meshesRegion.GetSectorCount();
+	result.freeSectors = blocksRegion.GetFreeSectorCount() + meshesRegion.GetFreeSectorCount();
+	return result;
+}
+
+LightBenchmark World::BenchmarkLight(int edits, uint32_t seed)
+{
+	LightBenchmark result;
+	const int chunkCount = WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT;
+	const size_t lightSize = Chunk::BLOCK_COUNT;
+	int mapSize = CHUNK_SIZE * WORLD_SIZE;
+	int mapHeight = CHUNK_SIZE * WORLD_HEIGHT;
+
+	// Opaque, transparent, absorbing and emitting blocks, and holes
+	static const BlockId palette[] = { EMPTY, EMPTY, STONE, GRASS, GLASS, WATER, REDSTONE_ORE, LOG };
+	std::vector<uint8_t> updated(chunkCount * lightSize);
+	uint32_t random = seed;
+	auto next = [&random](uint32_t range) {
+		random = random * 1664525u + 1013904223u;
+		return (random >> 8) % range;
+	};
+
+	// The check starts from the rebuilt light. The light of every chunk is compared : they all stay loaded until the end.
+	LoadAllChunks();
+	light.Rebuild(*this);
+	double updateTime = 0, rebuildTime = 0, changedCells = 0;
+	for (int i = 0; i < edits; i++) {
+		int x = (int)next(mapSize), y = (int)next(mapHeight), z = (int)next(mapSize);
+		BlockId block = palette[next((uint32_t)std::size(palette))];
+		if (!SetBlock(x, y, z, block)) continue;
+		placementMask.UpdateColumn(*this, x, z);
+		result.edits++;
+		updateTime += light.GetLastUpdateTime();
+		changedCells += light.GetLastChangedCount();
+
+		for (int idx = 0; idx < chunkCount; idx++) memcpy(updated.data() + idx * lightSize, chunks[idx]->light, lightSize);
+		light.Rebuild(*this);
+		rebuildTime += light.GetLastUpdateTime();
+
+		size_t mismatches = 0;
+		for (int idx = 0; idx < chunkCount; idx++) {
+			const uint8_t* before = updated.data() + idx * lightSize;
+			for (size_t cell = 0; cell < lightSize; cell++) mismatches += before[cell] != chunks[idx]->light[cell];
+		}
+		if (mismatches > 0) result.mismatchedEdits++;
+		result.mismatchedCells += mismatches;
+	}
+
+	if (result.edits > 0) {
+		result.updateTime = (float)(updateTime / result.edits);
+		result.rebuildTime = (float)(rebuildTime / result.edits);
+		result.changedCells = (float)(changedCells / result.edits);
+	}
+	return result;
+}
+
+uint64_t World::GetStateHash()
+{
+	uint64_t hash = Fnv1a64(nullptr, 0);
+	LoadAllChunks();
+	for (const Chunk* chunk : chunks) {
+		hash = Fnv1a64(chunk->data, Chunk::BLOCK_COUNT * sizeof(BlockId), hash);
+		// Field by field : the entries have padding
+		for (const BlockStateEntry& entry : chunk->states) {
+			hash = Fnv1a64(&entry.cell, sizeof(entry.cell), hash);
+			hash = Fnv1a64(&entry.state, sizeof(entry.state), hash);
+		}
+	}
+	hash = Fnv1a64(buildings, sizeof(buildings), hash);
+
+	// Positions are hashed in their order : it is the order of the instance buffers
+	for (const auto& [type, data] : buildingsPositions) {
+		hash = Fnv1a64(&type, sizeof(type), hash);
+		if (!data.positions->empty())
+			hash = Fnv1a64(data.positions->data(), data.positions->size() * sizeof(Vector3), hash);
+	}
+
+	int economy[3] = { energyGain, waterGain, passiveIncome };
+	return Fnv1a64(economy, sizeof(economy), hash);
+}
@@ -2,10 +2,19 @@
 
 #include "Engine/BlendState.h"
 #include "Engine/Camera.h"
+#include "Engine/JobSystem.h"
 #include "Minicraft/Block.h"
+#include "Minicraft/ChunkStreamer.h"
+#include "Minicraft/MeshCache.h"
+#include "Minicraft/NoiseField.h"
+#include "Minicraft/PlacementMask.h"
+#include "Minicraft/VoxelLight.h"
+#include "Minicraft/WaterFlow.h"
 
 #define WORLD_SIZE 6
 #define WORLD_HEIGHT 1
+// Levels of detail of the chunks : the full mesh, then cubes of 2 and 4 blocks
+#define LOD_COUNT 3
 
 class Chunk;
 class Cube3D;
@@ -39,12 +48,83 @@ struct BuildingData {
 	int income;
 };
 
+/// <summary>
+/// The brushes that sculpt the terrain
+/// </summary>
+enum BrushMode {
+	// Adds a block on top of the columns
+	BRUSH_RAISE,
+	// Removes the top block of the columns
+	BRUSH_LOWER,
+	// Brings the columns to a height
+	BRUSH_FLATTEN,
+	// Adds water on top of the columns
+	BRUSH_WATER,
+
+	BRUSH_COUNT
+};
+
+/// <summary>
+/// What the last frame drew of the chunks
+/// </summary>
+struct LodStats {
+	// Chunks drawn at every level of detail
+	int chunks[LOD_COUNT] = {};
+	// Vertices of the drawn chunks
+	size_t vertices = 0;
+};
+
+/// <summary>
+/// Throughput of the region files, measured by World::BenchmarkRegionFile
+/// </summary>
+struct RegionBenchmark {
+	// Uncompressed megabytes written and read per second
+	float writeThroughput = 0;
+	float readThroughput = 0;
+	// Size on the disk of the blocks, over their uncompressed size
+	float blocksRatio = 0;
+	// Sectors of the files, and the free ones left by the rewrites
+	uint32_t sectors = 0;
+	uint32_t freeSectors = 0;
+};
+
+/// <summary>
+/// The light updated block by block, checked against the light computed from the whole world by World::BenchmarkLight
+/// </summary>
+struct LightBenchmark {
+	// Edits that changed a block, and the ones after which the light differed from the rebuilt one
+	int edits = 0;
+	int mismatchedEdits = 0;
+	// Cells whose light differed, over all the edits
+	size_t mismatchedCells = 0;
+	// Average time of an update after an edit, and of a rebuild of the whole world, in milliseconds
+	float updateTime = 0;
+	float rebuildTime = 0;
+	// Average number of cells whose light changed after an edit
+	float changedCells = 0;
+};
+
+/// <summary>
+/// A change of the building on a tile. It can be applied both ways (to undo it).
+/// </summary>
+struct BuildingChange {
+	// Index of the tile (x + z * map size)
+	uint32_t tile;
+	// Y position of the building
+	uint8_t y;
+	// Buildings before and after the change
+	uint8_t before;
+	uint8_t after;
+};
+
 /// <summary>
 ///  Represents the world
 /// </summary>
 class World {
 	Chunk* chunks[WORLD_SIZE * WORLD_HEIGHT * WORLD_SIZE];
 	Building buildings[WORLD_SIZE * 16 * WORLD_SIZE * 16];
+	// Building pages (the tiles above a chunk column) changed since the last autosave
+	bool dirtyBuildingPages[WORLD_SIZE * WORLD_SIZE];
 	std::map<Building, BuildingData> buildingsPositions;
 
 	int energyGain = 0;
@@ -53,6 +133,39 @@ class World {
 
 	DeviceResources* deviceRes;
 
+	// Noise fields used by the generators (height, tree density, ...)
+	NoiseFieldCache noiseFields;
+	// Version of the height field the terrain was generated from (0 if it doesn't come from one, or a block changed since)
+	uint32_t terrainVersion = 0;
+	// Error of the last map loaded from a file
+	std::string loadError;
+
+	// Tiles where each tool can be used
+	PlacementMask placementMask;
+
+	// Flow of the water blocks, stepped every few ticks
+	WaterFlow water;
+	int tickCount = 0;
+
+	// Sky and block light of every block, baked in the chunk meshes
+	VoxelLight light;
+
+	// Jobs building the coarse meshes of the chunks, and what the last frame drew
+	JobCounter lodJobs;
+	LodStats lodStats;
+	bool showLods = false;
+
+	// Chunks kept in memory only around the camera (when enabled)
+	ChunkStreamer streamer;
+	// Full meshes of the chunks by content, so that unchanged chunks aren't meshed again
+	MeshCache meshCache;
+
+	// Scratch buffers of ApplyBuildingChanges (one value per tile for the first two)
+	std::vector<uint8_t> changedTileMarks;
+	std::vector<uint8_t> changedTileHeights;
+	std::vector<uint32_t> changedTiles;
+	std::vector<uint32_t> incomeTiles;
+
 public:
 	World();
 	virtual ~World();
@@ -71,7 +184,11 @@ public:
 	/// <param name="deviceRes">The game's device resources</param>
 	/// <param name="filePath">The map's filepath</param>
 	/// <param name="treeThreshold">The map's tree threshold</param>
-	void GenerateFromFile(DeviceResources* deviceRes, std::wstring filePath, float treeThreshold);
+	/// <returns>True if the map was loaded. If it wasn't, the world is unchanged and GetLoadError tells why.</returns>
+	bool GenerateFromFile(DeviceResources* deviceRes, std::wstring filePath, float treeThreshold);
+
+	// Gets the error of the last GenerateFromFile (empty if it succeeded)
+	const std::string& GetLoadError() const { return loadError; }
 
 	/// <summary>
 	/// Draws the world
@@ -91,6 +208,15 @@ public:
 	// Reset the world
 	void Reset();
 
+	// Simulates a tick of the world (water flow)
+	void Tick();
+
+	// Gets the number of water cells that will be updated by the next water step
+	size_t GetActiveWaterCount() const { return water.GetActiveCount(); }
+
+	// Gets the light propagation (for its stats)
+	const VoxelLight& GetVoxelLight() const { return light; }
+
 	/// <summary>
 	/// Gets a chunk
 	/// </summary>
@@ -100,6 +226,28 @@ public:
 	/// <returns>The chunk</returns>
 	Chunk* GetChunk(int cx, int cy, int cz);
 
+	/// <summary>
+	/// Gets a chunk with its blocks in memory : an evicted chunk is loaded back (see ChunkStreamer).
+	/// Only on the main thread : the jobs reading the blocks have their chunks loaded beforehand.
+	/// </summary>
+	/// <param name="idx">The chunk's index</param>
+	/// <returns>The chunk</returns>
+	Chunk* LoadChunk(int idx);
+
+	/// <summary>
+	/// Loads a chunk and its six neighbours, so that the blocks around the chunk can be read from the jobs
+	/// </summary>
+	/// <param name="cx">The chunk's X position</param>
+	/// <param name="cy">The chunk's Y position</param>
+	/// <param name="cz">The chunk's Z position</param>
+	void LoadChunksAround(int cx, int cy, int cz);
+
+	// Loads the neighbours of every chunk with a mesh, before meshing them all again
+	void LoadResidentNeighbours();
+
+	// Loads every chunk, before a pass reading the blocks of the whole world
+	void LoadAllChunks();
+
 	/// <summary>
 	/// Gets a chunk from a global coordinate
 	/// </summary>
@@ -110,7 +258,7 @@ public:
 	Chunk* GetChunkFromCoordinates(int gx, int gy, int gz);
 
 	/// <summary>
-	/// Gets a cube from a global coordinate
+	/// Gets a cube from a global coordinate. Its chunk is loaded if it was evicted.
 	/// </summary>
 	/// <param name="cx">The coordinate's X position</param>
 	/// <param name="cy">The coordinate's Y position</param>
@@ -119,13 +267,22 @@ public:
 	BlockId* GetCube(int gx, int gy, int gz);
 
 	/// <summary>
-	/// Make a chunk dirty
+	/// Marks the chunk section holding a cube for the remeshing. Nothing happens out of the world.
 	/// </summary>
-	/// <param name="cx">The chunk's X position</param>
-	/// <param name="cy">The chunk's Y position</param>
-	/// <param name="cz">The chunk's Z position</param>
+	/// <param name="gx">The cube's X position</param>
+	/// <param name="gy">The cube's Y position</param>
+	/// <param name="gz">The cube's Z position</param>
 	void MakeChunkDirty(int gx, int gy, int gz);
 
+	/// <summary>
+	/// Marks the sections holding the faces touching a cube : the cube's section, and the ones of its six neighbours.
+	/// They are the same section, unless the cube is on a section or chunk border.
+	/// </summary>
+	/// <param name="gx">The cube's X position</param>
+	/// <param name="gy">The cube's Y position</param>
+	/// <param name="gz">The cube's Z position</param>
+	void MarkFacesDirty(int gx, int gy, int gz);
+
 	/// <summary>
 	/// Checks if a coordinate is adjacent to water
 	/// </summary>
@@ -135,6 +292,23 @@ public:
 	/// <returns>True if it is adjacent to water</returns>
 	bool IsAdjacentToWater(int gx, int gy, int gz);
 
+	/// <summary>
+	/// Checks if a cube is hit by the raycasts (see BlockRegistry::solid), from the column masks
+	/// </summary>
+	/// <param name="gx">The cube's X position</param>
+	/// <param name="gy">The cube's Y position</param>
+	/// <param name="gz">The cube's Z position</param>
+	/// <returns>True if the cube is in the world and solid</returns>
+	bool IsSolid(int gx, int gy, int gz);
+
+	/// <summary>
+	/// Gets the height of the top cube of a column, the one a building stands on (water is ignored, like in the raycasts)
+	/// </summary>
+	/// <param name="gx">The column's X position</param>
+	/// <param name="gz">The column's Z position</param>
+	/// <returns>The cube's Y position, -1 if there is none</returns>
+	int GetSurfaceHeight(int gx, int gz);
+
 	/// <summary>
 	/// Updates a block's ID
 	/// </summary>
@@ -144,6 +318,35 @@ public:
 	/// <param name="block">The new block's ID</param>
 	void UpdateBlock(int gx, int gy, int gz, BlockId block);
 
+	/// <summary>
+	/// Gets the state of a block (orientation and on/off of the blocks with BF_ORIENTED)
+	/// </summary>
+	/// <param name="gx">The block's X position</param>
+	/// <param name="gy">The block's Y position</param>
+	/// <param name="gz">The block's Z position</param>
+	/// <returns>The BlockState bits, 0 if the block has none</returns>
+	uint8_t GetBlockState(int gx, int gy, int gz);
+
+	/// <summary>
+	/// Sets the state of a block. Only the blocks with BF_ORIENTED keep a state, and it is removed when the block changes.
+	/// </summary>
+	/// <param name="gx">The block's X position</param>
+	/// <param name="gy">The block's Y position</param>
+	/// <param name="gz">The block's Z position</param>
+	/// <param name="state">The BlockState bits</param>
+	void SetBlockState(int gx, int gy, int gz, uint8_t state);
+
+	/// <summary>
+	/// Sculpts the terrain in a circle. The columns with a building aren't changed.
+	/// Only the chunk sections holding a changed block, and their neighbours when the block is on their shared border, are remeshed (once, on the next draw).
+	/// </summary>
+	/// <param name="brush">The brush</param>
+	/// <param name="gx">The circle's center X position</param>
+	/// <param name="gz">The circle's center Z position</param>
+	/// <param name="radius">The circle's radius</param>
+	/// <param name="targetHeight">The height of the top block for BRUSH_FLATTEN</param>
+	void Sculpt(BrushMode brush, int gx, int gz, int radius, int targetHeight);
+
 	/// <summary>
 	/// Gets a building on the map
 	/// </summary>
@@ -161,6 +364,13 @@ public:
 	/// <param name="z">The building's Z position</param>
 	void PlaceBuilding(Building type, int x, int y, int z);
 
+	/// <summary>
+	/// Place multiple buildings of the same type, then updates the instance buffer once
+	/// </summary>
+	/// <param name="type">The buildings' type</param>
+	/// <param name="positions">The buildings' positions</param>
+	void PlaceBuildings(Building type, const std::vector<Vector3>& positions);
+
 	/// Removes a building
 	/// </summary>
 	/// <param name="x">The building's X position</param>
@@ -168,6 +378,15 @@ public:
 	/// <param name="z">The building's Z position</param>
 	void RemoveBuilding(int x, int y, int z);
 
+	/// <summary>
+	/// Applies building changes as a batch : the economy is updated from the difference over the changed tiles and their neighbours,
+	/// the removed buildings are compacted out of their instance arrays in a single pass, and the instance buffers of the changed types are updated once.
+	/// </summary>
+	/// <param name="changes">The changes</param>
+	/// <param name="count">The number of changes</param>
+	/// <param name="reverse">Applies the changes backward (last one first, from 'after' to 'before'), to undo them</param>
+	void ApplyBuildingChanges(const BuildingChange* changes, size_t count, bool reverse);
+
 	// Gets the delta for the water consumption
 	int GetWaterDelta();
 	// Gets the delta for the energy consumption
@@ -183,9 +402,123 @@ public:
 	/// <returns>The number of adjacent roads</returns>
 	int GetAmountOfAdjacentRoads(int x,int y);
 
+	/// <summary>
+	/// Gets the tiles where a building can be placed (or destroyed)
+	/// </summary>
+	/// <param name="tool">The building, NOTHING to destroy</param>
+	/// <returns>The tiles, valid until the next change of the world</returns>
+	const BitGrid& GetPlacementMask(Building tool);
+
+	// Gets the version of the placement masks : it changes whenever they may have changed
+	uint32_t GetPlacementVersion() const { return placementMask.GetVersion(); }
+
+	// Gets what the last frame drew of the chunks
+	const LodStats& GetLodStats() const { return lodStats; }
+
+	// Tints the chunks drawn at a coarse level of detail : green at 2x, red at 4x
+	void SetShowLods(bool show) { showLods = show; }
+	bool GetShowLods() const { return showLods; }
+
+	// Gets the streaming of the chunks
+	ChunkStreamer& GetStreamer() { return streamer; }
+
+	// Gets the cache of the chunk meshes
+	MeshCache& GetMeshCache() { return meshCache; }
+
+	/// <summary>
+	/// Measures the meshing of a chunk : every chunk is meshed again on this thread (to the same mesh), without uploading it
+	/// </summary>
+	/// <param name="iterations">The number of times every chunk is meshed</param>
+	/// <returns>The average time to mesh a chunk, in microseconds</returns>
+	float BenchmarkMeshing(int iterations);
+
+	/// <summary>
+	/// Measures the remeshing after a block edit : every section of every chunk is meshed again alone, as after an edit inside it
+	/// </summary>
+	/// <param name="iterations">The number of times every section is meshed</param>
+	/// <returns>The average time to mesh a section and put the chunk's buffers back together, in microseconds</returns>
+	float BenchmarkSectionMeshing(int iterations);
+
+	/// <summary>
+	/// Measures the region files : the blocks (run-length encoded, as a save) and the mesh (as a cache) of every chunk are written
+	/// again and again to two region files, then read back and compared
+	/// </summary>
+	/// <param name="iterations">The number of times every chunk is written</param>
+	/// <returns>The throughputs, zero if a file couldn't be written or read back</returns>
+	RegionBenchmark BenchmarkRegionFile(int iterations);
+
+	/// <summary>
+	/// Checks the light updates : random blocks are set at random positions, and after each edit the updated light
+	/// is compared with the light computed again from the whole world (which the next edit starts from). The blocks stay changed.
+	/// </summary>
+	/// <param name="edits">The number of edits</param>
+	/// <param name="seed">The seed of the positions and blocks</param>
+	/// <returns>The mismatches and timings</returns>
+	LightBenchmark BenchmarkLight(int edits, uint32_t seed);
+
+	// Gets a hash of the city's state (blocks, buildings and economy), used to check that a replay reached the same state
+	uint64_t GetStateHash();
+
 	friend class Chunk;
+	friend class WorldCache;
+	friend class CitySave;
+	friend class Autosave;
+	friend class WaterFlow;
+	friend class VoxelLight;
+	friend class ChunkStreamer;
 
 private:
+	/// <summary>
+	/// Chooses the level of detail of every visible chunk, so that a coarse mesh is off by LOD_ERROR_PER_DISTANCE blocks per block of distance at most.
+	/// A chunk only goes to a coarser level when it is well under the error (LOD_HYSTERESIS), so that it doesn't switch back and forth on the threshold.
+	/// The coarse meshes are built in the background : the full mesh is drawn until they are ready.
+	/// </summary>
+	/// <param name="camera">The camera</param>
+	/// <param name="deviceRes">The game's device resources</param>
+	void UpdateLods(Camera* camera, DeviceResources* deviceRes);
+
+	/// <summary>
+	/// Adds a building to the map and the economy, without updating its instance buffer
+	/// </summary>
+	/// <param name="type">the building's type</param>
+	/// <param name="x">The building's X position</param>
+	/// <param name="y">The building's Y position</param>
+	/// <param name="z">The building's Z position</param>
+	void AddBuilding(Building type, int x, int y, int z);
+
+	/// <summary>
+	/// Removes a building from the map and the economy, without updating its instance buffer
+	/// </summary>
+	/// <param name="x">The building's X position</param>
+	/// <param name="y">The building's Y position</param>
+	/// <param name="z">The building's Z position</param>
+	/// <returns>The removed building's type, NOTHING if there was none</returns>
+	Building EraseBuilding(int x, int y, int z);
+
+	/// <summary>
+	/// Changes a block, updates the light around it, and marks its chunk for the autosave and its section for the remeshing.
+	/// The neighbour sections are only marked when the block is on their border (or when their light changed), as their faces can't change otherwise.
+	/// </summary>
+	/// <param name="gx">The block's X position</param>
+	/// <param name="gy">The block's Y position</param>
+	/// <param name="gz">The block's Z position</param>
+	/// <param name="block">The new block's ID</param>
+	/// <returns>True if the block changed</returns>
+	bool SetBlock(int gx, int gy, int gz, BlockId block);
+
+	/// <summary>
+	/// Gets the income given by some tiles (the buildings next to a road)
+	/// </summary>
+	/// <param name="tiles">The tiles' indices</param>
+	/// <returns>The income</returns>
+	int GetIncomeOf(const std::vector<uint32_t>& tiles);
+
+	// Removes every building, without touching the terrain
+	void ResetBuildings();
+
+	// Marks every building page as changed since the last autosave
+	void MarkBuildingPagesDirty();
+
 	/// <summary>
 	/// Regenerates the buffer for a specific building type
 	/// </summary>
@@ -197,4 +530,17 @@ private:
 	/// </summary>
 	/// <param name="deviceRes">The game's device resources</param>
 	void Create(DeviceResources* deviceRes);
+
+	/// <summary>
+	/// Creates the buildings' models
+	/// </summary>
+	/// <param name="deviceRes">The game's device resources</param>
+	void CreateModels(DeviceResources* deviceRes);
+
+	/// <summary>
+	/// Regenerates the chunks' meshes. Meshes are built in parallel on the job system, then uploaded.
+	/// </summary>
+	/// <param name="deviceRes">The game's device resources</param>
+	/// <param name="onlyDirty">Only regenerates the chunks that need it</param>
+	void RegenerateChunks(DeviceResources* deviceRes, bool onlyDirty);
 };
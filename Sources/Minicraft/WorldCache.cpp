@@ -0,0 +1,181 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "Engine/MappedFile.h"
+#include "WorldCache.h"
+#include "World.h"
+#include "Chunk.h"
+#include "Cube3D.h"
+
+// "MCWC"
+static constexpr uint32_t CACHE_MAGIC = 0x4357434D;
+// To increment whenever the layout of the file or the meaning of its data changes
+static constexpr uint32_t CACHE_VERSION = 5;
+
+/// <summary>
+/// Start of a compiled map. Followed by the payload :
+/// - The blocks of every chunk, each followed by its block states (see WriteBlockStates)
+/// - The building of every tile (1 byte each)
+/// - The economy (energy, water, income)
+/// - For every building type : the number of buildings, then their positions
+/// - For every chunk and shader pass : the number of vertices and indices, then the vertices and indices,
+///   followed by the chunk's section ranges
+/// </summary>
+struct WorldCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	// Sizes the data depends on
+	uint32_t worldSize;
+	uint32_t worldHeight;
+	uint32_t chunkSize;
+	uint32_t sectionHeight;
+	uint32_t vertexSize;
+
+	WorldCacheKey key;
+
+	uint64_t payloadSize;
+	// FNV-1a of the payload
+	uint64_t checksum;
+};
+
+static WorldCacheHeader MakeHeader(const WorldCacheKey& key) {
+	WorldCacheHeader header = {};
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.worldSize = WORLD_SIZE;
+	header.worldHeight = WORLD_HEIGHT;
+	header.chunkSize = CHUNK_SIZE;
+	header.sectionHeight = SECTION_HEIGHT;
+	header.vertexSize = sizeof(VertexLayout_PositionNormalUV);
+	header.key = key;
+	return header;
+}
+
+bool WorldCacheKey::FromFile(const std::wstring& sourcePath, float treeThreshold, WorldCacheKey& key) {
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(sourcePath.c_str(), GetFileExInfoStandard, &attributes)) return false;
+
+	key = {};
+	key.sourceSize = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	key.sourceTime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	key.treeThreshold = treeThreshold;
+	return true;
+}
+
+std::wstring WorldCache::GetPath(const std::wstring& mapName) {
+	return L"Cache/" + mapName + L".wcache";
+}
+
+bool WorldCache::Load(World& world, const std::wstring& path, const WorldCacheKey& key) {
+	MappedFile file;
+	if (!file.Open(path) || file.GetSize() < sizeof(WorldCacheHeader)) return false;
+
+	// Everything is checked before touching the world
+	WorldCacheHeader header;
+	memcpy(&header, file.GetData(), sizeof(header));
+
+	WorldCacheHeader expected = MakeHeader(key);
+	if (header.magic != expected.magic || header.version != expected.version ||
+		header.worldSize != expected.worldSize || header.worldHeight != expected.worldHeight ||
+		header.chunkSize != expected.chunkSize || header.sectionHeight != expected.sectionHeight || header.vertexSize != expected.vertexSize ||
+		!(header.key == key)) return false;
+
+	const uint8_t* payload = file.GetData() + sizeof(header);
+	if (header.payloadSize != file.GetSize() - sizeof(header)) return false;
+	if (Fnv1a64(payload, header.payloadSize) != header.checksum) return false;
+
+	BinaryReader reader(payload, header.payloadSize);
+	world.Reset();
+
+	// Blocks
+	const int chunkCount = WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT;
+	for (int idx = 0; idx < chunkCount; idx++) {
+		reader.ReadBytes(world.chunks[idx]->data, Chunk::BLOCK_COUNT * sizeof(BlockId));
+		if (!ReadBlockStates(reader, world.chunks[idx]->data, Chunk::BLOCK_COUNT, world.chunks[idx]->states)) return false;
+	}
+
+	// Buildings
+	const int tileCount = WORLD_SIZE * CHUNK_SIZE * WORLD_SIZE * CHUNK_SIZE;
+	const uint8_t* tiles = reader.Skip(tileCount);
+	if (!tiles) return false;
+	for (int i = 0; i < tileCount; i++) {
+		if (tiles[i] > ROAD) return false;
+		world.buildings[i] = (Building)tiles[i];
+	}
+
+	reader.Read(world.energyGain);
+	reader.Read(world.waterGain);
+	reader.Read(world.passiveIncome);
+
+	for (int type = TREE; type <= ROAD; type++) {
+		uint32_t count = 0;
+		if (!reader.Read(count) || count > (uint32_t)tileCount) return false;
+
+		std::vector<Vector3>* positions = world.buildingsPositions[(Building)type].positions;
+		positions->resize(count);
+		reader.ReadBytes(positions->data(), count * sizeof(Vector3));
+	}
+
+	// Meshes
+	for (int idx = 0; idx < chunkCount; idx++) {
+		if (!world.chunks[idx]->ReadMesh(reader)) return false;
+	}
+	if (reader.HasFailed() || reader.GetRemaining() != 0) return false;
+
+	// The column masks and the light aren't cached : the meshes already hold them, they are only computed again for the next changes
+	for (int idx = 0; idx < chunkCount; idx++) world.chunks[idx]->RebuildColumns();
+	world.light.Rebuild(world);
+
+	// Only the GPU resources are left
+	for (int idx = 0; idx < chunkCount; idx++) {
+		world.chunks[idx]->Upload(world.deviceRes);
+	}
+	for (int type = TREE; type <= ROAD; type++) {
+		world.RegenerateBufferFor((Building)type);
+	}
+	world.CreateModels(world.deviceRes);
+	return true;
+}
+
+bool WorldCache::Save(const World& world, const std::wstring& path, const WorldCacheKey& key) {
+	// The meshes of the evicted chunks would be missing
+	const int chunkCount = WORLD_SIZE * WORLD_SIZE * WORLD_HEIGHT;
+	for (int idx = 0; idx < chunkCount; idx++) {
+		if (!world.chunks[idx]->IsLoaded() || !world.chunks[idx]->resident) return false;
+	}
+
+	BinaryWriter writer;
+	WorldCacheHeader header = MakeHeader(key);
+	writer.Write(header);
+
+	for (int idx = 0; idx < chunkCount; idx++) {
+		writer.WriteBytes(world.chunks[idx]->data, Chunk::BLOCK_COUNT * sizeof(BlockId));
+		WriteBlockStates(writer, world.chunks[idx]->states);
+	}
+
+	const int tileCount = WORLD_SIZE * CHUNK_SIZE * WORLD_SIZE * CHUNK_SIZE;
+	for (int i = 0; i < tileCount; i++) {
+		writer.Write((uint8_t)world.buildings[i]);
+	}
+
+	writer.Write(world.energyGain);
+	writer.Write(world.waterGain);
+	writer.Write(world.passiveIncome);
+
+	for (int type = TREE; type <= ROAD; type++) {
+		const std::vector<Vector3>* positions = world.buildingsPositions.at((Building)type).positions;
+		writer.Write((uint32_t)positions->size());
+		writer.WriteBytes(positions->data(), positions->size() * sizeof(Vector3));
+	}
+
+	for (int idx = 0; idx < chunkCount; idx++) {
+		world.chunks[idx]->WriteMesh(writer);
+	}
+
+	header.payloadSize = writer.GetSize() - sizeof(header);
+	header.checksum = Fnv1a64(writer.GetData() + sizeof(header), header.payloadSize);
+	writer.WriteAt(0, header);
+
+	CreateDirectoryW(L"Cache", nullptr);
+	return writer.SaveToFile(path);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+class World;
+
+/// <summary>
+/// What a compiled map was built from. A compiled map is only used if its key matches the current one.
+/// </summary>
+struct WorldCacheKey {
+	// Size and last write time of the map's file
+	uint64_t sourceSize;
+	uint64_t sourceTime;
+	float treeThreshold;
+
+	bool operator==(const WorldCacheKey& other) const {
+		return sourceSize == other.sourceSize && sourceTime == other.sourceTime && treeThreshold == other.treeThreshold;
+	}
+
+	/// <summary>
+	/// Creates the key of a map's file
+	/// </summary>
+	/// <param name="sourcePath">The map's file</param>
+	/// <param name="treeThreshold">The map's tree threshold</param>
+	/// <param name="key">The key</param>
+	/// <returns>False if the file doesn't exist</returns>
+	static bool FromFile(const std::wstring& sourcePath, float treeThreshold, WorldCacheKey& key);
+};
+
+/// <summary>
+/// Compiled maps : the blocks, buildings, economy and chunk meshes of a generated map,
+/// saved in a versioned and checksummed binary file that is memory-mapped and copied back as is.
+/// </summary>
+class WorldCache {
+public:
+	/// <summary>
+	/// Loads a compiled map in the world
+	/// </summary>
+	/// <param name="world">The world</param>
+	/// <param name="path">The compiled map's path</param>
+	/// <param name="key">The key of the map's current file</param>
+	/// <returns>False if the compiled map is missing, outdated or corrupted (the world must then be generated)</returns>
+	static bool Load(World& world, const std::wstring& path, const WorldCacheKey& key);
+
+	/// <summary>
+	/// Compiles the world's current map
+	/// </summary>
+	/// <param name="world">The world, with every chunk loaded and meshed (right after the generation)</param>
+	/// <param name="path">The compiled map's path</param>
+	/// <param name="key">The key of the map's file</param>
+	/// <returns>True if the compiled map was saved</returns>
+	static bool Save(const World& world, const std::wstring& path, const WorldCacheKey& key);
+
+	// Gets the path of a map's compiled file
+	static std::wstring GetPath(const std::wstring& mapName);
+};
@@ -53,12 +53,22 @@
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <system_error>
 #include <tuple>
+#include <type_traits>
 #include <fstream>
 #include <vector>
 #include <map>
 #include <array>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+#include <intrin.h>
 
 #ifdef _DEBUG
 #include <dxgidebug.h>
@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "Engine/MappedFile.h"
+#include "Check.h"
+
+// Random bytes made of runs, like the blocks of a chunk (mostly long runs, some noise)
+static std::vector<uint8_t> MakeRuns(uint32_t& random, size_t size, int maxRun) {
+	std::vector<uint8_t> data;
+	data.reserve(size);
+	while (data.size() < size) {
+		random = random * 1664525u + 1013904223u;
+		size_t run = std::min<size_t>((random >> 8) % maxRun + 1, size - data.size());
+		data.insert(data.end(), run, (uint8_t)(random >> 24));
+	}
+	return data;
+}
+
+// Values and var uints read back as written, WriteAt overwrites in place
+static void TestValues() {
+	const uint64_t varUints[] = { 0, 1, 127, 128, 300, 16383, 16384, UINT32_MAX, (uint64_t)UINT32_MAX + 1, UINT64_MAX };
+
+	BinaryWriter writer;
+	writer.Write<uint32_t>(0);
+	writer.Write(-2.5f);
+	for (uint64_t value : varUints) writer.WriteVarUint(value);
+	writer.WriteBytes("end", 3);
+	writer.WriteAt<uint32_t>(0, 0xDEADBEEF);
+
+	BinaryReader reader(writer.GetData(), writer.GetSize());
+	uint32_t header = 0;
+	float f = 0;
+	CHECK(reader.Read(header) && header == 0xDEADBEEF);
+	CHECK(reader.Read(f) && f == -2.5f);
+	for (uint64_t value : varUints) {
+		uint64_t read = 0;
+		CHECK(reader.ReadVarUint(read) && read == value);
+	}
+	char end[3];
+	CHECK(reader.ReadBytes(end, 3) && memcmp(end, "end", 3) == 0);
+	CHECK(reader.GetRemaining() == 0 && !reader.HasFailed());
+
+	// A read past the end fails, and so do the next ones
+	CHECK(!reader.Read(header) && reader.HasFailed());
+	BinaryReader small(writer.GetData(), 2);
+	CHECK(!small.Read(header) && !small.ReadBytes(end, 1) && small.Skip(0) == nullptr);
+
+	// A var uint cut in the middle, or longer than 10 bytes, is rejected
+	const uint8_t cut[] = { 0x80, 0x80 };
+	const uint8_t tooLong[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+	uint64_t value;
+	BinaryReader cutReader(cut, sizeof(cut)), longReader(tooLong, sizeof(tooLong));
+	CHECK(!cutReader.ReadVarUint(value) && !longReader.ReadVarUint(value));
+}
+
+// Random data round trips, and every broken stream is rejected
+static void TestRle() {
+	// Runs of 1 byte (the worst case), of chunk layers, and longer than a pair can hold
+	const int maxRuns[] = { 1, 16, 256, 1000 };
+	uint32_t random = 1;
+	for (int round = 0; round < 2000; round++) {
+		random = random * 1664525u + 1013904223u;
+		size_t size = (random >> 8) % 5000;
+		std::vector<uint8_t> data = MakeRuns(random, size, maxRuns[round % 4]);
+
+		BinaryWriter writer;
+		writer.Write<uint8_t>(0x7F);
+		writer.WriteRle(data.data(), data.size());
+		writer.Write<uint8_t>(0x7E);
+		CHECK(writer.GetSize() <= data.size() * 2 + 2);
+
+		// The bytes after the runs are read next
+		std::vector<uint8_t> decoded(size, 0xCD);
+		BinaryReader reader(writer.GetData(), writer.GetSize());
+		uint8_t before = 0, after = 0;
+		bool same = reader.Read(before) && reader.ReadRle(decoded.data(), size) && reader.Read(after) && decoded == data;
+		CHECK(same && before == 0x7F && after == 0x7E && reader.GetRemaining() == 0);
+		if (!same) break;
+	}
+
+	// Every truncation of the runs fails
+	std::vector<uint8_t> data = MakeRuns(random, 3000, 40);
+	BinaryWriter writer;
+	writer.WriteRle(data.data(), data.size());
+	std::vector<uint8_t> decoded(data.size());
+	bool rejected = true;
+	for (size_t size = 0; size < writer.GetSize(); size++) {
+		BinaryReader reader(writer.GetData(), size);
+		rejected &= !reader.ReadRle(decoded.data(), decoded.size()) && reader.HasFailed();
+	}
+	CHECK(rejected);
+
+	// Runs going past the expected size fail, without writing after it
+	decoded.assign(data.size() + 16, 0xCD);
+	BinaryReader reader(writer.GetData(), writer.GetSize());
+	CHECK(!reader.ReadRle(decoded.data(), data.size() - 1) && reader.HasFailed());
+	CHECK(std::all_of(decoded.begin() + data.size() - 1, decoded.end(), [](uint8_t b) { return b == 0xCD; }));
+}
+
+// Files : saved (replacing the previous file) and appended
+static void TestFiles() {
+	BinaryWriter first, second;
+	first.WriteBytes("first", 5);
+	second.WriteBytes("second", 6);
+
+	CHECK(first.SaveToFile(L"BinaryStream.bin"));
+	CHECK(second.SaveToFile(L"BinaryStream.bin"));
+	CHECK(first.AppendToFile(L"BinaryStream.bin"));
+
+	MappedFile file;
+	CHECK(file.Open(L"BinaryStream.bin"));
+	CHECK(file.GetSize() == 11 && memcmp(file.GetData(), "secondfirst", 11) == 0);
+	file.Close();
+	std::remove("BinaryStream.bin");
+
+	// A save to a missing directory fails, and leaves no temporary file
+	CHECK(!first.SaveToFile(L"Missing/BinaryStream.bin"));
+}
+
+int main(int argc, char** argv) {
+	TestValues();
+	TestRle();
+	TestFiles();
+
+	// Throughput on chunk-like data (runs of a layer, some noise), of the size given as argument in MB
+	size_t size = (size_t)(argc > 1 ? std::max(atoi(argv[1]), 1) : 64) << 20;
+	uint32_t random = 42;
+	std::vector<uint8_t> data = MakeRuns(random, size, 32);
+
+	auto start = std::chrono::steady_clock::now();
+	BinaryWriter writer;
+	writer.WriteRle(data.data(), data.size());
+	double encodeTime = SecondsSince(start);
+
+	std::vector<uint8_t> decoded(size);
+	start = std::chrono::steady_clock::now();
+	BinaryReader reader(writer.GetData(), writer.GetSize());
+	bool read = reader.ReadRle(decoded.data(), decoded.size());
+	double decodeTime = SecondsSince(start);
+	CHECK(read && decoded == data);
+
+	std::printf("RLE of %zu MB (%.1f%% once encoded) : encode %.0f MB/s, decode %.0f MB/s\n", size >> 20, 100.0 * writer.GetSize() / size,
+		size / 1e6 / encodeTime, size / 1e6 / decodeTime);
+
+	// Var uints of a few bytes, like the sizes and counts of the saves
+	const int count = 4 << 20;
+	BinaryWriter varWriter;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) varWriter.WriteVarUint((uint64_t)i * 2654435761u >> (i & 31));
+	double varEncodeTime = SecondsSince(start);
+
+	BinaryReader varReader(varWriter.GetData(), varWriter.GetSize());
+	bool same = true;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		uint64_t value = 0;
+		same &= varReader.ReadVarUint(value) && value == ((uint64_t)i * 2654435761u >> (i & 31));
+	}
+	double varDecodeTime = SecondsSince(start);
+	CHECK(same);
+	std::printf("Var uints : encode %.1f M/s, decode %.1f M/s\n", count / 1e6 / varEncodeTime, count / 1e6 / varDecodeTime);
+	return FailedChecks();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Number of failed checks of the test executable : main returns it, so that a failure fails the test
+inline int& FailedChecks() {
+	static int count = 0;
+	return count;
+}
+
+// Prints the failed condition and counts it, without stopping the test
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s(%d) : check failed : %s\n", __FILE__, __LINE__, #condition); \
+			FailedChecks()++; \
+		} \
+	} while (0)
+
+// Gets the seconds elapsed since a time point
+inline double SecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
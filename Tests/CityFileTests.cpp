@@ -0,0 +1,218 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "Engine/JobSystem.h"
+#include "Engine/MappedFile.h"
+#include "Engine/RegionSet.h"
+#include "Minicraft/CityFile.h"
+#include "Check.h"
+
+// A small world : a few chunks, and the building types of the game
+static constexpr CityLayout LAYOUT = { 3, 2, 16, 8 };
+
+static uint32_t Next(uint32_t& random) {
+	random = random * 1664525u + 1013904223u;
+	return random >> 8;
+}
+
+// A city of random runs of blocks, with furnaces facing every way, buildings and an economy
+static CityState MakeCity(const CityLayout& layout, uint32_t seed) {
+	uint32_t random = seed;
+	CityState city;
+	city.blocks.resize((size_t)layout.GetChunkCount() * layout.GetChunkBlocks());
+	for (size_t i = 0; i < city.blocks.size();) {
+		size_t run = std::min<size_t>(1 + Next(random) % 40, city.blocks.size() - i);
+		BlockId block = (BlockId)(Next(random) % COUNT);
+		std::fill_n(city.blocks.begin() + i, run, block);
+		i += run;
+	}
+
+	city.states.resize(layout.GetChunkCount());
+	for (int idx = 0; idx < layout.GetChunkCount(); idx++) {
+		BlockId* blocks = &city.blocks[(size_t)idx * layout.GetChunkBlocks()];
+		for (int cell = (int)(Next(random) % 64); cell < layout.GetChunkBlocks(); cell += 1 + (int)(Next(random) % 300)) {
+			blocks[cell] = FURNACE;
+			city.states[idx].push_back({ (uint16_t)cell, (uint8_t)(1 + Next(random) % (BS_FACING_MASK | BS_ON)) });
+		}
+	}
+
+	city.tiles.resize(layout.GetTileCount());
+	for (size_t i = 0; i < city.tiles.size();) {
+		size_t run = std::min<size_t>(1 + Next(random) % 20, city.tiles.size() - i);
+		std::fill_n(city.tiles.begin() + i, run, (uint8_t)(Next(random) % layout.buildingTypes));
+		i += run;
+	}
+	city.positions.resize(layout.buildingTypes);
+	for (int type = 1; type < layout.buildingTypes; type++) {
+		for (uint32_t i = Next(random) % 50; i > 0; i--) city.positions[type].push_back({ (float)(Next(random) % 96), 3.5f, (float)(Next(random) % 96) });
+	}
+
+	city.energyGain = -12;
+	city.waterGain = 7;
+	city.passiveIncome = (int)(Next(random) % 1000);
+	city.playerPosition = { 12.5f, 30, -4.25f };
+	city.playerYaw = 1.25f;
+	city.money = (int)seed;
+	city.incomeCooldown = 0.5f;
+	return city;
+}
+
+static bool SameCity(const CityState& a, const CityState& b) {
+	if (a.blocks != b.blocks || a.tiles != b.tiles || a.states.size() != b.states.size() || a.positions.size() != b.positions.size()) return false;
+	for (size_t idx = 0; idx < a.states.size(); idx++) {
+		if (a.states[idx].size() != b.states[idx].size()) return false;
+		for (size_t i = 0; i < a.states[idx].size(); i++) {
+			if (a.states[idx][i].cell != b.states[idx][i].cell || a.states[idx][i].state != b.states[idx][i].state) return false;
+		}
+	}
+	for (size_t type = 0; type < a.positions.size(); type++) {
+		if (a.positions[type].size() != b.positions[type].size()) return false;
+		if (memcmp(a.positions[type].data(), b.positions[type].data(), a.positions[type].size() * sizeof(CityPosition)) != 0) return false;
+	}
+	return a.energyGain == b.energyGain && a.waterGain == b.waterGain && a.passiveIncome == b.passiveIncome &&
+		memcmp(&a.playerPosition, &b.playerPosition, sizeof(CityPosition)) == 0 && a.playerYaw == b.playerYaw && a.money == b.money &&
+		a.incomeCooldown == b.incomeCooldown;
+}
+
+static std::vector<uint8_t> ReadFile(const std::wstring& path) {
+	MappedFile file;
+	if (!file.Open(path)) return {};
+	return std::vector<uint8_t>(file.GetData(), file.GetData() + file.GetSize());
+}
+
+static bool WriteFile(const std::wstring& path, const std::vector<uint8_t>& bytes) {
+	BinaryWriter writer;
+	writer.WriteBytes(bytes.data(), bytes.size());
+	return writer.SaveToFile(path);
+}
+
+static bool Exists(const std::wstring& path) {
+	MappedFile file;
+	return file.Open(path);
+}
+
+// Deletes a save and the chunks of its generations
+static void DeleteSave(const std::wstring& path, const CityLayout& layout, uint32_t lastGeneration) {
+	for (uint32_t generation = 1; generation <= lastGeneration; generation++) {
+		RegionSet regions(CityFile::GetChunksDirectory(path, generation), false);
+		int x, z;
+		for (int idx = 0; idx < layout.GetChunkCount(); idx++) regions.Get(idx % layout.worldSize, (idx / layout.worldSize) % layout.worldHeight, idx / (layout.worldSize * layout.worldHeight), false, x, z);
+		regions.Delete();
+	}
+	std::remove(ToUtf8(path).c_str());
+}
+
+// A city reads back as written. A save written over replaces the previous one, whose chunks are deleted.
+static void TestRoundTrip() {
+	const std::wstring path = L"RoundTrip.city";
+	CityState first = MakeCity(LAYOUT, 1), second = MakeCity(LAYOUT, 2), read;
+	std::string error;
+
+	CHECK(CityFile::Write(path, LAYOUT, first));
+	CHECK(CityFile::Read(path, LAYOUT, read, error) && error.empty());
+	CHECK(SameCity(first, read));
+
+	CHECK(CityFile::Write(path, LAYOUT, second));
+	CHECK(CityFile::Read(path, LAYOUT, read, error));
+	CHECK(SameCity(second, read));
+	CHECK(!Exists(RegionFile::GetPath(CityFile::GetChunksDirectory(path, 1), 0, 0, 0)));
+	CHECK(Exists(RegionFile::GetPath(CityFile::GetChunksDirectory(path, 2), 0, 0, 0)));
+	DeleteSave(path, LAYOUT, 2);
+}
+
+// Every broken save is rejected with its reason
+static void TestRejected() {
+	const std::wstring path = L"Rejected.city";
+	CityState city = MakeCity(LAYOUT, 3), read;
+	std::string error;
+	CHECK(CityFile::Write(path, LAYOUT, city));
+	const std::vector<uint8_t> bytes = ReadFile(path);
+	CHECK(bytes.size() > 64);
+
+	CHECK(!CityFile::Read(L"Missing.city", LAYOUT, read, error) && error == "Could not open the save");
+
+	// The header starts with the magic, then the version
+	std::vector<uint8_t> changed = bytes;
+	changed[0] ^= 1;
+	CHECK(WriteFile(path, changed));
+	CHECK(!CityFile::Read(path, LAYOUT, read, error) && error == "The file isn't a save");
+
+	changed = bytes;
+	changed[4] ^= 1;
+	CHECK(WriteFile(path, changed));
+	CHECK(!CityFile::Read(path, LAYOUT, read, error) && error == "The save was made with another version of the game");
+
+	CHECK(WriteFile(path, bytes));
+	CityLayout other = LAYOUT;
+	other.buildingTypes++;
+	CHECK(!CityFile::Read(path, other, read, error) && error == "The save was made for another world size");
+
+	// A flipped byte in the payload, and the file cut anywhere
+	changed = bytes;
+	changed[bytes.size() - 10] ^= 0x10;
+	CHECK(WriteFile(path, changed));
+	CHECK(!CityFile::Read(path, LAYOUT, read, error) && error == "The save is corrupted");
+	bool cutRejected = true;
+	for (size_t size : { (size_t)0, (size_t)20, bytes.size() / 2, bytes.size() - 1 }) {
+		CHECK(WriteFile(path, std::vector<uint8_t>(bytes.begin(), bytes.begin() + size)));
+		cutRejected &= !CityFile::Read(path, LAYOUT, read, error) && error == "The save is corrupted";
+	}
+	CHECK(cutRejected);
+
+	// A chunk written over by another city doesn't match its checksum
+	CHECK(WriteFile(path, bytes));
+	{
+		RegionSet regions(CityFile::GetChunksDirectory(path, 1), false);
+		int x, z;
+		RegionFile* region = regions.Get(1, 0, 0, false, x, z);
+		CHECK(region && region->Write(x, z, "other", 5, false));
+	}
+	CHECK(!CityFile::Read(path, LAYOUT, read, error) && error == "The save is corrupted");
+	DeleteSave(path, LAYOUT, 1);
+
+	// A state on a block that can't turn
+	CityState unturnable = MakeCity(LAYOUT, 4);
+	unturnable.blocks[unturnable.states[0][0].cell] = STONE;
+	CHECK(CityFile::Write(path, LAYOUT, unturnable));
+	CHECK(!CityFile::Read(path, LAYOUT, read, error) && error == "The save is corrupted");
+
+	// A tile with a building type the game doesn't have
+	CityState unknown = MakeCity(LAYOUT, 5);
+	unknown.tiles[7] = (uint8_t)LAYOUT.buildingTypes;
+	CHECK(CityFile::Write(path, LAYOUT, unknown));
+	CHECK(!CityFile::Read(path, LAYOUT, read, error) && error == "The save is corrupted");
+
+	// The chunks deleted under the save
+	DeleteSave(path, LAYOUT, 2);
+	CHECK(CityFile::Write(path, LAYOUT, city));
+	{
+		RegionSet regions(CityFile::GetChunksDirectory(path, 1), false);
+		int x, z;
+		regions.Get(0, 0, 0, false, x, z);
+		regions.Delete();
+	}
+	CHECK(!CityFile::Read(path, LAYOUT, read, error) && error == "The chunks of the save are missing");
+	DeleteSave(path, LAYOUT, 1);
+}
+
+int main(int argc, char** argv) {
+	JobSystem jobSystem(std::max((int)std::thread::hardware_concurrency() - 1, 1));
+	TestRoundTrip();
+	TestRejected();
+
+	// Save and load times of a larger world, of the size given as argument in chunks along X and Z
+	CityLayout layout = { argc > 1 ? std::max(atoi(argv[1]), 1) : 16, 1, 16, 8 };
+	CityState city = MakeCity(layout, 42), read;
+	std::string error;
+	auto start = std::chrono::steady_clock::now();
+	CHECK(CityFile::Write(L"Benchmark.city", layout, city));
+	double writeTime = SecondsSince(start);
+	start = std::chrono::steady_clock::now();
+	CHECK(CityFile::Read(L"Benchmark.city", layout, read, error));
+	double readTime = SecondsSince(start);
+	CHECK(SameCity(city, read));
+	std::printf("City of %d chunks (%.1f MB of blocks) : save %.1f ms, load %.1f ms\n", layout.GetChunkCount(), city.blocks.size() / 1e6,
+		writeTime * 1000, readTime * 1000);
+	DeleteSave(L"Benchmark.city", layout, 1);
+	return FailedChecks();
+}
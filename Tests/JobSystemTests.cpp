@@ -0,0 +1,95 @@
+#include "pch.h"
+
+#include "Engine/JobSystem.h"
+#include "Check.h"
+
+// Work of a job in the scaling benchmark : a few microseconds of arithmetic the compiler can't skip
+static uint64_t Work(int item) {
+	uint64_t hash = 14695981039346656037ull ^ (uint64_t)item;
+	for (int i = 0; i < 20000; i++) {
+		hash ^= (uint64_t)i;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Every item of a ParallelFor is visited once, whatever the count and grain size
+static void TestParallelFor() {
+	for (int count : { 0, 1, 7, 64, 1000, 4099 }) {
+		for (int grainSize : { 0, 1, 3, 64, 5000 }) {
+			std::vector<std::atomic<int>> visits(count);
+			JobSystem::Get()->ParallelFor(count, grainSize, [&visits](int begin, int end) {
+				for (int i = begin; i < end; i++) visits[i]++;
+			});
+			bool once = true;
+			for (const auto& visit : visits) once &= visit.load() == 1;
+			CHECK(once);
+		}
+	}
+}
+
+// A counter is done once all its jobs ran, including the jobs scheduled by jobs
+static void TestCounters() {
+	std::atomic<int> runs = 0;
+	JobCounter counter;
+	for (int i = 0; i < 200; i++) {
+		JobSystem::Get()->Schedule([&runs, &counter]() {
+			runs++;
+			JobSystem::Get()->Schedule([&runs]() { runs++; }, &counter);
+		}, &counter);
+	}
+	JobSystem::Get()->Wait(&counter);
+	CHECK(counter.IsDone());
+	CHECK(runs == 400);
+}
+
+// A job scheduled after a counter starts once every job of the counter is done
+static void TestDependencies() {
+	for (int round = 0; round < 50; round++) {
+		std::atomic<int> first = 0;
+		std::atomic<int> seenByLater = -1;
+		JobCounter firstJobs, laterJobs;
+		for (int i = 0; i < 16; i++) JobSystem::Get()->Schedule([&first]() { first++; }, &firstJobs);
+		JobSystem::Get()->ScheduleAfter(&firstJobs, [&first, &seenByLater]() { seenByLater = first.load(); }, &laterJobs);
+		JobSystem::Get()->Wait(&laterJobs);
+		JobSystem::Get()->Wait(&firstJobs);
+		CHECK(seenByLater == 16);
+	}
+}
+
+int main(int argc, char** argv) {
+	// The scaling goes up to the hardware threads, or to the count given as argument
+	int maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	if (argc > 1) maxThreads = std::max(atoi(argv[1]), 1);
+
+	{
+		// At least one background thread, so that the jobs really run on other threads
+		JobSystem jobSystem(std::max(maxThreads - 1, 1));
+		TestParallelFor();
+		TestCounters();
+		TestDependencies();
+	}
+
+	// The same work on 1 to N workers (the calling thread included)
+	const int items = 2048;
+	double singleTime = 0;
+	std::printf("Workers  Time (ms)  Speedup\n");
+	for (int workers = 1; workers <= maxThreads; workers++) {
+		JobSystem jobSystem(workers - 1);
+		CHECK(jobSystem.GetWorkerCount() == workers);
+
+		std::vector<uint64_t> results(items);
+		auto start = std::chrono::steady_clock::now();
+		jobSystem.ParallelFor(items, 16, [&results](int begin, int end) {
+			for (int i = begin; i < end; i++) results[i] = Work(i);
+		});
+		double time = SecondsSince(start);
+		if (workers == 1) singleTime = time;
+
+		bool same = true;
+		for (int i = 0; i < items; i += 97) same &= results[i] == Work(i);
+		CHECK(same);
+		std::printf("%7d  %9.1f  %7.2f\n", workers, time * 1000, singleTime / time);
+	}
+	return FailedChecks();
+}
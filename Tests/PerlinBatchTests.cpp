@@ -0,0 +1,73 @@
+#include "pch.h"
+
+#include <random>
+#include "Minicraft/PerlinBatch.h"
+#include "Check.h"
+
+// Counts the values that differ from siv::PerlinNoise's noise2D, bit for bit
+static int CountMismatches(const siv::BasicPerlinNoise<float>& noise, const PerlinBatch& batch, std::mt19937& random, int points) {
+	// The generators sample up to a few thousand blocks away, with the fractions of the octaves
+	std::uniform_real_distribution<float> coordinate(-4096.0f, 4096.0f);
+	std::vector<float> xs(points), ys(points), out(points);
+	for (int i = 0; i < points; i++) {
+		xs[i] = coordinate(random);
+		ys[i] = coordinate(random);
+	}
+
+	int mismatches = 0;
+	batch.Noise2D(xs.data(), ys.data(), out.data(), points);
+	for (int i = 0; i < points; i++) {
+		float expected = noise.noise2D(xs[i], ys[i]);
+		mismatches += memcmp(&expected, &out[i], sizeof(float)) != 0;
+	}
+
+	// Rows of every length : the ends go through the narrower paths
+	for (int count = 1; count <= 67; count++) {
+		batch.Noise2DRow(xs.data(), ys[count], out.data(), count);
+		for (int i = 0; i < count; i++) {
+			float expected = noise.noise2D(xs[i], ys[count]);
+			mismatches += memcmp(&expected, &out[i], sizeof(float)) != 0;
+		}
+	}
+	return mismatches;
+}
+
+int main() {
+	const int points = 200000;
+	for (uint32_t seed : { 1u, 42u, 786768768u }) {
+		siv::BasicPerlinNoise<float> noise(seed);
+		std::mt19937 random(seed);
+
+		PerlinBatch batch(noise);
+		const char* widest = batch.GetInstructionSet();
+		int mismatches = CountMismatches(noise, batch, random, points);
+		std::printf("Seed %u, %s : %d mismatches over %d points\n", seed, widest, mismatches, points);
+		CHECK(mismatches == 0);
+
+		// SSE2 too, when AVX2 was used above
+		batch.DisableAvx2();
+		if (strcmp(widest, "SSE2") != 0) {
+			mismatches = CountMismatches(noise, batch, random, points);
+			std::printf("Seed %u, SSE2 : %d mismatches over %d points\n", seed, mismatches, points);
+			CHECK(mismatches == 0);
+		}
+
+		// Throughput of the batches against the scalar noise
+		std::vector<float> xs(4096), out(4096);
+		for (int i = 0; i < 4096; i++) xs[i] = i * 0.37f;
+		auto start = std::chrono::steady_clock::now();
+		for (int row = 0; row < 256; row++) batch.Noise2DRow(xs.data(), row * 0.37f, out.data(), 4096);
+		double batchTime = SecondsSince(start);
+		float sum = 0;
+		start = std::chrono::steady_clock::now();
+		for (int row = 0; row < 256; row++) {
+			for (int i = 0; i < 4096; i++) sum += noise.noise2D(xs[i], row * 0.37f);
+		}
+		double scalarTime = SecondsSince(start);
+		// Kept, so that the scalar loop isn't optimized away
+		volatile float sink = sum;
+		(void)sink;
+		std::printf("  %s rows : %.2f ns per point, scalar : %.2f ns per point\n", batch.GetInstructionSet(), batchTime * 1e9 / (256 * 4096), scalarTime * 1e9 / (256 * 4096));
+	}
+	return FailedChecks();
+}
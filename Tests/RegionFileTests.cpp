@@ -0,0 +1,208 @@
+#include "pch.h"
+
+#include "Engine/BinaryStream.h"
+#include "Engine/MappedFile.h"
+#include "Engine/RegionFile.h"
+#include "Engine/RegionSet.h"
+#include "Check.h"
+
+static uint32_t Next(uint32_t& random) {
+	random = random * 1664525u + 1013904223u;
+	return random >> 8;
+}
+
+// Random bytes made of runs, like the blocks and light of a chunk
+static std::vector<uint8_t> MakeRuns(uint32_t& random, size_t size, int maxRun) {
+	std::vector<uint8_t> data;
+	data.reserve(size);
+	while (data.size() < size) {
+		size_t run = std::min<size_t>(Next(random) % maxRun + 1, size - data.size());
+		data.insert(data.end(), run, (uint8_t)Next(random));
+	}
+	return data;
+}
+
+// True if every chunk of the region has the blob of the reference, or none if the reference has none
+static bool MatchesReference(RegionFile& region, const std::vector<std::vector<uint8_t>>& blobs, const std::vector<bool>& written) {
+	std::vector<uint8_t> read;
+	for (int index = 0; index < RegionFile::ENTRY_COUNT; index++) {
+		int x = index % RegionFile::REGION_SIZE, z = index / RegionFile::REGION_SIZE;
+		if (region.Has(x, z) != written[index]) return false;
+		if (written[index] && (!region.Read(x, z, read) || read != blobs[index])) return false;
+	}
+	return true;
+}
+
+// Random writes (of any size, empty included, compressed or not) and removes read back as in a reference, before and after
+// reopening the file
+static void TestRandomWrites() {
+	std::vector<std::vector<uint8_t>> blobs(RegionFile::ENTRY_COUNT);
+	std::vector<bool> written(RegionFile::ENTRY_COUNT, false);
+	uint32_t random = 7;
+
+	RegionFile region;
+	CHECK(region.Open(L"Random.region", true));
+	bool same = true;
+	for (int i = 0; i < 4000; i++) {
+		int index = Next(random) % 64;
+		int x = index % RegionFile::REGION_SIZE, z = index / RegionFile::REGION_SIZE;
+		if (Next(random) % 4 == 0) {
+			same &= region.Remove(x, z) == written[index];
+			written[index] = false;
+			continue;
+		}
+		// From empty to several sectors, so that the blobs move and leave holes of every size
+		size_t size = Next(random) % 16 == 0 ? 0 : Next(random) % 20000;
+		blobs[index] = MakeRuns(random, size, 1 + Next(random) % 64);
+		same &= region.Write(x, z, blobs[index].data(), blobs[index].size(), Next(random) % 2 == 0);
+		written[index] = true;
+		same &= region.GetTimestamp(x, z) > 0;
+	}
+	CHECK(same);
+	CHECK(MatchesReference(region, blobs, written));
+	CHECK(!region.Write(RegionFile::REGION_SIZE, 0, "x", 1, false) && !region.Has(-1, 0));
+
+	region.Close();
+	CHECK(region.Open(L"Random.region", false));
+	CHECK(MatchesReference(region, blobs, written));
+
+	// Once every blob is removed, the file is back to its table : no sector is lost
+	for (int index = 0; index < RegionFile::ENTRY_COUNT; index++) {
+		if (written[index]) CHECK(region.Remove(index % RegionFile::REGION_SIZE, index / RegionFile::REGION_SIZE));
+	}
+	CHECK(region.GetFreeSectorCount() == 0);
+
+	// An empty blob written last in a new file doesn't point past its end
+	const char blob[] = "blob";
+	CHECK(region.Open(L"Random.region", true));
+	CHECK(region.Write(0, 0, blob, sizeof(blob), false) && region.Write(1, 0, blob, 0, true));
+	region.Close();
+	CHECK(region.Open(L"Random.region", false));
+	CHECK(region.Has(0, 0) && region.Read(0, 0, blobs[0]) && blobs[0].size() == sizeof(blob));
+	CHECK(region.Has(1, 0) && region.Read(1, 0, blobs[1]) && blobs[1].empty());
+	region.Close();
+	std::remove("Random.region");
+}
+
+// A broken blob fails to read, a broken table or header starts the file again
+static void TestCorruption() {
+	uint32_t random = 11;
+	std::vector<uint8_t> blob = MakeRuns(random, 10000, 16);
+	std::vector<uint8_t> read;
+
+	RegionFile region;
+	CHECK(region.Open(L"Corrupted.region", true));
+	CHECK(region.Write(3, 5, blob.data(), blob.size(), false));
+	CHECK(region.Write(4, 5, blob.data(), blob.size(), false));
+	region.Close();
+
+	std::vector<uint8_t> bytes;
+	{
+		MappedFile file;
+		CHECK(file.Open(L"Corrupted.region"));
+		bytes.assign(file.GetData(), file.GetData() + file.GetSize());
+	}
+	// The first blob starts right after the table, the second one on the next free sector and ends the file
+	size_t blobSectors = (blob.size() + RegionFile::SECTOR_SIZE - 1) / RegionFile::SECTOR_SIZE;
+	size_t tableSize = bytes.size() - blobSectors * RegionFile::SECTOR_SIZE - blob.size();
+
+	// A flipped byte in the first blob : the other one still reads
+	BinaryWriter flipped;
+	flipped.WriteBytes(bytes.data(), bytes.size());
+	flipped.WriteAt<uint8_t>(tableSize + 10, bytes[tableSize + 10] ^ 0x40);
+	CHECK(flipped.SaveToFile(L"Corrupted.region"));
+	CHECK(region.Open(L"Corrupted.region", false));
+	CHECK(region.Has(3, 5) && !region.Read(3, 5, read));
+	CHECK(region.Read(4, 5, read) && read == blob);
+	region.Close();
+
+	// The file cut after the table : the blobs it points to are out of it
+	BinaryWriter cut;
+	cut.WriteBytes(bytes.data(), tableSize);
+	CHECK(cut.SaveToFile(L"Corrupted.region"));
+	CHECK(region.Open(L"Corrupted.region", false));
+	CHECK(!region.Has(3, 5) && !region.Has(4, 5));
+	region.Close();
+
+	// Another file altogether
+	BinaryWriter other;
+	other.WriteBytes("not a region", 12);
+	CHECK(other.SaveToFile(L"Corrupted.region"));
+	CHECK(region.Open(L"Corrupted.region", false));
+	CHECK(!region.Has(3, 5));
+	CHECK(region.Write(3, 5, blob.data(), blob.size(), true) && region.Read(3, 5, read) && read == blob);
+	region.Close();
+	std::remove("Corrupted.region");
+}
+
+// The chunks go to the region holding them, negative coordinates included. A truncated set doesn't read the previous session.
+static void TestRegionSet() {
+	const char blob[] = "chunk";
+	std::vector<uint8_t> read;
+	int x = 0, z = 0;
+	{
+		RegionSet regions(L"RegionSet/Layers", false);
+		CHECK(regions.Get(-1, 0, 0, false, x, z) == nullptr);
+		RegionFile* region = regions.Get(-1, 2, 33, true, x, z);
+		CHECK(region && x == RegionFile::REGION_SIZE - 1 && z == 1);
+		CHECK(region && region->Write(x, z, blob, sizeof(blob), false));
+		CHECK(regions.Get(-32, 2, 63, false, x, z) == region && x == 0 && z == RegionFile::REGION_SIZE - 1);
+		CHECK(regions.Get(-1, 3, 33, false, x, z) == nullptr);
+	}
+	{
+		RegionSet regions(L"RegionSet/Layers", false);
+		RegionFile* region = regions.Get(-1, 2, 33, false, x, z);
+		CHECK(region && region->Read(x, z, read) && read.size() == sizeof(blob) && memcmp(read.data(), blob, sizeof(blob)) == 0);
+	}
+	{
+		RegionSet regions(L"RegionSet/Layers", true);
+		CHECK(regions.Get(-1, 2, 33, false, x, z) == nullptr);
+		RegionFile* region = regions.Get(-1, 2, 33, true, x, z);
+		CHECK(region && !region->Has(x, z));
+	}
+	std::remove(ToUtf8(RegionFile::GetPath(L"RegionSet/Layers", -1, 2, 1)).c_str());
+	std::remove("RegionSet/Layers");
+	std::remove("RegionSet");
+}
+
+int main(int argc, char** argv) {
+	TestRandomWrites();
+	TestCorruption();
+	TestRegionSet();
+
+	// Throughput on a full region of chunk-like blobs (blocks and light), written over in a few passes (given as argument) then read
+	int passes = argc > 1 ? std::max(atoi(argv[1]), 1) : 2;
+	const size_t blobSize = 2 * 16 * 16 * 16;
+	uint32_t random = 42;
+	std::vector<std::vector<uint8_t>> blobs(RegionFile::ENTRY_COUNT);
+	for (auto& blob : blobs) blob = MakeRuns(random, blobSize, 48);
+
+	RegionFile region;
+	CHECK(region.Open(L"Throughput.region", true));
+	double writeTime = 0;
+	for (int pass = 0; pass < passes; pass++) {
+		auto start = std::chrono::steady_clock::now();
+		bool written = true;
+		for (int index = 0; index < RegionFile::ENTRY_COUNT; index++) {
+			written &= region.Write(index % RegionFile::REGION_SIZE, index / RegionFile::REGION_SIZE, blobs[index].data(), blobSize, true);
+		}
+		writeTime += SecondsSince(start);
+		CHECK(written);
+	}
+
+	std::vector<uint8_t> read;
+	bool same = true;
+	auto start = std::chrono::steady_clock::now();
+	for (int index = 0; index < RegionFile::ENTRY_COUNT; index++) {
+		same &= region.Read(index % RegionFile::REGION_SIZE, index / RegionFile::REGION_SIZE, read) && read == blobs[index];
+	}
+	double readTime = SecondsSince(start);
+	CHECK(same);
+
+	double megabytes = RegionFile::ENTRY_COUNT * blobSize / 1e6;
+	std::printf("Region of %d chunks (%.1f MB) : write %.0f MB/s, read %.0f MB/s, %u sectors (%u free) after %d passes\n", RegionFile::ENTRY_COUNT,
+		megabytes, megabytes * passes / writeTime, megabytes / readTime, region.GetSectorCount(), region.GetFreeSectorCount(), passes);
+	region.Close();
+	std::remove("Throughput.region");
+	return FailedChecks();
+}
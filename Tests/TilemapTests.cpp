@@ -0,0 +1,151 @@
+#include "pch.h"
+
+#include "Engine/MappedFile.h"
+#include "Minicraft/Tilemap.h"
+#include "Check.h"
+
+// Creates a file holding a text, the path can have any characters
+static bool WriteTextFile(const std::wstring& path, const std::string& text) {
+#ifdef _WIN32
+	FILE* file = _wfopen(path.c_str(), L"wb");
+#else
+	FILE* file = fopen(ToUtf8(path).c_str(), "wb");
+#endif
+	if (!file) return false;
+	bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+	return fclose(file) == 0 && written;
+}
+
+static bool ParseCsv(const std::string& text, Tilemap& tilemap, TilemapError& error) {
+	return ParseCsvTilemap(text.data(), text.data() + text.size(), tilemap, error);
+}
+
+// Valid CSV : values, sizes, and the blanks and commas allowed around the rows
+static void TestCsv() {
+	Tilemap tilemap;
+	TilemapError error;
+	CHECK(ParseCsv("1,2,3\n4,5,6\n", tilemap, error));
+	CHECK(tilemap.width == 3 && tilemap.height == 2);
+	CHECK(tilemap.Get(0, 0) == 1 && tilemap.Get(2, 1) == 6);
+
+	CHECK(ParseCsv("\r\n\n 7 , -8,\r\n9,10 ,\r\n\n\n", tilemap, error));
+	CHECK(tilemap.width == 2 && tilemap.height == 2);
+	CHECK(tilemap.Get(1, 0) == -8 && tilemap.Get(1, 1) == 10);
+
+	// The values of 10 digits and more go through std::from_chars
+	CHECK(ParseCsv("2147483647,-2147483648,0000000000012", tilemap, error));
+	CHECK(tilemap.tiles == std::vector<int>({ 2147483647, -2147483647 - 1, 12 }));
+}
+
+// Invalid CSV : the message and position of the error
+static void TestCsvErrors() {
+	struct Case {
+		const char* text;
+		int line;
+		int column;
+		const char* message;
+	};
+	const Case cases[] = {
+		{ "1,2\n3\n", 2, 2, "The row has 1 values, expected 2" },
+		{ "1,2\n\n3,4\n", 2, 1, "Empty line inside the tilemap" },
+		{ "1,,2\n", 1, 3, "Expected a number" },
+		{ "1 2\n", 1, 3, "Expected ',' or the end of the line" },
+		{ "1,x\n", 1, 3, "Expected a number" },
+		{ "5,2147483648\n", 1, 3, "Value out of range" },
+		{ " \r\n\n", 0, 0, "The tilemap is empty" },
+	};
+	for (const Case& test : cases) {
+		Tilemap tilemap;
+		TilemapError error;
+		bool parsed = ParseCsv(test.text, tilemap, error);
+		CHECK(!parsed);
+		CHECK(error.line == test.line && error.column == test.column);
+		CHECK(error.message == test.message);
+		if (parsed || error.message != test.message || error.line != test.line || error.column != test.column) std::printf("  %s\n", error.ToString().c_str());
+	}
+}
+
+// TMX : layers and properties, the global ids become ids in their tileset (without the flip bits of Tiled)
+static void TestTmx() {
+	const std::string text =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<map version=\"1.10\" orientation=\"orthogonal\" width=\"3\" height=\"2\" infinite=\"0\">\n"
+		" <properties>\n"
+		"  <property name=\"seed\" type=\"int\" value=\"42\"/>\n"
+		"  <property name=\"title\" value=\"A &amp; B\"/>\n"
+		" </properties>\n"
+		" <tileset firstgid=\"1\" source=\"blocks.tsx\"/>\n"
+		" <tileset firstgid=\"10\" source=\"buildings.tsx\"/>\n"
+		" <!-- <layer name=\"commented\"> -->\n"
+		" <layer id=\"1\" name=\"Height\" width=\"3\" height=\"2\">\n"
+		"  <data encoding=\"csv\">\n1,3221225474,0,\n10,2147483659,9\n</data>\n"
+		" </layer>\n"
+		"</map>\n";
+	TmxMap map;
+	TilemapError error;
+	CHECK(ParseTmxMap(text.data(), text.data() + text.size(), map, error));
+	CHECK(map.width == 3 && map.height == 2 && map.layers.size() == 1);
+	const TmxLayer* layer = map.FindLayer("height");
+	CHECK(layer && layer->tiles.tiles == std::vector<int>({ 0, 1, -1, 0, 1, 8 }));
+	const std::string* title = map.FindProperty("title");
+	CHECK(title && *title == "A & B");
+	CHECK(map.FindProperty("seed") && !map.FindProperty("Seed"));
+
+	// The errors in the CSV of a layer are given in the file's lines
+	const std::string broken = "<map width=\"2\" height=\"1\">\n<layer name=\"a\">\n<data encoding=\"csv\">1,y</data></layer></map>";
+	CHECK(!ParseTmxMap(broken.data(), broken.data() + broken.size(), map, error));
+	CHECK(error.line == 3 && error.column == 24);
+
+	const std::string infinite = "<map width=\"2\" height=\"1\" infinite=\"1\"></map>";
+	CHECK(!ParseTmxMap(infinite.data(), infinite.data() + infinite.size(), map, error));
+	CHECK(error.message == "Infinite maps are not supported");
+}
+
+// Files : non-ASCII paths are opened, and given in UTF-8 in the errors
+static void TestFiles() {
+	const std::wstring path = L"Tilemap été 測試.csv";
+	CHECK(WriteTextFile(path, "1,2\n3,4\n"));
+	Tilemap tilemap;
+	TilemapError error;
+	CHECK(LoadCsvTilemap(path, tilemap, error));
+	CHECK(tilemap.tiles == std::vector<int>({ 1, 2, 3, 4 }));
+
+	// An empty file isn't mapped, but it is opened
+	CHECK(WriteTextFile(L"Empty.csv", ""));
+	CHECK(!LoadCsvTilemap(L"Empty.csv", tilemap, error) && error.message == "The tilemap is empty");
+
+	CHECK(!LoadCsvTilemap(L"Missing é.csv", tilemap, error));
+	CHECK(error.message == "Could not open Missing \xc3\xa9.csv");
+	CHECK(ToUtf8(L"\U0001F600") == "\xf0\x9f\x98\x80");
+}
+
+int main(int argc, char** argv) {
+	TestCsv();
+	TestCsvErrors();
+	TestTmx();
+	TestFiles();
+
+	// Throughput on a square map of the size given as argument, values as in a height map
+	int size = argc > 1 ? std::max(atoi(argv[1]), 1) : 4096;
+	std::string text;
+	text.reserve((size_t)size * size * 3);
+	uint32_t random = 12345;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			random = random * 1664525u + 1013904223u;
+			text += std::to_string((random >> 24) % 64);
+			text += x + 1 < size ? ',' : '\n';
+		}
+	}
+	CHECK(WriteTextFile(L"Large.csv", text));
+
+	Tilemap tilemap;
+	TilemapError error;
+	auto start = std::chrono::steady_clock::now();
+	bool loaded = LoadCsvTilemap(L"Large.csv", tilemap, error);
+	double time = SecondsSince(start);
+	CHECK(loaded && tilemap.width == size && tilemap.height == size);
+	std::printf("%dx%d CSV (%.1f MB) : %.1f ms, %.0f MB/s\n", size, size, text.size() / 1e6, time * 1000, text.size() / 1e6 / time);
+	std::remove("Large.csv");
+	return FailedChecks();
+}
@@ -0,0 +1,42 @@
+//
+// pch.h
+// Standard include files of the engine sources built by the tests.
+// Takes the place of Sources/pch.h : the tested sources don't use Direct3D, and build on Linux too.
+//
+
+#pragma once
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <map>
+#include <array>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+#include <tuple>
@@ -6,6 +6,7 @@
 #include "Sources/Game.h"
 
 #include <Dbt.h>
+#include <shellapi.h>
 
 using namespace DirectX;
 
@@ -43,6 +44,28 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
 	g_game = std::make_unique<Game>();
 
+	// Checks run without a window, the exit code tells if they passed :
+	// "--replay <file>" plays the replay and checks that it reaches the recorded state
+	// "--check-light [edits]" compares the light updates with full rebuilds after random edits
+	int argc = 0;
+	LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	bool replayCheck = argv && argc == 3 && wcscmp(argv[1], L"--replay") == 0;
+	bool lightCheck = argv && (argc == 2 || argc == 3) && wcscmp(argv[1], L"--check-light") == 0;
+	if (replayCheck || lightCheck) {
+		std::wstring argument = argc == 3 ? argv[2] : L"";
+		LocalFree(argv);
+
+		// Prints in the console the game was started from, if any
+		FILE* console = nullptr;
+		if (AttachConsole(ATTACH_PARENT_PROCESS)) freopen_s(&console, "CONOUT$", "w", stdout);
+
+		int result = replayCheck ? g_game->RunHeadless(argument) : g_game->CheckLightHeadless(argument.empty() ? 500 : _wtoi(argument.c_str()));
+		g_game.reset();
+		CoUninitialize();
+		return result;
+	}
+	LocalFree(argv);
+
 	// Register class and create window
 	{
 		// Register class
@@ -41,6 +41,7 @@ project "SimCity"
 		"d3d11.lib",
 		"dxgi.lib",
 		"DirectXTK.lib",
+		"shell32.lib",
 		
 	}
 